@@ -6,6 +6,9 @@
 #include "game_draw.h"
 #include "game_draw_group.h"
 #include "game_image.h"
+#include "game_tilemap.h"
+#include "game_post_process.h"
+#include "game_task_graph.h"
 #if WIN32
 #include "game_platform_win32.cpp"
 #elif LINUX
@@ -18,10 +21,35 @@
 #include "game_draw.cpp"
 #include "game_draw_group.cpp"
 #include "game_image.cpp"
+#include "game_tilemap.cpp"
+#include "game_post_process.cpp"
+#include "game_task_graph.cpp"
 
 // NOTE(ivan): Capacity of draw group buffer.
 #define MAX_DRAW_GROUP_BUFFER 2048
 
+// NOTE(ivan): Number of row bands the surface is cleared in, see BuildFrameTaskGraph().
+#define NUM_FRAME_CLEAR_BANDS 4
+
+// NOTE(ivan): Everything the frame tasks need, lives on the stack of UpdateGame() while the graph runs.
+struct game_frame {
+	platform_state *PlatformState;
+	platform_api *PlatformAPI;
+	game_api *GameAPI;
+	game_state *State;
+	game_surface_buffer *SurfaceBuffer;
+
+	draw_basis DefaultBasis;
+	draw_group *PrimaryDrawGroup; // NOTE(ivan): Zero until built, or if out of memory.
+};
+
+// NOTE(ivan): Surface clear band task parameters.
+struct game_frame_clear_band {
+	game_frame *Frame;
+	s32 Y0;
+	s32 Y1;
+};
+
 inline void
 PushConfigurationEntry(platform_state *PlatformState,
 					   platform_api *PlatformAPI,
@@ -77,11 +105,11 @@ LOAD_CONFIGURATION(LoadConfiguration)
 
 	// NOTE(ivan): Read data from parent cache.
 	if (Config) {
-		EnterTicketMutex(&Config->ConfigMutex);
+		EnterRWMutexRead(&Config->ConfigMutex);
 		for (game_config_entry *Entry = Config->LastEntry; Entry; Entry = Entry->Prev)
 			PushConfigurationEntry(PlatformState, PlatformAPI,
 								   &Result, Entry->Name, Entry->Value);
-		LeaveTicketMutex(&Config->ConfigMutex);
+		LeaveRWMutexRead(&Config->ConfigMutex);
 		FreeConfiguration(PlatformAPI, Config);
 	}
 	
@@ -116,7 +144,7 @@ SAVE_CONFIGURATION(SaveConfiguration)
 
 	PlatformAPI->Log(PlatformState, "Saving configuration-file '%s'...", FileName);
 
-	EnterTicketMutex(&Config->ConfigMutex);
+	EnterRWMutexRead(&Config->ConfigMutex);
 
 	// NOTE(ivan): We need to write entries in order from the first one to the last one loaded.
 	game_config_entry *FirstEntry = Config->LastEntry;
@@ -126,30 +154,43 @@ SAVE_CONFIGURATION(SaveConfiguration)
 		FirstEntry = FirstEntry->Prev;
 	}
 
-	char Buffer[4096] = {}; // TODO(ivan): dynamically allocate the buffer OR use openfile/writefile/closefile eventually.
-	u32 Pos = 0;
+	// NOTE(ivan): Measure first, then build the whole file in thread scratch memory.
+	u32 Bytes = 0;
 	game_config_entry *Entry = FirstEntry;
 	while (Entry) {
-		Pos += snprintf(Buffer + Pos, CountOf(Buffer) - Pos - 1, "%s %s\n", Entry->Name, Entry->Value);
+		Bytes += snprintf(0, 0, "%s %s\n", Entry->Name, Entry->Value);
 		Entry = Entry->Next;
 	}
 
-	if (Pos)
-		PlatformAPI->WriteEntireFile(FileName, Buffer, Pos);
+	if (Bytes) {
+		memory_stack *Scratch = PlatformAPI->GetThreadScratch();
+		temporary_memory TempMemory = BeginTemporaryMemory(Scratch);
+
+		char *Buffer = (char *)PushStackSize(PlatformState, PlatformAPI, Scratch, Bytes + 1);
+		if (Buffer) {
+			u32 Pos = 0;
+			for (Entry = FirstEntry; Entry; Entry = Entry->Next)
+				Pos += snprintf(Buffer + Pos, Bytes + 1 - Pos, "%s %s\n", Entry->Name, Entry->Value);
+
+			PlatformAPI->WriteEntireFile(FileName, Buffer, Pos);
+		}
+
+		EndTemporaryMemory(TempMemory);
+	}
 
-	LeaveTicketMutex(&Config->ConfigMutex);
+	LeaveRWMutexRead(&Config->ConfigMutex);
 }
 
 FREE_CONFIGURATION(FreeConfiguration)
 {
 	Assert(Config);
 
-	EnterTicketMutex(&Config->ConfigMutex);
+	EnterRWMutexWrite(&Config->ConfigMutex);
 	
 	FreeMemoryStack(PlatformAPI, &Config->ConfigStack);
 	Config->LastEntry = 0;
 
-	LeaveTicketMutex(&Config->ConfigMutex);
+	LeaveRWMutexWrite(&Config->ConfigMutex);
 }
 
 GET_CONFIGURATION_VALUE(GetConfigurationValue)
@@ -158,16 +199,16 @@ GET_CONFIGURATION_VALUE(GetConfigurationValue)
 	Assert(Name);
 	Assert(Default);
 
-	EnterTicketMutex(&Config->ConfigMutex);
+	EnterRWMutexRead(&Config->ConfigMutex);
 
 	for (game_config_entry *Entry = Config->LastEntry; Entry; Entry = Entry->Prev) {
 		if (strcmp(Entry->Name, Name) == 0) {
-			LeaveTicketMutex(&Config->ConfigMutex);
+			LeaveRWMutexRead(&Config->ConfigMutex);
 			return Entry->Value;
 		}
 	}
 
-	LeaveTicketMutex(&Config->ConfigMutex);
+	LeaveRWMutexRead(&Config->ConfigMutex);
 	return Default;
 }
 
@@ -178,26 +219,295 @@ REGISTER_ENTITY(RegisterEntity)
 	Assert(Name);
 	Assert(Update);
 	
-	// NOTE(ivan): Check if already registered.
+	// NOTE(ivan): Check if already registered, update function moves when entities module gets reloaded.
 	for (game_entity_reg *EntityReg = GameState->EntityRegs; EntityReg; EntityReg = EntityReg->Next) {
-		if (strcmp(EntityReg->Name, Name) == 0)
+		if (strcmp(EntityReg->Name, Name) == 0) {
+			Assert(EntityReg->StateBytes == StateBytes);
+			EntityReg->Update = Update;
 			return;
+		}
 	}
 
 	// NOTE(ivan): Register new entity reg.
 	GameAPI->PlatformAPI->Log(GameAPI->PlatformState, "Registering entity \"%s\"...", Name);
 	
-	game_entity_reg *NewEntityReg = PushPoolType(GameAPI->PlatformState,
-												 GameAPI->PlatformAPI,
-												 &GameState->EntityRegsPool,
-												 game_entity_reg);
+	game_entity_reg *NewEntityReg = PushTypedPoolItem(&GameState->EntityRegsPool);
+	if (!NewEntityReg)
+		return;
+	
 	strncpy(NewEntityReg->Name, Name, CountOf(NewEntityReg->Name) - 1);
 	NewEntityReg->StateBytes = StateBytes;
 	NewEntityReg->Update = Update;
+	InitializeMemoryPool(GameAPI->PlatformState,
+						 GameAPI->PlatformAPI,
+						 &NewEntityReg->StatesPool,
+						 "EntityStates",
+						 Max(StateBytes, (u32)1),
+						 64);
 	NewEntityReg->Next = GameState->EntityRegs;
 	GameState->EntityRegs = NewEntityReg;
 }
 
+SPAWN_ENTITY(SpawnEntity)
+{
+	Assert(GameState);
+	Assert(GameAPI);
+	Assert(Name);
+
+	slot_map_handle Result = {};
+	
+	game_entity_reg *EntityReg = GameState->EntityRegs;
+	while (EntityReg && strcmp(EntityReg->Name, Name) != 0)
+		EntityReg = EntityReg->Next;
+	if (!EntityReg) {
+		GameAPI->PlatformAPI->Log(GameAPI->PlatformState, "Entity \"%s\" is not registered!", Name);
+		return Result;
+	}
+
+	void *State = PushPoolSize(GameAPI->PlatformState,
+							   GameAPI->PlatformAPI,
+							   &EntityReg->StatesPool);
+	if (!State)
+		return Result;
+
+	game_entity *Entity = (game_entity *)InsertSlotMapItem(GameAPI->PlatformState,
+														   GameAPI->PlatformAPI,
+														   &GameState->Entities,
+														   &Result);
+	if (!Entity) {
+		FreePoolSize(&EntityReg->StatesPool, State);
+		return Result;
+	}
+
+	Entity->Handle = Result;
+	Entity->Reg = EntityReg;
+	Entity->State = State;
+
+	EntityReg->Update(GameAPI, GameStateType_Prepare, State);
+	return Result;
+}
+
+DESPAWN_ENTITY(DespawnEntity)
+{
+	Assert(GameState);
+	Assert(GameAPI);
+
+	game_entity *Entity = (game_entity *)GetSlotMapItem(&GameState->Entities, Handle);
+	if (!Entity)
+		return false;
+
+	// NOTE(ivan): Copy out, the entity is about to be overwritten by the last one.
+	game_entity_reg *EntityReg = Entity->Reg;
+	void *State = Entity->State;
+	RemoveSlotMapItem(&GameState->Entities, Handle);
+
+	EntityReg->Update(GameAPI, GameStateType_Release, State);
+	FreePoolSize(&EntityReg->StatesPool, State);
+
+	return true;
+}
+
+GET_ENTITY_STATE(GetEntityState)
+{
+	Assert(GameState);
+
+	game_entity *Entity = (game_entity *)GetSlotMapItem(&GameState->Entities, Handle);
+	return Entity ? Entity->State : 0;
+}
+
+// NOTE(ivan): Gives free pool chunks back once memory gets critical, entity states budget or system-wide.
+static MEMORY_PRESSURE_CALLBACK(GameMemoryPressure)
+{
+	UnreferencedParam(PlatformState);
+
+	game_state *State = (game_state *)Param;
+
+	if (Level == MemoryPressureLevel_Critical && (!DebugName || strcmp(DebugName, "EntityStates") == 0)) {
+		for (game_entity_reg *EntityReg = State->EntityRegs; EntityReg; EntityReg = EntityReg->Next)
+			TrimMemoryPool(PlatformAPI, &EntityReg->StatesPool);
+		TrimMemoryPool(PlatformAPI, &State->EntityRegsPool.Pool);
+	}
+}
+
+#if INTERNAL
+// NOTE(ivan): One bar per allocator: dark - reserved, green - used, yellow - high-water mark, red - budget.
+// Bars are scaled against the biggest reservation, there is no text rendering yet, so use the
+// log dump for names and exact numbers.
+static void
+DrawMemoryStatsOverlay(game_surface_buffer *SurfaceBuffer)
+{
+	memory_stats Stats[MAX_MEMORY_STATS];
+	u32 NumStats = GetAllMemoryStats(Stats, CountOf(Stats));
+	if (!NumStats)
+		return;
+
+	u64 MaxBytes = 1;
+	for (u32 Index = 0; Index < NumStats; Index++) {
+		MaxBytes = Max(MaxBytes, Stats[Index].BytesReserved);
+		MaxBytes = Max(MaxBytes, Stats[Index].HighWaterMark);
+		MaxBytes = Max(MaxBytes, Stats[Index].BudgetBytes);
+	}
+
+	f32 Left = 8.0f;
+	f32 Width = (f32)(SurfaceBuffer->Width / 3);
+	f32 BarHeight = 6.0f;
+	f32 Top = 8.0f;
+	for (u32 Index = 0; Index < NumStats; Index++) {
+		memory_stats *Entry = &Stats[Index];
+		f32 Y = Top + (f32)Index * (BarHeight + 2.0f);
+		if (Y + BarHeight >= (f32)SurfaceBuffer->Height)
+			break;
+
+		f32 Reserved = Width * (f32)((f64)Entry->BytesReserved / (f64)MaxBytes);
+		f32 Used = Width * (f32)((f64)Entry->BytesUsed / (f64)MaxBytes);
+		f32 HighWater = Width * (f32)((f64)Entry->HighWaterMark / (f64)MaxBytes);
+
+		DrawRectangle(SurfaceBuffer, MakeV2(Left, Y), MakeV2(Left + Width, Y + BarHeight), MakeRGBA(0.1f, 0.1f, 0.1f, 0.8f));
+		DrawRectangle(SurfaceBuffer, MakeV2(Left, Y), MakeV2(Left + Reserved, Y + BarHeight), MakeRGBA(0.25f, 0.25f, 0.4f, 0.9f));
+		DrawRectangle(SurfaceBuffer, MakeV2(Left, Y), MakeV2(Left + Used, Y + BarHeight), MakeRGBA(0.2f, 0.8f, 0.2f, 1.0f));
+		DrawRectangle(SurfaceBuffer, MakeV2(Left + HighWater, Y), MakeV2(Left + HighWater + 1.0f, Y + BarHeight), MakeRGBA(1.0f, 0.9f, 0.1f, 1.0f));
+		if (Entry->BudgetBytes) {
+			f32 Budget = Width * (f32)((f64)Entry->BudgetBytes / (f64)MaxBytes);
+			DrawRectangle(SurfaceBuffer, MakeV2(Left + Budget, Y), MakeV2(Left + Budget + 1.0f, Y + BarHeight), MakeRGBA(1.0f, 0.1f, 0.1f, 1.0f));
+		}
+	}
+}
+#endif
+
+// NOTE(ivan): Frame tasks, see BuildFrameTaskGraph().
+static WORK_QUEUE_CALLBACK(UpdateEntitiesFrameTask)
+{
+	UnreferencedParam(Queue);
+
+	game_frame *Frame = (game_frame *)Data;
+	game_state *State = Frame->State;
+
+	// NOTE(ivan): Update all game entities through a snapshot of their handles, despawns move items around
+	// so walking the items themselves could update one twice. Entities despawned during the walk are skipped,
+	// ones spawned during it are not in the snapshot and get their first update next frame.
+	u32 NumEntities = State->Entities.NumItems;
+	if (!NumEntities)
+		return;
+
+	slot_map_handle *Handles = PushStackTypeArray(Frame->PlatformState, Frame->PlatformAPI, &State->FrameStack,
+												  slot_map_handle, NumEntities);
+	if (!Handles)
+		return;
+	for (u32 Index = 0; Index < NumEntities; Index++)
+		Handles[Index] = GetSlotMapHandleAt(&State->Entities, Index);
+
+	for (u32 Index = 0; Index < NumEntities; Index++) {
+		game_entity *Entity = (game_entity *)GetSlotMapItem(&State->Entities, Handles[Index]);
+		if (Entity)
+			Entity->Reg->Update(Frame->GameAPI, GameStateType_Frame, Entity->State);
+	}
+}
+
+static WORK_QUEUE_CALLBACK(BuildDrawGroupFrameTask)
+{
+	UnreferencedParam(Queue);
+
+	game_frame *Frame = (game_frame *)Data;
+
+	draw_group *PrimaryDrawGroup = PushStackType(Frame->PlatformState,
+												 Frame->PlatformAPI,
+												 &Frame->State->FrameStack,
+												 draw_group);
+	if (!PrimaryDrawGroup)
+		return;
+
+	Frame->DefaultBasis.Pos = MakeV2(0, 0);
+	PrimaryDrawGroup->DefaultBasis = &Frame->DefaultBasis;
+	if (!InitializeArenaArray(Frame->PlatformState,
+							  Frame->PlatformAPI,
+							  &Frame->State->FrameStack,
+							  &PrimaryDrawGroup->Entries,
+							  MAX_DRAW_GROUP_BUFFER))
+		return;
+
+	Frame->PrimaryDrawGroup = PrimaryDrawGroup;
+}
+
+static WORK_QUEUE_CALLBACK(ClearSurfaceBandFrameTask)
+{
+	UnreferencedParam(Queue);
+
+	game_frame_clear_band *Band = (game_frame_clear_band *)Data;
+	game_surface_buffer *SurfaceBuffer = Band->Frame->SurfaceBuffer;
+
+	// NOTE(ivan): Rectangle's far corner is exclusive, and bands of tiny surfaces may be empty.
+	if (Band->Y1 > Band->Y0 && SurfaceBuffer->Width > 0)
+		DrawRectangle(SurfaceBuffer,
+					  MakeV2(0.0f, (f32)Band->Y0),
+					  MakeV2((f32)SurfaceBuffer->Width, (f32)Band->Y1),
+					  MakeRGBA(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static PARALLEL_FOR_CALLBACK(DrawGroupRowsFrameTask)
+{
+	game_frame *Frame = (game_frame *)Data;
+	DrawGroupRows(Frame->PrimaryDrawGroup, Frame->SurfaceBuffer, (s32)First, (s32)OnePastLast);
+}
+
+static WORK_QUEUE_CALLBACK(DrawGroupFrameTask)
+{
+	game_frame *Frame = (game_frame *)Data;
+
+	// NOTE(ivan): Every band walks all the entries, so bands are kept tall enough for that to stay cheap.
+	static const u32 MinRowsPerBand = 32;
+	if (Frame->PrimaryDrawGroup)
+		Frame->PlatformAPI->ParallelFor(Queue, Frame->SurfaceBuffer->Height, MinRowsPerBand, DrawGroupRowsFrameTask, Frame);
+}
+
+static WORK_QUEUE_CALLBACK(PostProcessFrameTask)
+{
+	UnreferencedParam(Queue);
+
+	game_frame *Frame = (game_frame *)Data;
+	ApplyPostProcess(Frame->PlatformState, Frame->PlatformAPI, &Frame->State->PostProcess, Frame->SurfaceBuffer);
+}
+
+// NOTE(ivan): Frame pipeline, every arrow is a dependency:
+//   update entities -> build draw group -> draw group -> post-process
+//   clear surface band (x NUM_FRAME_CLEAR_BANDS) -> draw group
+// Clearing does not depend on the game state, so it overlaps with the entities update.
+static b32
+BuildFrameTaskGraph(task_graph *Graph,
+					game_frame *Frame,
+					game_frame_clear_band *ClearBands)
+{
+	Assert(Graph);
+	Assert(Frame);
+	Assert(ClearBands);
+
+	if (!InitializeTaskGraph(Frame->PlatformState, Frame->PlatformAPI, &Frame->State->FrameStack,
+							 Graph, Frame->PlatformAPI->HighPriorityWorkQueue, NUM_FRAME_CLEAR_BANDS + 4))
+		return false;
+
+	task_graph_task *UpdateEntities = AddTask(Graph, "UpdateEntities", UpdateEntitiesFrameTask, Frame);
+	task_graph_task *BuildDrawGroup = AddTask(Graph, "BuildDrawGroup", BuildDrawGroupFrameTask, Frame);
+	AddTaskDependency(BuildDrawGroup, UpdateEntities);
+
+	task_graph_task *ClearTasks[NUM_FRAME_CLEAR_BANDS];
+	s32 NumRows = Frame->SurfaceBuffer->Height;
+	for (s32 Index = 0; Index < NUM_FRAME_CLEAR_BANDS; Index++) {
+		ClearBands[Index].Frame = Frame;
+		ClearBands[Index].Y0 = (NumRows * Index) / NUM_FRAME_CLEAR_BANDS;
+		ClearBands[Index].Y1 = (NumRows * (Index + 1)) / NUM_FRAME_CLEAR_BANDS;
+		ClearTasks[Index] = AddTask(Graph, "ClearSurfaceBand", ClearSurfaceBandFrameTask, ClearBands + Index);
+	}
+
+	task_graph_task *Draw = AddTask(Graph, "DrawGroup", DrawGroupFrameTask, Frame);
+	AddTaskDependency(Draw, BuildDrawGroup);
+	for (s32 Index = 0; Index < NUM_FRAME_CLEAR_BANDS; Index++)
+		AddTaskDependency(Draw, ClearTasks[Index]);
+
+	task_graph_task *PostProcess = AddTask(Graph, "PostProcess", PostProcessFrameTask, Frame);
+	AddTaskDependency(PostProcess, Draw);
+
+	return true;
+}
+
 void
 UpdateGame(platform_state *PlatformState,
 		   platform_api *PlatformAPI,
@@ -230,36 +540,67 @@ UpdateGame(platform_state *PlatformState,
 		GameAPI.GetConfigurationValue = GetConfigurationValue;
 		GameAPI.PushDrawGroupRectangle = PushDrawGroupRectangle;
 		GameAPI.PushDrawGroupImage = PushDrawGroupImage;
+		GameAPI.PushDrawGroupTintedImage = PushDrawGroupTintedImage;
+		GameAPI.InitializeTileMap = InitializeTileMap;
+		GameAPI.FreeTileMap = FreeTileMap;
+		GameAPI.PushDrawGroupTileMap = PushDrawGroupTileMap;
+		GameAPI.SetTileMapTile = SetTileMapTile;
+		GameAPI.GetTileMapTile = GetTileMapTile;
 		GameAPI.RegisterEntity = RegisterEntity;
+		GameAPI.SpawnEntity = SpawnEntity;
+		GameAPI.DespawnEntity = DespawnEntity;
+		GameAPI.GetEntityState = GetEntityState;
+		GameAPI.GetAllMemoryStats = GetAllMemoryStats;
+		GameAPI.FindMemoryStats = FindMemoryStats;
+		GameAPI.DumpMemoryStats = DumpMemoryStats;
+		GameAPI.SetMemoryBudget = SetMemoryBudget;
 
 		GameAPI.SurfaceWidth = SurfaceBuffer->Width;
 		GameAPI.SurfaceHeight = SurfaceBuffer->Height;
 
-		// NOTE(ivan): Initialize per-frame stack.
-		InitializeMemoryStack(PlatformState,
-							  PlatformAPI,
-							  &State->FrameStack,
-							  "FrameStack",
-							  0, 1024);
+		// NOTE(ivan): Initialize per-frame stack, address space is cheap, pages are committed on demand.
+		InitializeMemoryStackVirtual(PlatformState,
+									 PlatformAPI,
+									 &State->FrameStack,
+									 "FrameStack",
+									 Megabytes(256));
 
 		// NOTE(ivan): Initialize entity system.
-		InitializeMemoryPool(PlatformState,
-							 PlatformAPI,
-							 &State->EntitiesPool,
-							 "EntitiesPool",
-							 sizeof(game_entity),
-							 1024);
-		InitializeMemoryPool(PlatformState,
-							 PlatformAPI,
-							 &State->EntityRegsPool,
-							 "EntityRegsPool",
-							 sizeof(game_entity_reg),
-							 256);
+		InitializeSlotMap(PlatformState,
+						  PlatformAPI,
+						  &State->Entities,
+						  "Entities",
+						  sizeof(game_entity),
+						  1024);
+		InitializeTypedPool(PlatformState,
+							PlatformAPI,
+							&State->EntityRegsPool,
+							"EntityRegsPool");
 		
 		// NOTE(ivan): Load configuration.
 		State->Config = LoadConfiguration(PlatformState, PlatformAPI, "default.cfg", 0);
 		State->Config = LoadConfiguration(PlatformState, PlatformAPI, "user.cfg", &State->Config);
 
+		// NOTE(ivan): Read post-process settings.
+		State->PostProcess.BlurEnabled = atoi(GetConfigurationValue(&State->Config, "postfx_blur", "0"));
+		State->PostProcess.BlurRadius = atoi(GetConfigurationValue(&State->Config, "postfx_blur_radius", "2"));
+		State->PostProcess.BloomEnabled = atoi(GetConfigurationValue(&State->Config, "postfx_bloom", "0"));
+		State->PostProcess.BloomRadius = atoi(GetConfigurationValue(&State->Config, "postfx_bloom_radius", "4"));
+		State->PostProcess.BloomThreshold = (f32)atof(GetConfigurationValue(&State->Config, "postfx_bloom_threshold", "0.7"));
+		State->PostProcess.BloomIntensity = (f32)atof(GetConfigurationValue(&State->Config, "postfx_bloom_intensity", "1.0"));
+
+		// NOTE(ivan): Read memory budgets, in megabytes, zero means unlimited.
+		SetMemoryBudget("FrameStack", (u64)atoi(GetConfigurationValue(&State->Config, "mem_budget_frame_mb", "0")) * Megabytes(1));
+		SetMemoryBudget("EntityStates", (u64)atoi(GetConfigurationValue(&State->Config, "mem_budget_entities_mb", "0")) * Megabytes(1));
+		SetMemoryBudget(IMAGES_MEMORY_NAME, (u64)atoi(GetConfigurationValue(&State->Config, "mem_budget_assets_mb", "0")) * Megabytes(1));
+		State->MemoryPressureAvailableBytes = (u64)atoi(GetConfigurationValue(&State->Config, "mem_pressure_available_mb", "64")) * Megabytes(1);
+		RegisterMemoryPressureCallback(GameMemoryPressure, State);
+
+#if INTERNAL
+		// NOTE(ivan): Read debug settings.
+		State->DebugDumpMemoryStats = atoi(GetConfigurationValue(&State->Config, "debug_memory_stats_dump", "0"));
+#endif
+
 		// NOTE(ivan): Load entities.
 		snprintf(EntitiesModuleFileName, CountOf(EntitiesModuleFileName) - 1, "%s%s_ents", PlatformAPI->ExePath, PlatformAPI->ExeNameNoExt);
 		snprintf(EntitiesModuleTempFileName, CountOf(EntitiesModuleFileName) - 1, "%s%s_ents.tmp", PlatformAPI->ExePath, PlatformAPI->ExeNameNoExt);
@@ -289,36 +630,40 @@ UpdateGame(platform_state *PlatformState,
 											  State, &GameAPI);
 #endif
 
-		// NOTE(ivan): Update all game entities.
-		for (game_entity *Entity = State->Entities; Entity; Entity = Entity->Next)
-			Entity->Update(&GameAPI, GameStateType_Frame, Entity->State);
-
-		// NOTE(ivan): Prepare draw group.
-		draw_group *PrimaryDrawGroup = PushStackType(PlatformState,
-													 PlatformAPI,
-													 &State->FrameStack,
-													 draw_group);
-		draw_basis DefaultBasis = {0, 0};
-		PrimaryDrawGroup->DefaultBasis = &DefaultBasis;
-		PrimaryDrawGroup->EntriesBase = (u8 *)PushStackSize(PlatformState,
-															PlatformAPI,
-															&State->FrameStack,
-															MAX_DRAW_GROUP_BUFFER);
-		PrimaryDrawGroup->EntriesBytes = 0;
-		PrimaryDrawGroup->EntriesMax = MAX_DRAW_GROUP_BUFFER;
-		
-		// NOTE(ivan): Clear surface buffer.
-        DrawRectangle(SurfaceBuffer,
-					  MakeV2(0.0f, 0.0f),
-					  MakeV2((f32)(SurfaceBuffer->Width - 1), (f32)(SurfaceBuffer->Height - 1)),
-					  MakeRGBA(0.0f, 0.0f, 0.0f, 1.0f));
-		
-		// NOTE(ivan): Present draw group to the surface buffer.
-		DrawGroup(PrimaryDrawGroup, SurfaceBuffer);
+		// NOTE(ivan): Let caches shrink before anything gets allocated this frame.
+		CheckMemoryPressure(PlatformState, PlatformAPI, Clocks->SecondsPerFrame, State->MemoryPressureAvailableBytes);
 
-		// NOTE(ivan): Free per-frame stack.
-		FreeMemoryStack(PlatformAPI, &State->FrameStack);
-		
+		// NOTE(ivan): Run the frame pipeline on the high-priority work queue, helping it out meanwhile.
+		game_frame Frame = {};
+		Frame.PlatformState = PlatformState;
+		Frame.PlatformAPI = PlatformAPI;
+		Frame.GameAPI = &GameAPI;
+		Frame.State = State;
+		Frame.SurfaceBuffer = SurfaceBuffer;
+
+		task_graph FrameGraph;
+		game_frame_clear_band ClearBands[NUM_FRAME_CLEAR_BANDS];
+		if (BuildFrameTaskGraph(&FrameGraph, &Frame, ClearBands))
+			RunTaskGraph(&FrameGraph);
+
+#if INTERNAL
+		// NOTE(ivan): Memory statistics overlay and dump.
+		if (IsSinglePress(Input->KeyboardButtons[KeyCode_F3])) {
+			State->DebugShowMemoryStats = !State->DebugShowMemoryStats;
+			if (State->DebugShowMemoryStats)
+				DumpMemoryStats(PlatformState, PlatformAPI);
+		}
+		if (State->DebugDumpMemoryStats)
+			DumpMemoryStats(PlatformState, PlatformAPI);
+		if (State->DebugShowMemoryStats)
+			DrawMemoryStatsOverlay(SurfaceBuffer);
+#endif
+
+		// NOTE(ivan): Reset per-frame stack, its blocks are kept for the next frame.
+		ResetMemoryStack(&State->FrameStack);
+
+		// NOTE(ivan): Close statistics frame.
+		EndMemoryStatsFrame();
 	} break;
 
 		///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -329,11 +674,21 @@ UpdateGame(platform_state *PlatformState,
 		SaveConfiguration(PlatformState, PlatformAPI, "user.cfg", &State->Config);
 		FreeConfiguration(PlatformAPI, &State->Config);
 
+		// NOTE(ivan): Release post-process buffers.
+		FreePostProcess(PlatformAPI, &State->PostProcess);
+
+		// NOTE(ivan): Release per-frame stack.
+		FreeMemoryStack(PlatformAPI, &State->FrameStack);
+
+		UnregisterMemoryPressureCallback(GameMemoryPressure, State);
+
 		// NOTE(ivan): Release entities system.
-		FreeMemoryPool(PlatformAPI,
-					   &State->EntitiesPool);
-		FreeMemoryPool(PlatformAPI,
-					   &State->EntityRegsPool);
+		while (State->Entities.NumItems)
+			DespawnEntity(State, &GameAPI, GetSlotMapHandleAt(&State->Entities, State->Entities.NumItems - 1));
+		FreeSlotMap(PlatformAPI, &State->Entities);
+		for (game_entity_reg *EntityReg = State->EntityRegs; EntityReg; EntityReg = EntityReg->Next)
+			FreeMemoryPool(PlatformAPI, &EntityReg->StatesPool);
+		FreeTypedPool(&State->EntityRegsPool);
 	} break;
 	}
 }
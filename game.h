@@ -7,6 +7,8 @@
 #include "game_keys.h"
 #include "game_image.h"
 #include "game_draw_group.h"
+#include "game_tilemap.h"
+#include "game_post_process.h"
 
 // NOTE(ivan): Title.
 #define GAMENAME "ZDemo"
@@ -104,7 +106,7 @@ struct game_config_entry {
 struct game_config {
 	memory_stack ConfigStack; // TOOD(ivan): MAYBE pool instead of stack?
 	game_config_entry *LastEntry;
-	ticket_mutex ConfigMutex;
+	rw_mutex ConfigMutex; // NOTE(ivan): Lookups only read, so they never wait for each other.
 };
 
 // NOTE(ivan): Game state type.
@@ -118,28 +120,24 @@ enum game_state_type {
 #define UPDATE_GAME_ENTITY(name) void name(struct game_api *GameAPI, game_state_type UpdateType, void *State)
 typedef UPDATE_GAME_ENTITY(update_game_entity);
 
-// NOTE(ivan): Game entity.
-struct game_entity {
-	u32 Id;
-	char *Name;
-
-	void *State;
-	update_game_entity *Update;
-
-	game_entity *Next;
-	game_entity *Prev;
-};
-
 // NOTE(ivan): Game entity registration information.
 struct game_entity_reg {
 	char Name[256];
 
 	u32 StateBytes;
-	update_game_entity *Update;
+	update_game_entity *Update; // NOTE(ivan): Refreshed on entities module reload.
+	memory_pool StatesPool; // NOTE(ivan): States of all entities of this kind.
 
 	game_entity_reg *Next;
 };
 
+// NOTE(ivan): Game entity, lives in game_state::Entities slot map and is referred to by handles.
+struct game_entity {
+	slot_map_handle Handle;
+	game_entity_reg *Reg;
+	void *State; // NOTE(ivan): Block of Reg->StatesPool, its address is stable unlike the entity's.
+};
+
 // NOTE(ivan): Game state.
 // NOTE(ivan): Game state structure allocated in platform layer MUST be ZEROED.
 struct game_state {
@@ -148,11 +146,22 @@ struct game_state {
 
 	memory_stack FrameStack;
 
+	// NOTE(ivan): Screen-space effects applied after the draw group is presented.
+	post_process PostProcess;
+
 	// NOTE(ivan): Entity system.
-	memory_pool EntitiesPool;
-	memory_pool EntityRegsPool;
-	game_entity *Entities;
+	slot_map Entities;
+	typed_pool<game_entity_reg, 16> EntityRegsPool;
 	game_entity_reg *EntityRegs;
+
+	// NOTE(ivan): Memory pressure is signaled once system available memory gets under this, zero disables.
+	u64 MemoryPressureAvailableBytes;
+
+#if INTERNAL
+	// NOTE(ivan): Memory statistics overlay, toggled with F3.
+	b32 DebugShowMemoryStats;
+	b32 DebugDumpMemoryStats; // NOTE(ivan): Log statistics every frame, "debug_memory_stats_dump" in config.
+#endif
 };
 
 // NOTE(ivan): This is program's main body, gets called each frame.
@@ -179,6 +188,18 @@ typedef GET_CONFIGURATION_VALUE(get_configuration_value);
 #define REGISTER_ENTITY(name) void name(game_state *GameState, game_api *GameAPI, const char *Name, u32 StateBytes, update_game_entity *Update)
 typedef REGISTER_ENTITY(register_entity);
 
+// NOTE(ivan): Returns a null handle if no such entity is registered or out of memory.
+#define SPAWN_ENTITY(name) slot_map_handle name(game_state *GameState, game_api *GameAPI, const char *Name)
+typedef SPAWN_ENTITY(spawn_entity);
+
+// NOTE(ivan): Returns false if the handle is stale.
+#define DESPAWN_ENTITY(name) b32 name(game_state *GameState, game_api *GameAPI, slot_map_handle Handle)
+typedef DESPAWN_ENTITY(despawn_entity);
+
+// NOTE(ivan): Returns zero if the handle is stale.
+#define GET_ENTITY_STATE(name) void * name(game_state *GameState, slot_map_handle Handle)
+typedef GET_ENTITY_STATE(get_entity_state);
+
 // NOTE(ivan): Game API exported to entities module.
 struct game_api {
 	platform_state *PlatformState;
@@ -189,9 +210,25 @@ struct game_api {
 	free_configuration *FreeConfiguration;
 	get_configuration_value *GetConfigurationValue;
 	register_entity *RegisterEntity;
+	spawn_entity *SpawnEntity;
+	despawn_entity *DespawnEntity;
+	get_entity_state *GetEntityState;
 
 	push_draw_group_rectangle *PushDrawGroupRectangle;
 	push_draw_group_image *PushDrawGroupImage;
+	push_draw_group_tinted_image *PushDrawGroupTintedImage;
+	initialize_tile_map *InitializeTileMap;
+	free_tile_map *FreeTileMap;
+	push_draw_group_tile_map *PushDrawGroupTileMap;
+	set_tile_map_tile *SetTileMapTile;
+	get_tile_map_tile *GetTileMapTile;
+
+	get_all_memory_stats *GetAllMemoryStats;
+	find_memory_stats *FindMemoryStats;
+	dump_memory_stats *DumpMemoryStats;
+	set_memory_budget *SetMemoryBudget;
+	// NOTE(ivan): Memory pressure callbacks are not exported, the entities module gets unloaded on reload
+	// and would leave dangling callbacks behind.
 
 	s32 SurfaceWidth;
 	s32 SurfaceHeight;
@@ -202,5 +239,8 @@ SAVE_CONFIGURATION(SaveConfiguration);
 FREE_CONFIGURATION(FreeConfiguration);
 GET_CONFIGURATION_VALUE(GetConfigurationValue);
 REGISTER_ENTITY(RegisterEntity);
+SPAWN_ENTITY(SpawnEntity);
+DESPAWN_ENTITY(DespawnEntity);
+GET_ENTITY_STATE(GetEntityState);
 
 #endif // #ifndef GAME_H
@@ -70,10 +70,12 @@ DrawPixel(game_surface_buffer *Buffer,
 }
 
 void
-DrawRectangle(game_surface_buffer *Buffer,
-			  v2 Pos0,
-			  v2 Pos1,
-			  rgba Color)
+DrawRectangleRows(game_surface_buffer *Buffer,
+				  v2 Pos0,
+				  v2 Pos1,
+				  rgba Color,
+				  s32 ClipMinY,
+				  s32 ClipMaxY)
 {
 	Assert(Buffer);
 
@@ -94,20 +96,16 @@ DrawRectangle(game_surface_buffer *Buffer,
 	Assert(PosX1 > PosX0);
 	Assert(PosY1 > PosY0);
 
-	for (s32 Y = PosY0; Y < PosY1; Y++) {
-		if (Y < 0)
-			continue;
-		if (Y > Buffer->Height)
-			continue;
+	// NOTE(ivan): Clip once instead of testing every pixel, bands drawn by other threads must stay untouched.
+	s32 MinX = Max(PosX0, 0);
+	s32 MinY = Max(PosY0, Max(ClipMinY, 0));
+	s32 MaxX = Min(PosX1, Buffer->Width);
+	s32 MaxY = Min(PosY1, Min(ClipMaxY, Buffer->Height));
 
+	for (s32 Y = MinY; Y < MaxY; Y++) {
 		u8 *Row = ((u8 *)Buffer->Pixels + (Y * Buffer->Pitch));
 		
-		for (s32 X = PosX0; X < PosX1; X++) {
-			if (X < 0)
-				continue;
-			if (X > Buffer->Width)
-				continue;
-			
+		for (s32 X = MinX; X < MaxX; X++) {
 			u32 *Pixel = (u32 *)(Row + (X * Buffer->BytesPerPixel));
 			
 			u32 SourceC = Color32;
@@ -124,56 +122,142 @@ DrawRectangle(game_surface_buffer *Buffer,
 			*Pixel = (((u32)BResult.R << 16) |
 					  ((u32)BResult.G << 8) |
 					  ((u32)BResult.B << 0));
-			Pixel++;
 		}
 	}
 }
 
 void
-DrawImage(game_surface_buffer *Buffer,
-		  v2 Pos,
-		  image *Image)
+DrawRectangle(game_surface_buffer *Buffer,
+			  v2 Pos0,
+			  v2 Pos1,
+			  rgba Color)
+{
+	Assert(Buffer);
+	DrawRectangleRows(Buffer, Pos0, Pos1, Color, 0, Buffer->Height);
+}
+
+// NOTE(ivan): Per-sprite modulation constants, broadcasted for the SIMD blitter.
+struct draw_image_tint {
+	__m128 MultiplyR;
+	__m128 MultiplyG;
+	__m128 MultiplyB;
+	__m128 MultiplyA;
+	__m128 AddR;
+	__m128 AddG;
+	__m128 AddB;
+	__m128 AddA;
+};
+
+// NOTE(ivan): Modulates four source pixels and blends them over four destination pixels.
+inline __m128i
+BlendTintedPixels4(__m128i SourceC, __m128i DestC, draw_image_tint *Tint)
+{
+	__m128i Mask = _mm_set1_epi32(0xFF);
+	__m128 Zero = _mm_setzero_ps();
+	__m128 Max255 = _mm_set1_ps(255.0f);
+	__m128 Inv255 = _mm_set1_ps(1.0f / 255.0f);
+
+	__m128 SourceA = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(SourceC, 24), Mask));
+	__m128 SourceR = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(SourceC, 16), Mask));
+	__m128 SourceG = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(SourceC, 8), Mask));
+	__m128 SourceB = _mm_cvtepi32_ps(_mm_and_si128(SourceC, Mask));
+
+	__m128 DestR = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(DestC, 16), Mask));
+	__m128 DestG = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(DestC, 8), Mask));
+	__m128 DestB = _mm_cvtepi32_ps(_mm_and_si128(DestC, Mask));
+
+	// NOTE(ivan): Color modulation.
+	SourceA = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(SourceA, Tint->MultiplyA), Tint->AddA), Zero), Max255);
+	SourceR = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(SourceR, Tint->MultiplyR), Tint->AddR), Zero), Max255);
+	SourceG = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(SourceG, Tint->MultiplyG), Tint->AddG), Zero), Max255);
+	SourceB = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(SourceB, Tint->MultiplyB), Tint->AddB), Zero), Max255);
+
+	// TODO(ivan): Premultiplied alpha!!!
+	__m128 Alpha = _mm_mul_ps(SourceA, Inv255);
+	__m128 ResultR = _mm_add_ps(DestR, _mm_mul_ps(_mm_sub_ps(SourceR, DestR), Alpha));
+	__m128 ResultG = _mm_add_ps(DestG, _mm_mul_ps(_mm_sub_ps(SourceG, DestG), Alpha));
+	__m128 ResultB = _mm_add_ps(DestB, _mm_mul_ps(_mm_sub_ps(SourceB, DestB), Alpha));
+
+	return _mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(ResultR), 16),
+						_mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(ResultG), 8),
+									 _mm_cvtps_epi32(ResultB)));
+}
+
+void
+DrawImageRows(game_surface_buffer *Buffer,
+			  v2 Pos,
+			  image *Image,
+			  rgba ColorMultiply,
+			  rgba ColorAdd,
+			  s32 ClipMinY,
+			  s32 ClipMaxY)
 {
 	Assert(Buffer);
 	Assert(Image);
 
-	s32 PosX0 = (u32)roundf(Pos.X);
-	s32 PosY0 = (u32)roundf(Pos.Y);
-	s32 PosX1 = PosX0 + Image->Width;
-	s32 PosY1 = PosY0 + Image->Height;
+	s32 PosX0 = (s32)roundf(Pos.X);
+	s32 PosY0 = (s32)roundf(Pos.Y);
 
-	for (s32 Y = PosY0; Y < PosY1; Y++) {
-		if (Y < 0)
-			continue;
-		if (Y >= Buffer->Height)
-			continue;
-		
-		u8 *DestRow = ((u8 *)Buffer->Pixels + (Y * Buffer->Pitch));
-		u8 *SourceRow = (u8 *)Image->Pixels + ((Y - PosY0) * Image->Pitch);
-		
-		for (s32 X = PosX0; X < PosX1; X++) {
-			if (X < 0)
-				continue;
-			if (X >= Buffer->Width)
-				continue;
-
-			u32 *DestPixel = (u32 *)(DestRow + (X * Buffer->BytesPerPixel));
-			u32 *SourcePixel = (u32 *)(SourceRow + ((X - PosX0) * Image->BytesPerPixel));
-			
-			u32 SourceC = *SourcePixel;
-			u32 DestC = *DestPixel;
+	// NOTE(ivan): Clip once instead of testing every pixel.
+	s32 MinX = Max(PosX0, 0);
+	s32 MinY = Max(PosY0, Max(ClipMinY, 0));
+	s32 MaxX = Min(PosX0 + Image->Width, Buffer->Width);
+	s32 MaxY = Min(PosY0 + Image->Height, Min(ClipMaxY, Buffer->Height));
+	if (MinX >= MaxX || MinY >= MaxY)
+		return;
 
-			// TODO(ivan): Premultiplied alpha!!!
-			blending_result BResult = DoLinearBlending(((SourceC >> 24) & 0xFF) / 255.0f,
-													   (u8)((DestC >> 16) & 0xFF),
-													   (u8)((DestC >> 8) & 0xFF),
-													   (u8)((DestC >> 0) & 0xFF),
-													   (u8)((SourceC >> 16) & 0xFF),
-													   (u8)((SourceC >> 8) & 0xFF),
-													   (u8)((SourceC >> 0) & 0xFF));
-			*DestPixel = (((u32)BResult.R << 16) |
-						  ((u32)BResult.G << 8) |
-						  ((u32)BResult.B << 0));
+	draw_image_tint Tint;
+	Tint.MultiplyR = _mm_set1_ps(ColorMultiply.R);
+	Tint.MultiplyG = _mm_set1_ps(ColorMultiply.G);
+	Tint.MultiplyB = _mm_set1_ps(ColorMultiply.B);
+	Tint.MultiplyA = _mm_set1_ps(ColorMultiply.A);
+	Tint.AddR = _mm_set1_ps(ColorAdd.R * 255.0f);
+	Tint.AddG = _mm_set1_ps(ColorAdd.G * 255.0f);
+	Tint.AddB = _mm_set1_ps(ColorAdd.B * 255.0f);
+	Tint.AddA = _mm_set1_ps(ColorAdd.A * 255.0f);
+
+	for (s32 Y = MinY; Y < MaxY; Y++) {
+		u32 *DestPixel = (u32 *)((u8 *)Buffer->Pixels + (Y * Buffer->Pitch) + (MinX * Buffer->BytesPerPixel));
+		u32 *SourcePixel = (u32 *)((u8 *)Image->Pixels + ((Y - PosY0) * Image->Pitch) + ((MinX - PosX0) * Image->BytesPerPixel));
+
+		s32 X = MinX;
+		for (; (X + 4) <= MaxX; X += 4) {
+			__m128i SourceC = _mm_loadu_si128((__m128i *)SourcePixel);
+			__m128i DestC = _mm_loadu_si128((__m128i *)DestPixel);
+			_mm_storeu_si128((__m128i *)DestPixel, BlendTintedPixels4(SourceC, DestC, &Tint));
+
+			SourcePixel += 4;
+			DestPixel += 4;
+		}
+
+		// NOTE(ivan): Row tail goes through the very same kernel, via a small staging buffer.
+		s32 Remaining = MaxX - X;
+		if (Remaining) {
+			u32 SourceTail[4] = {};
+			u32 DestTail[4] = {};
+			for (s32 Index = 0; Index < Remaining; Index++) {
+				SourceTail[Index] = SourcePixel[Index];
+				DestTail[Index] = DestPixel[Index];
+			}
+
+			__m128i Result = BlendTintedPixels4(_mm_loadu_si128((__m128i *)SourceTail),
+												_mm_loadu_si128((__m128i *)DestTail),
+												&Tint);
+			_mm_storeu_si128((__m128i *)DestTail, Result);
+
+			for (s32 Index = 0; Index < Remaining; Index++)
+				DestPixel[Index] = DestTail[Index];
 		}
 	}
 }
+
+void
+DrawImage(game_surface_buffer *Buffer,
+		  v2 Pos,
+		  image *Image,
+		  rgba ColorMultiply,
+		  rgba ColorAdd)
+{
+	Assert(Buffer);
+	DrawImageRows(Buffer, Pos, Image, ColorMultiply, ColorAdd, 0, Buffer->Height);
+}
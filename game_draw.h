@@ -14,8 +14,28 @@ void DrawRectangle(game_surface_buffer *Buffer,
 				   v2 Pos1,
 				   rgba Color);
 
+// NOTE(ivan): Every source pixel is modulated as Source * ColorMultiply + ColorAdd (all four channels,
+// clamped) in the same pass as the alpha blend, so tinting and flashing sprites costs no extra copies.
 void DrawImage(game_surface_buffer *Buffer,
 			   v2 Pos,
-			   image *Image);
+			   image *Image,
+			   rgba ColorMultiply = MakeRGBA(1.0f, 1.0f, 1.0f, 1.0f),
+			   rgba ColorAdd = MakeRGBA(0.0f, 0.0f, 0.0f, 0.0f));
+
+// NOTE(ivan): Same as above, but only rows [ClipMinY, ClipMaxY) are touched,
+// so different threads may draw different row bands of one buffer at once.
+void DrawRectangleRows(game_surface_buffer *Buffer,
+					   v2 Pos0,
+					   v2 Pos1,
+					   rgba Color,
+					   s32 ClipMinY,
+					   s32 ClipMaxY);
+void DrawImageRows(game_surface_buffer *Buffer,
+				   v2 Pos,
+				   image *Image,
+				   rgba ColorMultiply,
+				   rgba ColorAdd,
+				   s32 ClipMinY,
+				   s32 ClipMaxY);
 
 #endif // #ifndef GAME_DRAW_H
@@ -11,14 +11,10 @@ PushDrawGroupSize(draw_group *Group, u32 Bytes, draw_group_entry_type Type)
 
 	u8 *Result = 0;
 
-	Bytes += sizeof(draw_group_entry_header);
-
-	if ((Group->EntriesBytes + Bytes) < Group->EntriesMax) {
-		draw_group_entry_header *Header = (draw_group_entry_header *)(Group->EntriesBase + Group->EntriesBytes);
+	draw_group_entry_header *Header = (draw_group_entry_header *)PushArenaArray(&Group->Entries, sizeof(draw_group_entry_header) + Bytes);
+	if (Header) {
 		Header->Type = Type;
-
 		Result = (u8 *)Header + sizeof(draw_group_entry_header);
-		Group->EntriesBytes += Bytes;
 	} else {
 		Assert(!"Draw group entries buffer overflow!");
 	}
@@ -44,35 +40,53 @@ PUSH_DRAW_GROUP_IMAGE(PushDrawGroupImage)
 	draw_group_entry_image *Piece = PushDrawGroupEntry(Group, draw_group_entry_image);
 	Piece->Basis.Pos = Pos;
 	Piece->Image = Image;
+	Piece->ColorMultiply = MakeRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+	Piece->ColorAdd = MakeRGBA(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+PUSH_DRAW_GROUP_TINTED_IMAGE(PushDrawGroupTintedImage)
+{
+	Assert(Group);
+	Assert(Image);
+
+	draw_group_entry_image *Piece = PushDrawGroupEntry(Group, draw_group_entry_image);
+	Piece->Basis.Pos = Pos;
+	Piece->Image = Image;
+	Piece->ColorMultiply = ColorMultiply;
+	Piece->ColorAdd = ColorAdd;
 }
 
 void
-DrawGroup(draw_group *Group, game_surface_buffer *Buffer)
+DrawGroupRows(draw_group *Group, game_surface_buffer *Buffer, s32 MinY, s32 MaxY)
 {
 	Assert(Group);
 	Assert(Buffer);
 
 	u32 BaseAddress = 0;
-	while (BaseAddress < Group->EntriesBytes) {
-		draw_group_entry_header *Header = (draw_group_entry_header *)(Group->EntriesBase + BaseAddress);
+	while (BaseAddress < Group->Entries.Count) {
+		draw_group_entry_header *Header = (draw_group_entry_header *)(Group->Entries.Items + BaseAddress);
 		BaseAddress += sizeof(draw_group_entry_header);
 		
 		void *Data = (u8 *)Header + sizeof(draw_group_entry_header);
 		switch(Header->Type) {
 		case DrawGroupEntryType_draw_group_entry_rectangle: {
 			draw_group_entry_rectangle *Entry = (draw_group_entry_rectangle *)Data;
-			DrawRectangle(Buffer,
-						  Entry->Basis.Pos,
-						  MakeV2(Entry->Basis.Pos.X + Entry->Dim.X, Entry->Basis.Pos.Y + Entry->Dim.Y),
-						  Entry->Color);
+			DrawRectangleRows(Buffer,
+							  Entry->Basis.Pos,
+							  MakeV2(Entry->Basis.Pos.X + Entry->Dim.X, Entry->Basis.Pos.Y + Entry->Dim.Y),
+							  Entry->Color,
+							  MinY, MaxY);
 			BaseAddress += sizeof(draw_group_entry_rectangle);
 		} break;
 
 		case DrawGroupEntryType_draw_group_entry_image: {
 			draw_group_entry_image *Entry = (draw_group_entry_image *)Data;
-			DrawImage(Buffer,
-					  Entry->Basis.Pos,
-					  Entry->Image);
+			DrawImageRows(Buffer,
+						  Entry->Basis.Pos,
+						  Entry->Image,
+						  Entry->ColorMultiply,
+						  Entry->ColorAdd,
+						  MinY, MaxY);
 			BaseAddress += sizeof(draw_group_entry_image);
 		} break;
 
@@ -80,3 +94,10 @@ DrawGroup(draw_group *Group, game_surface_buffer *Buffer)
 		}
 	}
 }
+
+void
+DrawGroup(draw_group *Group, game_surface_buffer *Buffer)
+{
+	Assert(Buffer);
+	DrawGroupRows(Group, Buffer, 0, Buffer->Height);
+}
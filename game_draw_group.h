@@ -29,12 +29,14 @@ struct draw_group_entry_image {
 	draw_basis Basis;
 	image *Image;
 	v2 Dim;
+
+	// NOTE(ivan): Per-sprite modulation, Color = Source * ColorMultiply + ColorAdd, before blending.
+	rgba ColorMultiply;
+	rgba ColorAdd;
 };
 
 struct draw_group {
-	u8 *EntriesBase;
-	u32 EntriesBytes;
-	u32 EntriesMax;
+	arena_array<u8> Entries; // NOTE(ivan): Packed entries, each one is a header followed by its data.
 
 	draw_basis *DefaultBasis;
 };
@@ -45,9 +47,15 @@ typedef PUSH_DRAW_GROUP_RECTANGLE(push_draw_group_rectangle);
 #define PUSH_DRAW_GROUP_IMAGE(name) void name(draw_group *Group, v2 Pos, image *Image)
 typedef PUSH_DRAW_GROUP_IMAGE(push_draw_group_image);
 
+#define PUSH_DRAW_GROUP_TINTED_IMAGE(name) void name(draw_group *Group, v2 Pos, image *Image, rgba ColorMultiply, rgba ColorAdd)
+typedef PUSH_DRAW_GROUP_TINTED_IMAGE(push_draw_group_tinted_image);
+
 PUSH_DRAW_GROUP_RECTANGLE(PushDrawGroupRectangle);
 PUSH_DRAW_GROUP_IMAGE(PushDrawGroupImage);
+PUSH_DRAW_GROUP_TINTED_IMAGE(PushDrawGroupTintedImage);
 
 void DrawGroup(draw_group *Group, struct game_surface_buffer *Buffer);
+// NOTE(ivan): Draws into rows [MinY, MaxY) only, so bands may be drawn by different threads at once.
+void DrawGroupRows(draw_group *Group, struct game_surface_buffer *Buffer, s32 MinY, s32 MaxY);
 
 #endif // #ifndef GAME_DRAW_GROUP_H
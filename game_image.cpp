@@ -26,6 +26,36 @@ struct bmp_header {
 };
 #pragma pack(pop)
 
+// NOTE(ivan): Shared state of a BMP pixels conversion, run through ParallelFor().
+struct bmp_convert_job {
+	u32 *Source; // NOTE(ivan): Bottom-up file rows.
+	image *Dest;
+
+	u32 RedShift;
+	u32 GreenShift;
+	u32 BlueShift;
+	u32 AlphaShift;
+};
+
+// NOTE(ivan): Swizzles file rows to 0xAARRGGBB and flips them top-down in one pass.
+static PARALLEL_FOR_CALLBACK(ConvertBMPRows)
+{
+	bmp_convert_job *Job = (bmp_convert_job *)Data;
+	image *Dest = Job->Dest;
+
+	for (u32 Y = First; Y < OnePastLast; Y++) {
+		u32 *SourcePixel = Job->Source + (Dest->Height - 1 - Y) * Dest->Width;
+		u32 *DestPixel = (u32 *)((u8 *)Dest->Pixels + Y * Dest->Pitch);
+		for (s32 X = 0; X < Dest->Width; X++) {
+			u32 C = *SourcePixel++;
+			*DestPixel++ = ((((C >> Job->AlphaShift) & 0xFF) << 24) |
+							(((C >> Job->RedShift) & 0xFF) << 16) |
+							(((C >> Job->GreenShift) & 0xFF) << 8) |
+							(((C >> Job->BlueShift) & 0xFF) << 0));
+		}
+	}
+}
+
 image
 LoadBMP(platform_state *PlatformState,
 		platform_api *PlatformAPI,
@@ -65,35 +95,26 @@ LoadBMP(platform_state *PlatformState,
 			Assert(BlueShift.IsFound);
 			Assert(AlphaShift.IsFound);
 			
-			u32 *SourceDest = Pixels;
-			for (s32 Y = 0; Y < Header->Height; Y++) {
-				for (s32 X = 0; X < Header->Width; X++) {
-					u32 C = *SourceDest;
-					*SourceDest++ = ((((C >> AlphaShift.Index) & 0xFF) << 24) |
-									 (((C >> RedShift.Index) & 0xFF) << 16) |
-									 (((C >> GreenShift.Index) & 0xFF) << 8) |
-									 (((C >> BlueShift.Index) & 0xFF) << 0));
-				}
-			}
-				
-			Result.Pixels = PlatformAPI->AllocateMemory(Header->Width * Header->Height * Header->BitsPerPixel / 8);
+			Result.Pixels = AllocateTrackedMemory(PlatformState, PlatformAPI, IMAGES_MEMORY_NAME,
+												  Header->Width * Header->Height * Header->BitsPerPixel / 8);
 			if (Result.Pixels) {
 				Result.Width = Header->Width;
 				Result.Height = Header->Height;
 				Result.BytesPerPixel = Header->BitsPerPixel / 8;
 				Result.Pitch = Header->Width * Header->BitsPerPixel / 8;
-				
-				u8 *SourceRow =(u8 *)Pixels + Result.Pitch * (Header->Height - 1);
-				u8 *DestRow = (u8 *)Result.Pixels;
-				for (s32 Y = 0; Y < Result.Height; Y++) {
-					u32 *SourcePixel = (u32 *)SourceRow;
-					u32 *DestPixel = (u32 *)DestRow;
-					for (s32 X = 0; X < Result.Width; X++)
-						*DestPixel++ = *SourcePixel++;
 
-					SourceRow -= Result.Pitch;
-					DestRow += Result.Pitch;
-				}
+				bmp_convert_job Job;
+				Job.Source = Pixels;
+				Job.Dest = &Result;
+				Job.RedShift = RedShift.Index;
+				Job.GreenShift = GreenShift.Index;
+				Job.BlueShift = BlueShift.Index;
+				Job.AlphaShift = AlphaShift.Index;
+
+				// NOTE(ivan): Rows are tiny, so keep at least ~16K pixels per range.
+				u32 MinRowsPerRange = Max(1u, 16384u / (u32)Max(Result.Width, 1));
+				PlatformAPI->ParallelFor(PlatformAPI->HighPriorityWorkQueue, (u32)Result.Height, MinRowsPerRange,
+										 ConvertBMPRows, &Job);
 			} else {
 				PlatformAPI->Log(PlatformState, "BMP file '%s' is too large.", FileName);
 			}
@@ -114,5 +135,5 @@ FreeImage(platform_api *PlatformAPI,
 	Assert(PlatformAPI);
 	Assert(Image);
 	
-	PlatformAPI->DeallocateMemory(Image->Pixels);
+	DeallocateTrackedMemory(PlatformAPI, Image->Pixels);
 }
@@ -13,10 +13,14 @@ struct image {
 	s32 Pitch;
 };
 
+// NOTE(ivan): Memory stats and budget name loaded and cached images are accounted under.
+#define IMAGES_MEMORY_NAME "Assets"
+
 image LoadBMP(platform_state *PlatformState,
 			  platform_api *PlatformAPI,
 			  const char *FileName);
 
+// NOTE(ivan): Pixels of every image MUST come from AllocateTrackedMemory().
 void FreeImage(platform_api *PlatformAPI,
 			   image *Image);
 
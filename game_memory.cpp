@@ -1,13 +1,399 @@
 #include "game.h"
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Memory statistics.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static ticket_mutex MemoryStatsMutex;
+static memory_stats MemoryStatsTable[MAX_MEMORY_STATS];
+static u32 NumMemoryStats;
+
+// NOTE(ivan): Shared by all allocators whose names did not fit into the table, keeps hot paths free of checks.
+static memory_stats OverflowMemoryStats = {}; // NOTE(ivan): Named on first use.
+
+// NOTE(ivan): Must be called with MemoryStatsMutex held.
+static memory_stats *
+FindOrCreateMemoryStats(const char *DebugName, memory_stats_type Type)
+{
+	Assert(DebugName);
+
+	memory_stats *Result = 0;
+
+	for (u32 Index = 0; Index < NumMemoryStats; Index++) {
+		if (strcmp(MemoryStatsTable[Index].DebugName, DebugName) == 0) {
+			Result = &MemoryStatsTable[Index];
+			break;
+		}
+	}
+
+	if (!Result) {
+		if (NumMemoryStats < MAX_MEMORY_STATS) {
+			// NOTE(ivan): Name is copied, it may come from the entities module that can be unloaded.
+			Result = &MemoryStatsTable[NumMemoryStats++];
+			strncpy(Result->DebugName, DebugName, CountOf(Result->DebugName) - 1);
+			Result->Type = Type;
+		} else {
+			Result = &OverflowMemoryStats;
+			if (!Result->DebugName[0])
+				strncpy(Result->DebugName, "<overflow>", CountOf(Result->DebugName) - 1);
+		}
+	}
+
+	return Result;
+}
+
+static memory_stats *
+AcquireMemoryStats(const char *DebugName, memory_stats_type Type)
+{
+	Assert(DebugName);
+
+	EnterTicketMutex(&MemoryStatsMutex);
+
+	memory_stats *Result = FindOrCreateMemoryStats(DebugName, Type);
+	Result->Type = Type; // NOTE(ivan): Entry might have been created by SetMemoryBudget().
+	Result->NumAllocators++;
+
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	return Result;
+}
+
+static void
+ReleaseMemoryStats(memory_stats *Stats)
+{
+	if (!Stats)
+		return;
+
+	EnterTicketMutex(&MemoryStatsMutex);
+	Assert(Stats->NumAllocators);
+	Stats->NumAllocators--;
+	LeaveTicketMutex(&MemoryStatsMutex);
+}
+
+inline void
+CopyMemoryStats(memory_stats *Dest, memory_stats *Source)
+{
+	memcpy(Dest->DebugName, Source->DebugName, sizeof(Dest->DebugName));
+	Dest->Type = Source->Type;
+	Dest->NumAllocators = Source->NumAllocators;
+	Dest->BytesReserved = Source->BytesReserved;
+	Dest->BytesUsed = Source->BytesUsed;
+	Dest->HighWaterMark = Source->HighWaterMark;
+	Dest->BlocksAllocated = Source->BlocksAllocated;
+	Dest->Allocations = Source->Allocations;
+	Dest->AllocationsLastFrame = Source->AllocationsLastFrame;
+	Dest->BudgetBytes = Source->BudgetBytes;
+	Dest->BudgetFailures = Source->BudgetFailures;
+}
+
+// NOTE(ivan): Checks whether an allocator may obtain Bytes more from the platform layer.
+inline b32
+IsWithinMemoryBudget(memory_stats *Stats, u64 Bytes)
+{
+	if (!Stats)
+		return true;
+
+	u64 BudgetBytes = Stats->BudgetBytes;
+	if (!BudgetBytes || (Stats->BytesReserved + Bytes) <= BudgetBytes)
+		return true;
+
+	AtomicIncrementU64(&Stats->BudgetFailures);
+	return false;
+}
+
+GET_ALL_MEMORY_STATS(GetAllMemoryStats)
+{
+	Assert(Stats);
+
+	EnterTicketMutex(&MemoryStatsMutex);
+
+	u32 Result = Min(MaxCount, NumMemoryStats);
+	for (u32 Index = 0; Index < Result; Index++)
+		CopyMemoryStats(&Stats[Index], &MemoryStatsTable[Index]);
+
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	return Result;
+}
+
+FIND_MEMORY_STATS(FindMemoryStats)
+{
+	Assert(DebugName);
+	Assert(Stats);
+
+	b32 Result = false;
+
+	EnterTicketMutex(&MemoryStatsMutex);
+
+	for (u32 Index = 0; Index < NumMemoryStats; Index++) {
+		if (strcmp(MemoryStatsTable[Index].DebugName, DebugName) == 0) {
+			CopyMemoryStats(Stats, &MemoryStatsTable[Index]);
+			Result = true;
+			break;
+		}
+	}
+
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	return Result;
+}
+
+DUMP_MEMORY_STATS(DumpMemoryStats)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+
+	static const char *TypeNames[] = {"stack", "pool", "concurrent pool", "tracked"};
+
+	memory_stats Stats[MAX_MEMORY_STATS];
+	u32 NumStats = GetAllMemoryStats(Stats, CountOf(Stats));
+	for (u32 Index = 0; Index < NumStats; Index++) {
+		memory_stats *Entry = &Stats[Index];
+		PlatformAPI->Log(PlatformState,
+						 "MemoryStats[%s]: %s x%u, reserved %llu, used %llu, peak %llu, blocks %llu, allocs/frame %llu, budget %llu",
+						 Entry->DebugName, TypeNames[Entry->Type], Entry->NumAllocators,
+						 Entry->BytesReserved, Entry->BytesUsed, Entry->HighWaterMark,
+						 Entry->BlocksAllocated, Entry->AllocationsLastFrame, Entry->BudgetBytes);
+	}
+}
+
+void
+EndMemoryStatsFrame(void)
+{
+	EnterTicketMutex(&MemoryStatsMutex);
+
+	for (u32 Index = 0; Index < NumMemoryStats; Index++) {
+		memory_stats *Stats = &MemoryStatsTable[Index];
+
+		// NOTE(ivan): Pushes racing with this just land in either frame.
+		u64 Allocations = Stats->Allocations;
+		AtomicAddU64(&Stats->Allocations, (u64)0 - Allocations);
+		Stats->AllocationsLastFrame = Allocations;
+	}
+
+	LeaveTicketMutex(&MemoryStatsMutex);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Memory budgets and pressure.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct memory_pressure_callback_entry {
+	memory_pressure_callback *Callback;
+	void *Param;
+};
+
+static memory_pressure_callback_entry MemoryPressureCallbacks[MAX_MEMORY_PRESSURE_CALLBACKS];
+static u32 NumMemoryPressureCallbacks;
+
+SET_MEMORY_BUDGET(SetMemoryBudget)
+{
+	Assert(DebugName);
+
+	EnterTicketMutex(&MemoryStatsMutex);
+
+	memory_stats *Stats = FindOrCreateMemoryStats(DebugName, MemoryStatsType_Tracked);
+	if (Stats != &OverflowMemoryStats)
+		Stats->BudgetBytes = BudgetBytes;
+
+	LeaveTicketMutex(&MemoryStatsMutex);
+}
+
+REGISTER_MEMORY_PRESSURE_CALLBACK(RegisterMemoryPressureCallback)
+{
+	Assert(Callback);
+
+	b32 Result = false;
+
+	EnterTicketMutex(&MemoryStatsMutex);
+	// NOTE(ivan): Registering the same callback twice is a no-op, it would otherwise fire twice per signal.
+	for (u32 Index = 0; Index < NumMemoryPressureCallbacks; Index++) {
+		if (MemoryPressureCallbacks[Index].Callback == Callback &&
+			MemoryPressureCallbacks[Index].Param == Param) {
+			Result = true;
+			break;
+		}
+	}
+	if (!Result && NumMemoryPressureCallbacks < MAX_MEMORY_PRESSURE_CALLBACKS) {
+		MemoryPressureCallbacks[NumMemoryPressureCallbacks].Callback = Callback;
+		MemoryPressureCallbacks[NumMemoryPressureCallbacks].Param = Param;
+		NumMemoryPressureCallbacks++;
+		Result = true;
+	}
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	return Result;
+}
+
+UNREGISTER_MEMORY_PRESSURE_CALLBACK(UnregisterMemoryPressureCallback)
+{
+	Assert(Callback);
+
+	EnterTicketMutex(&MemoryStatsMutex);
+	for (u32 Index = 0; Index < NumMemoryPressureCallbacks; Index++) {
+		if (MemoryPressureCallbacks[Index].Callback == Callback &&
+			MemoryPressureCallbacks[Index].Param == Param) {
+			MemoryPressureCallbacks[Index] = MemoryPressureCallbacks[--NumMemoryPressureCallbacks];
+			break;
+		}
+	}
+	LeaveTicketMutex(&MemoryStatsMutex);
+}
+
+static void
+SignalMemoryPressure(platform_state *PlatformState,
+					 platform_api *PlatformAPI,
+					 memory_pressure_level Level,
+					 const char *DebugName)
+{
+	// NOTE(ivan): Callbacks are run unlocked, they may unregister themselves or deallocate tracked memory.
+	memory_pressure_callback_entry Callbacks[MAX_MEMORY_PRESSURE_CALLBACKS];
+
+	EnterTicketMutex(&MemoryStatsMutex);
+	u32 NumCallbacks = NumMemoryPressureCallbacks;
+	memcpy(Callbacks, MemoryPressureCallbacks, sizeof(memory_pressure_callback_entry) * NumCallbacks);
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	for (u32 Index = 0; Index < NumCallbacks; Index++)
+		Callbacks[Index].Callback(PlatformState, PlatformAPI, Level, DebugName, Callbacks[Index].Param);
+}
+
+void
+CheckMemoryPressure(platform_state *PlatformState,
+					platform_api *PlatformAPI,
+					f32 SecondsElapsed,
+					u64 MinAvailableBytes)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+
+	static f32 SecondsSinceSystemCheck = MEMORY_PRESSURE_CHECK_SECONDS;
+	static memory_pressure_level SystemLevel = MemoryPressureLevel_None;
+
+	// NOTE(ivan): System-wide memory.
+	SecondsSinceSystemCheck += SecondsElapsed;
+	if (MinAvailableBytes && SecondsSinceSystemCheck >= MEMORY_PRESSURE_CHECK_SECONDS) {
+		SecondsSinceSystemCheck = 0.0f;
+
+		platform_memory_stats MemoryStats = PlatformAPI->GetMemoryStats();
+		memory_pressure_level Level = MemoryPressureLevel_None;
+		if (MemoryStats.BytesAvailable < (MinAvailableBytes / 2))
+			Level = MemoryPressureLevel_Critical;
+		else if (MemoryStats.BytesAvailable < MinAvailableBytes)
+			Level = MemoryPressureLevel_Low;
+
+		if (Level != SystemLevel)
+			PlatformAPI->Log(PlatformState, "MemoryPressure: system level %u, %llu of %llu bytes available.",
+							 Level, MemoryStats.BytesAvailable, MemoryStats.BytesTotal);
+		SystemLevel = Level;
+	}
+
+	if (SystemLevel != MemoryPressureLevel_None)
+		SignalMemoryPressure(PlatformState, PlatformAPI, SystemLevel, 0);
+
+	// NOTE(ivan): Budgets, names are copied since the table may grow while callbacks run.
+	char Names[MAX_MEMORY_STATS][64];
+	memory_pressure_level Levels[MAX_MEMORY_STATS];
+	u32 NumBudgets = 0;
+
+	EnterTicketMutex(&MemoryStatsMutex);
+	for (u32 Index = 0; Index < NumMemoryStats; Index++) {
+		memory_stats *Stats = &MemoryStatsTable[Index];
+		if (!Stats->BudgetBytes)
+			continue;
+
+		u64 BudgetFailures = Stats->BudgetFailures;
+		AtomicAddU64(&Stats->BudgetFailures, (u64)0 - BudgetFailures);
+
+		memory_pressure_level Level = MemoryPressureLevel_None;
+		if (BudgetFailures)
+			Level = MemoryPressureLevel_Critical;
+		else if (Stats->BytesReserved >= (Stats->BudgetBytes / 100 * MEMORY_BUDGET_LOW_PERCENT))
+			Level = MemoryPressureLevel_Low;
+
+		if (Level != MemoryPressureLevel_None) {
+			if (BudgetFailures)
+				PlatformAPI->Log(PlatformState, "MemoryPressure[%s]: %llu allocations refused, budget %llu bytes.",
+								 Stats->DebugName, BudgetFailures, Stats->BudgetBytes);
+
+			memcpy(Names[NumBudgets], Stats->DebugName, sizeof(Names[NumBudgets]));
+			Levels[NumBudgets] = Level;
+			NumBudgets++;
+		}
+	}
+	LeaveTicketMutex(&MemoryStatsMutex);
+
+	for (u32 Index = 0; Index < NumBudgets; Index++)
+		SignalMemoryPressure(PlatformState, PlatformAPI, Levels[Index], Names[Index]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Tracked memory.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+void *
+AllocateTrackedMemory(platform_state *PlatformState,
+					  platform_api *PlatformAPI,
+					  const char *DebugName,
+					  uptr Bytes)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(DebugName);
+	Assert(Bytes);
+	Assert(sizeof(tracked_memory_header) <= TRACKED_MEMORY_HEADER_BYTES);
+
+	memory_stats *Stats = AcquireMemoryStats(DebugName, MemoryStatsType_Tracked);
+	if (!IsWithinMemoryBudget(Stats, TRACKED_MEMORY_HEADER_BYTES + Bytes)) {
+		ReleaseMemoryStats(Stats);
+		PlatformAPI->Log(PlatformState, "TrackedMemory[%s]: Over budget!", DebugName);
+		return 0;
+	}
+
+	tracked_memory_header *Header = (tracked_memory_header *)PlatformAPI->AllocateMemory(TRACKED_MEMORY_HEADER_BYTES + Bytes);
+	if (!Header) {
+		ReleaseMemoryStats(Stats);
+		PlatformAPI->Log(PlatformState, "TrackedMemory[%s]: Out of memory!", DebugName);
+		return 0;
+	}
+
+	Header->Stats = Stats;
+	Header->Bytes = Bytes;
+
+	AtomicAddU64(&Stats->BytesReserved, TRACKED_MEMORY_HEADER_BYTES + Bytes);
+	AtomicIncrementU64(&Stats->BlocksAllocated);
+	AtomicIncrementU64(&Stats->Allocations);
+	AddMemoryStatsUsed(Stats, Bytes);
+
+	return (u8 *)Header + TRACKED_MEMORY_HEADER_BYTES;
+}
+
+void
+DeallocateTrackedMemory(platform_api *PlatformAPI,
+						void *Memory)
+{
+	Assert(PlatformAPI);
+
+	if (!Memory)
+		return;
+
+	tracked_memory_header *Header = (tracked_memory_header *)((u8 *)Memory - TRACKED_MEMORY_HEADER_BYTES);
+	memory_stats *Stats = Header->Stats;
+
+	SubMemoryStatsUsed(Stats, Header->Bytes);
+	AtomicAddU64(&Stats->BytesReserved, (u64)0 - (TRACKED_MEMORY_HEADER_BYTES + Header->Bytes));
+	ReleaseMemoryStats(Stats);
+
+	PlatformAPI->DeallocateMemory(Header);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // NOTE(ivan): Memory stack.
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 static memory_stack_block *
 AllocateMemoryStackBlock(platform_api *PlatformAPI,
-						 uptr Bytes,
-						 memory_stack_block *PrevBlock)
+						 uptr Bytes)
 {
 	Assert(PlatformAPI);
 	Assert(Bytes);
@@ -19,25 +405,39 @@ AllocateMemoryStackBlock(platform_api *PlatformAPI,
 			Result->BytesTotal = Bytes;
 			Result->BytesUsed = 0;
 			Result->Next = 0;
-			Result->Prev = PrevBlock;
-
-			if (PrevBlock)
-				PrevBlock->Next = Result;
+			Result->Prev = 0;
+			Result->BytesCommitted = Bytes;
 		} else {
 			PlatformAPI->DeallocateMemory(Result);
+			Result = 0;
 		}
 	}
 
 	return Result;
 }
 
+inline void
+LockMemoryStack(memory_stack *MemoryStack)
+{
+	if (!(MemoryStack->Flags & MemoryStackFlag_ThreadLocal))
+		EnterTicketMutex(&MemoryStack->StackMutex);
+}
+
+inline void
+UnlockMemoryStack(memory_stack *MemoryStack)
+{
+	if (!(MemoryStack->Flags & MemoryStackFlag_ThreadLocal))
+		LeaveTicketMutex(&MemoryStack->StackMutex);
+}
+
 void
 InitializeMemoryStack(platform_state *PlatformState,
 					  platform_api *PlatformAPI,
 					  memory_stack *MemoryStack,
 					  const char *DebugName,
 					  uptr MinBlockBytes,
-					  uptr Bytes)
+					  uptr Bytes,
+					  u32 Flags)
 {
 	Assert(PlatformState);
 	Assert(PlatformAPI);
@@ -48,14 +448,21 @@ InitializeMemoryStack(platform_state *PlatformState,
 	EnterTicketMutex(&MemoryStack->StackMutex);
 	
 	MemoryStack->DebugName = DebugName;	
+	MemoryStack->Stats = AcquireMemoryStats(DebugName, MemoryStatsType_Stack);
 	MemoryStack->MinBlockBytes = MinBlockBytes ? MinBlockBytes : 1024; // TODO(ivan): Tune default minimal block size eventually.
+	MemoryStack->Flags = Flags;
+	MemoryStack->TempCount = 0;
+	MemoryStack->UnfoldedBytesUsed = 0;
+	MemoryStack->UnfoldedAllocations = 0;
 
-	MemoryStack->CurrentBlock = AllocateMemoryStackBlock(PlatformAPI, Bytes, 0);
+	MemoryStack->FirstBlock = MemoryStack->CurrentBlock = AllocateMemoryStackBlock(PlatformAPI, Bytes);
 	if (!MemoryStack->CurrentBlock)  {
 		LeaveTicketMutex(&MemoryStack->StackMutex);
 		PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Out of memory!", MemoryStack->DebugName);
 		return;
 	}
+	AtomicAddU64(&MemoryStack->Stats->BytesReserved, Bytes);
+	AtomicIncrementU64(&MemoryStack->Stats->BlocksAllocated);
 
 	LeaveTicketMutex(&MemoryStack->StackMutex);
 }
@@ -63,7 +470,8 @@ InitializeMemoryStack(platform_state *PlatformState,
 void
 InitializeMemoryStackEmpty(memory_stack *MemoryStack,
 						   const char *DebugName,
-						   uptr MinBlockBytes)
+						   uptr MinBlockBytes,
+						   u32 Flags)
 {
 	Assert(MemoryStack);
 	Assert(DebugName);
@@ -71,119 +479,467 @@ InitializeMemoryStackEmpty(memory_stack *MemoryStack,
 	EnterTicketMutex(&MemoryStack->StackMutex);
 
 	MemoryStack->DebugName = DebugName;
+	MemoryStack->Stats = AcquireMemoryStats(DebugName, MemoryStatsType_Stack);
 	MemoryStack->MinBlockBytes = MinBlockBytes ? MinBlockBytes : 1024; // NOTE(ivan): Tune default minimal block size eventually.
+	MemoryStack->Flags = Flags;
+	MemoryStack->TempCount = 0;
+	MemoryStack->UnfoldedBytesUsed = 0;
+	MemoryStack->UnfoldedAllocations = 0;
 
+	MemoryStack->FirstBlock = 0;
 	MemoryStack->CurrentBlock = 0;
 
 	LeaveTicketMutex(&MemoryStack->StackMutex);
 }
 
-void
-FreeMemoryStack(platform_api *PlatformAPI,
-				memory_stack *MemoryStack)
+b32
+InitializeMemoryStackVirtual(platform_state *PlatformState,
+							 platform_api *PlatformAPI,
+							 memory_stack *MemoryStack,
+							 const char *DebugName,
+							 uptr ReserveBytes,
+							 u32 Flags)
 {
+	Assert(PlatformState);
 	Assert(PlatformAPI);
 	Assert(MemoryStack);
+	Assert(DebugName);
+	Assert(ReserveBytes);
 
 	EnterTicketMutex(&MemoryStack->StackMutex);
 
-	if (!MemoryStack->CurrentBlock) {
+	MemoryStack->DebugName = DebugName;
+	MemoryStack->Stats = AcquireMemoryStats(DebugName, MemoryStatsType_Stack);
+	MemoryStack->MinBlockBytes = 0;
+	MemoryStack->Flags = Flags | MemoryStackFlag_Virtual;
+	MemoryStack->TempCount = 0;
+	MemoryStack->UnfoldedBytesUsed = 0;
+	MemoryStack->UnfoldedAllocations = 0;
+	MemoryStack->FirstBlock = MemoryStack->CurrentBlock = 0;
+
+	ReserveBytes = AlignPow2(ReserveBytes, (uptr)PLATFORM_MEMORY_PAGE_BYTES);
+
+	memory_stack_block *Block = (memory_stack_block *)PlatformAPI->AllocateMemory(sizeof(memory_stack_block));
+	if (Block) {
+		Block->Base = PlatformAPI->ReserveMemory(ReserveBytes, (Flags & MemoryStackFlag_LargePages) ? PlatformMemoryFlag_LargePages : 0);
+		if (!Block->Base) {
+			PlatformAPI->DeallocateMemory(Block);
+			Block = 0;
+		}
+	}
+	if (!Block) {
 		LeaveTicketMutex(&MemoryStack->StackMutex);
-		return;
+		PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Failed reserving %llu bytes!", DebugName, (u64)ReserveBytes);
+		return false;
+	}
+
+	Block->BytesTotal = ReserveBytes;
+	Block->BytesUsed = 0;
+	Block->BytesCommitted = 0;
+	Block->Next = Block->Prev = 0;
+	MemoryStack->FirstBlock = MemoryStack->CurrentBlock = Block;
+	AtomicIncrementU64(&MemoryStack->Stats->BlocksAllocated);
+
+	LeaveTicketMutex(&MemoryStack->StackMutex);
+	return true;
+}
+
+// NOTE(ivan): Moves pushes counted by a thread-local stack into its stats, must be called with the stack locked.
+static void
+FoldMemoryStackStats(memory_stack *MemoryStack)
+{
+	if (MemoryStack->Stats && MemoryStack->UnfoldedAllocations) {
+		AddMemoryStatsUsed(MemoryStack->Stats, MemoryStack->UnfoldedBytesUsed);
+		AtomicAddU64(&MemoryStack->Stats->Allocations, MemoryStack->UnfoldedAllocations);
+	}
+
+	MemoryStack->UnfoldedBytesUsed = 0;
+	MemoryStack->UnfoldedAllocations = 0;
+}
+
+// NOTE(ivan): Bytes used by all blocks up to the current one, must be called with the stack locked.
+static uptr
+GetMemoryStackBytesUsed(memory_stack *MemoryStack)
+{
+	uptr Result = 0;
+	for (memory_stack_block *Block = MemoryStack->FirstBlock; Block; Block = Block->Next) {
+		Result += Block->BytesUsed;
+		if (Block == MemoryStack->CurrentBlock)
+			break;
 	}
 
-	memory_stack_block *Block = MemoryStack->CurrentBlock;
+	return Result;
+}
+
+void
+FreeMemoryStack(platform_api *PlatformAPI,
+				memory_stack *MemoryStack)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryStack);
+
+	LockMemoryStack(MemoryStack);
+
+	Assert(MemoryStack->TempCount == 0);
+
+	FoldMemoryStackStats(MemoryStack);
+	uptr BytesUsed = GetMemoryStackBytesUsed(MemoryStack);
+	uptr BytesReserved = 0;
+
+	memory_stack_block *Block = MemoryStack->FirstBlock;
 	while (Block) {
 		memory_stack_block *BlockToDelete = Block;
 		Block = Block->Next;
-		PlatformAPI->DeallocateMemory(BlockToDelete->Base);
+		BytesReserved += BlockToDelete->BytesCommitted;
+		if (MemoryStack->Flags & MemoryStackFlag_Virtual)
+			PlatformAPI->ReleaseMemory(BlockToDelete->Base, BlockToDelete->BytesTotal);
+		else
+			PlatformAPI->DeallocateMemory(BlockToDelete->Base);
 		PlatformAPI->DeallocateMemory(BlockToDelete);
 	}
 
+	MemoryStack->FirstBlock = 0;
 	MemoryStack->CurrentBlock = 0;
 
-	LeaveTicketMutex(&MemoryStack->StackMutex);
+	if (MemoryStack->Stats) {
+		SubMemoryStatsUsed(MemoryStack->Stats, BytesUsed);
+		AtomicAddU64(&MemoryStack->Stats->BytesReserved, (u64)0 - BytesReserved);
+		ReleaseMemoryStats(MemoryStack->Stats);
+		MemoryStack->Stats = 0;
+	}
+
+	UnlockMemoryStack(MemoryStack);
+}
+
+// NOTE(ivan): Bytes needed to align next push from given block.
+inline uptr
+GetStackAlignmentOffset(memory_stack_block *Block, uptr Alignment)
+{
+	uptr Pointer = (uptr)Block->Base + Block->BytesUsed;
+	return AlignPow2(Pointer, Alignment) - Pointer;
+}
+
+void
+ResetMemoryStack(memory_stack *MemoryStack)
+{
+	Assert(MemoryStack);
+
+	LockMemoryStack(MemoryStack);
+
+	Assert(MemoryStack->TempCount == 0);
+
+	FoldMemoryStackStats(MemoryStack);
+	if (MemoryStack->Stats)
+		SubMemoryStatsUsed(MemoryStack->Stats, GetMemoryStackBytesUsed(MemoryStack));
+
+	MemoryStack->CurrentBlock = MemoryStack->FirstBlock;
+	if (MemoryStack->CurrentBlock)
+		MemoryStack->CurrentBlock->BytesUsed = 0;
+
+	UnlockMemoryStack(MemoryStack);
+}
+
+// NOTE(ivan): Makes sure a virtual stack block is committed up to BytesEnd.
+static b32
+CommitMemoryStackBlock(platform_api *PlatformAPI,
+					   memory_stack *MemoryStack,
+					   memory_stack_block *Block,
+					   uptr BytesEnd)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryStack);
+	Assert(Block);
+
+	b32 Result = true;
+
+	LockMemoryStack(MemoryStack);
+	if (BytesEnd > Block->BytesCommitted) {
+		uptr NewBytesCommitted = Min(AlignPow2(BytesEnd, (uptr)MEMORY_STACK_COMMIT_BYTES), Block->BytesTotal);
+		Result = IsWithinMemoryBudget(MemoryStack->Stats, NewBytesCommitted - Block->BytesCommitted);
+		if (Result)
+			Result = PlatformAPI->CommitMemory((u8 *)Block->Base + Block->BytesCommitted, NewBytesCommitted - Block->BytesCommitted);
+		if (Result) {
+			if (MemoryStack->Stats)
+				AtomicAddU64(&MemoryStack->Stats->BytesReserved, NewBytesCommitted - Block->BytesCommitted);
+
+			CompletePastWritesBeforeFutureWrites();
+			Block->BytesCommitted = NewBytesCommitted;
+		}
+	}
+	UnlockMemoryStack(MemoryStack);
+
+	return Result;
+}
+
+// NOTE(ivan): Tries to push into given block, returns zero if it does not fit.
+// BytesUsedBefore receives the block's used bytes the push started at.
+inline void *
+BumpMemoryStackBlock(memory_stack *MemoryStack,
+					 memory_stack_block *Block,
+					 uptr Bytes, uptr Alignment,
+					 uptr *BytesUsedBefore)
+{
+	if (MemoryStack->Flags & MemoryStackFlag_ThreadLocal) {
+		uptr Padding = GetStackAlignmentOffset(Block, Alignment);
+		if ((Block->BytesTotal - Block->BytesUsed) < (Padding + Bytes))
+			return 0;
+
+		void *Result = (void *)((uptr)Block->Base + Block->BytesUsed + Padding);
+		*BytesUsedBefore = Block->BytesUsed;
+		Block->BytesUsed += Padding + Bytes;
+		MemoryStack->PaddingBytes += Padding;
+		MemoryStack->UnfoldedBytesUsed += Padding + Bytes;
+		MemoryStack->UnfoldedAllocations++;
+		return Result;
+	}
+
+	while (true) {
+		uptr BytesUsed = Block->BytesUsed;
+		uptr Pointer = (uptr)Block->Base + BytesUsed;
+		uptr Padding = AlignPow2(Pointer, Alignment) - Pointer;
+		if ((Block->BytesTotal - BytesUsed) < (Padding + Bytes))
+			return 0;
+
+		if (AtomicCompareExchangeU64((volatile u64 *)&Block->BytesUsed, BytesUsed + Padding + Bytes, BytesUsed) == BytesUsed) {
+			*BytesUsedBefore = BytesUsed;
+			AtomicAddU64((volatile u64 *)&MemoryStack->PaddingBytes, Padding);
+			if (MemoryStack->Stats) {
+				AddMemoryStatsUsed(MemoryStack->Stats, Padding + Bytes);
+				AtomicIncrementU64(&MemoryStack->Stats->Allocations);
+			}
+			return (void *)(Pointer + Padding);
+		}
+	}
+}
+
+// NOTE(ivan): Takes a push back, unless something else was pushed after it already, then its bytes stay used.
+static void
+UnbumpMemoryStackBlock(memory_stack *MemoryStack,
+					   memory_stack_block *Block,
+					   uptr Bytes,
+					   uptr BytesUsedBefore, uptr BytesUsedAfter)
+{
+	uptr Padding = (BytesUsedAfter - BytesUsedBefore) - Bytes;
+
+	if (MemoryStack->Flags & MemoryStackFlag_ThreadLocal) {
+		Assert(Block->BytesUsed == BytesUsedAfter);
+		Block->BytesUsed = BytesUsedBefore;
+		MemoryStack->PaddingBytes -= Padding;
+		MemoryStack->UnfoldedBytesUsed -= Padding + Bytes;
+		MemoryStack->UnfoldedAllocations--;
+		return;
+	}
+
+	if (AtomicCompareExchangeU64((volatile u64 *)&Block->BytesUsed, BytesUsedBefore, BytesUsedAfter) == BytesUsedAfter) {
+		AtomicAddU64((volatile u64 *)&MemoryStack->PaddingBytes, (u64)0 - Padding);
+		if (MemoryStack->Stats) {
+			SubMemoryStatsUsed(MemoryStack->Stats, Padding + Bytes);
+			AtomicDecrementU64(&MemoryStack->Stats->Allocations);
+		}
+	}
 }
 
 void *
 PushStackSize(platform_state *PlatformState,
 			  platform_api *PlatformAPI,
-			  memory_stack *MemoryStack, uptr Bytes)
+			  memory_stack *MemoryStack, uptr Bytes,
+			  uptr Alignment)
 {
 	Assert(PlatformState);
 	Assert(PlatformAPI);
 	Assert(MemoryStack);
 	Assert(Bytes);
+	Assert(Alignment && Alignment <= MAX_MEMORY_ALIGNMENT);
+	Assert((Alignment & (Alignment - 1)) == 0);
 
-	EnterTicketMutex(&MemoryStack->StackMutex);
+	while (true) {
+		// NOTE(ivan): Fast path, bump the current block.
+		memory_stack_block *TargetBlock = MemoryStack->CurrentBlock;
+		if (TargetBlock) {
+			uptr BytesUsedBefore;
+			void *Result = BumpMemoryStackBlock(MemoryStack, TargetBlock, Bytes, Alignment, &BytesUsedBefore);
+			if (Result) {
+				// NOTE(ivan): Virtual stacks may need more pages committed first.
+				// The push is taken back if that fails, so it does not stay counted as used till the next reset.
+				if (MemoryStack->Flags & MemoryStackFlag_Virtual) {
+					uptr BytesEnd = ((uptr)Result - (uptr)TargetBlock->Base) + Bytes;
+					if (BytesEnd > TargetBlock->BytesCommitted &&
+						!CommitMemoryStackBlock(PlatformAPI, MemoryStack, TargetBlock, BytesEnd)) {
+						UnbumpMemoryStackBlock(MemoryStack, TargetBlock, Bytes, BytesUsedBefore, BytesEnd);
+						PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Failed committing memory, out of memory or over budget!", MemoryStack->DebugName);
+						return 0;
+					}
+				}
 
-	memory_stack_block *TargetBlock = 0;
-	if (MemoryStack->CurrentBlock) {
-		TargetBlock = MemoryStack->CurrentBlock;
-		while (TargetBlock) {
-			if ((TargetBlock->BytesTotal - TargetBlock->BytesUsed) >= Bytes)
-				break;
-
-			TargetBlock = TargetBlock->Next;
+				return Result;
+			}
 		}
-	}
-	if (!TargetBlock) {
-		memory_stack_block *NewBlock = AllocateMemoryStackBlock(PlatformAPI,
-																Max(MemoryStack->MinBlockBytes, Bytes),
-																TargetBlock);
-		if (!NewBlock) {
-			LeaveTicketMutex(&MemoryStack->StackMutex);
-			PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Out of memory!", MemoryStack->DebugName);
+
+		// NOTE(ivan): Virtual stacks never chain blocks, running out of reserved space is fatal for the push.
+		if (MemoryStack->Flags & MemoryStackFlag_Virtual) {
+			PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Out of reserved memory!", MemoryStack->DebugName);
 			return 0;
 		}
-		MemoryStack->CurrentBlock = NewBlock;
-		TargetBlock = NewBlock;
+
+		// NOTE(ivan): Slow path, current block is full, switch to another one under the lock.
+		LockMemoryStack(MemoryStack);
+		FoldMemoryStackStats(MemoryStack);
+
+		// NOTE(ivan): Someone else might have switched the block already, then just retry.
+		if (MemoryStack->CurrentBlock == TargetBlock) {
+			// NOTE(ivan): Reuse the next spare block if it is large enough.
+			memory_stack_block *NextBlock = TargetBlock ? TargetBlock->Next : MemoryStack->FirstBlock;
+			if (NextBlock && NextBlock->BytesTotal >= (AlignPow2((uptr)NextBlock->Base, Alignment) - (uptr)NextBlock->Base + Bytes)) {
+				NextBlock->BytesUsed = 0;
+				TargetBlock = NextBlock;
+			} else {
+				// NOTE(ivan): Otherwise insert a fresh block right after the current one,
+				// keeping all the spares after it. It is large enough for the worst alignment case.
+				uptr NewBlockBytes = Max(MemoryStack->MinBlockBytes, Bytes + Alignment - 1);
+				if (!IsWithinMemoryBudget(MemoryStack->Stats, NewBlockBytes)) {
+					UnlockMemoryStack(MemoryStack);
+					PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Over budget!", MemoryStack->DebugName);
+					return 0;
+				}
+
+				memory_stack_block *NewBlock = AllocateMemoryStackBlock(PlatformAPI, NewBlockBytes);
+				if (!NewBlock) {
+					UnlockMemoryStack(MemoryStack);
+					PlatformAPI->Log(PlatformState, "MemoryStack[%s]: Out of memory!", MemoryStack->DebugName);
+					return 0;
+				}
+
+				if (MemoryStack->Stats) {
+					AtomicAddU64(&MemoryStack->Stats->BytesReserved, NewBlock->BytesTotal);
+					AtomicIncrementU64(&MemoryStack->Stats->BlocksAllocated);
+				}
+
+				NewBlock->Prev = TargetBlock;
+				NewBlock->Next = NextBlock;
+				if (NextBlock)
+					NextBlock->Prev = NewBlock;
+				if (TargetBlock)
+					TargetBlock->Next = NewBlock;
+				else
+					MemoryStack->FirstBlock = NewBlock;
+
+				TargetBlock = NewBlock;
+			}
+
+			CompletePastWritesBeforeFutureWrites();
+			MemoryStack->CurrentBlock = TargetBlock;
+		}
+
+		UnlockMemoryStack(MemoryStack);
 	}
+}
+
+temporary_memory
+BeginTemporaryMemory(memory_stack *MemoryStack)
+{
+	Assert(MemoryStack);
+
+	temporary_memory Result;
+
+	LockMemoryStack(MemoryStack);
+
+	Result.Stack = MemoryStack;
+	Result.Block = MemoryStack->CurrentBlock;
+	Result.BytesUsed = MemoryStack->CurrentBlock ? MemoryStack->CurrentBlock->BytesUsed : 0;
+	MemoryStack->TempCount++;
+
+	UnlockMemoryStack(MemoryStack);
+
+	return Result;
+}
+
+void
+EndTemporaryMemory(temporary_memory TempMemory)
+{
+	memory_stack *MemoryStack = TempMemory.Stack;
+	Assert(MemoryStack);
+
+	LockMemoryStack(MemoryStack);
+
+	Assert(MemoryStack->TempCount > 0);
 
-	void *Result = (void *)((uptr)TargetBlock->Base + TargetBlock->BytesUsed);
-	TargetBlock->BytesUsed += Bytes;
+	FoldMemoryStackStats(MemoryStack);
+	uptr BytesUsedBefore = GetMemoryStackBytesUsed(MemoryStack);
 
-	LeaveTicketMutex(&MemoryStack->StackMutex);
+	// NOTE(ivan): Blocks used after the marker are not freed, they stay as spares.
+	if (TempMemory.Block) {
+		MemoryStack->CurrentBlock = TempMemory.Block;
+		MemoryStack->CurrentBlock->BytesUsed = TempMemory.BytesUsed;
+	} else {
+		MemoryStack->CurrentBlock = MemoryStack->FirstBlock;
+		if (MemoryStack->CurrentBlock)
+			MemoryStack->CurrentBlock->BytesUsed = 0;
+	}
+	MemoryStack->TempCount--;
 
-	return Result;
+	if (MemoryStack->Stats)
+		SubMemoryStatsUsed(MemoryStack->Stats, BytesUsedBefore - GetMemoryStackBytesUsed(MemoryStack));
+
+	UnlockMemoryStack(MemoryStack);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // NOTE(ivan): Memory pool.
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+// NOTE(ivan): Bytes a chunk of given size takes from the platform layer.
+inline uptr
+GetMemoryPoolChunkBytes(memory_pool *MemoryPool, u32 NumBlocks)
+{
+	return sizeof(memory_pool_chunk) + (uptr)NumBlocks * MemoryPool->BlockStride + MemoryPool->Alignment - 1;
+}
+
+// NOTE(ivan): Allocates a chunk and pushes all of its blocks to the pool free list.
 static memory_pool_chunk *
 AllocateMemoryPoolChunk(platform_api *PlatformAPI,
-						u32 BlockSize, u32 NumBlocks)
+						memory_pool *MemoryPool,
+						u32 NumBlocks)
 {
 	Assert(PlatformAPI);
-	Assert(BlockSize);
+	Assert(MemoryPool);
 	Assert(NumBlocks);
 
 	memory_pool_chunk *Chunk = (memory_pool_chunk *)PlatformAPI->AllocateMemory(sizeof(memory_pool_chunk));
 	if (!Chunk)
 		return 0;
 
+	// NOTE(ivan): Allocate with enough slack to align the first block by hand.
+	uptr BlocksBytes = (uptr)NumBlocks * MemoryPool->BlockStride;
+	Chunk->Memory = PlatformAPI->AllocateMemory(BlocksBytes + MemoryPool->Alignment - 1);
+	if (!Chunk->Memory) {
+		PlatformAPI->DeallocateMemory(Chunk);
+		return 0;
+	}
+
 	Chunk->NumBlocks = NumBlocks;
-	Chunk->Blocks = PlatformAPI->AllocateMemory(NumBlocks * (sizeof(memory_pool_block) + BlockSize));
-	Chunk->FreeBlocks = 0;
-	Chunk->AllocBlocks = 0;
-	Chunk->Next = 0;
-
-	for (u32 Index = 0; Index < NumBlocks; Index++) {
-		memory_pool_block *Block = (memory_pool_block *)((u8 *)Chunk->Blocks + Index * (BlockSize + sizeof(memory_pool_block)));
-		if (!Block) {
-			PlatformAPI->DeallocateMemory(Chunk->Blocks);
-			return 0;
-		}
+	Chunk->NumFreeBlocks = NumBlocks;
+	Chunk->Blocks = (void *)AlignPow2((uptr)Chunk->Memory, (uptr)MemoryPool->Alignment);
+
+	// NOTE(ivan): Link blocks backwards, so the free list hands them out in address order.
+	for (u32 Index = NumBlocks; Index > 0; Index--) {
+		void *Address = (u8 *)Chunk->Blocks + (Index - 1) * MemoryPool->BlockStride + MemoryPool->BlockHeaderBytes;
+
+		GetMemoryPoolBlock(Address)->ChunkAndFreeBit = (uptr)Chunk | 1;
+		SetMemoryPoolNextFree(Address, MemoryPool->FreeList);
+		MemoryPool->FreeList = Address;
+	}
+
+	Chunk->Next = MemoryPool->Chunks;
+	MemoryPool->Chunks = Chunk;
 
-		Block->Chunk = Chunk;
-		Block->Prev = 0;
-		Block->Next = Chunk->FreeBlocks;
-		if (Chunk->FreeBlocks)
-			Chunk->FreeBlocks->Prev = Block;
-		Chunk->FreeBlocks = Block;
+	MemoryPool->NumBlocks += NumBlocks;
+	MemoryPool->NumFreeBlocks += NumBlocks;
+	if (MemoryPool->Stats) {
+		AtomicAddU64(&MemoryPool->Stats->BytesReserved, GetMemoryPoolChunkBytes(MemoryPool, NumBlocks));
+		AtomicIncrementU64(&MemoryPool->Stats->BlocksAllocated);
 	}
+	MemoryPool->PaddingBytes += (((uptr)Chunk->Blocks - (uptr)Chunk->Memory) +
+								 (uptr)NumBlocks * (MemoryPool->BlockStride - MemoryPool->BlockSize - sizeof(memory_pool_block)));
 
 	return Chunk;
 }
@@ -195,10 +951,28 @@ FreeMemoryPoolChunk(platform_api *PlatformAPI,
 	Assert(PlatformAPI);
 	Assert(Chunk);
 
-	PlatformAPI->DeallocateMemory(Chunk->Blocks);
+	PlatformAPI->DeallocateMemory(Chunk->Memory);
 	PlatformAPI->DeallocateMemory(Chunk);
 }
 
+// NOTE(ivan): Grows the pool geometrically by a single chunk.
+static b32
+GrowMemoryPool(platform_api *PlatformAPI,
+			   memory_pool *MemoryPool)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+
+	u32 NumBlocks = MemoryPool->NextChunkBlocks;
+	if (!AllocateMemoryPoolChunk(PlatformAPI, MemoryPool, NumBlocks))
+		return false;
+
+	u64 NextChunkBlocks = (u64)NumBlocks * MemoryPool->DefaultMultiplier;
+	MemoryPool->NextChunkBlocks = (u32)Min(NextChunkBlocks, (u64)Max(NumBlocks, MemoryPool->MaxChunkBlocks));
+
+	return true;
+}
+
 void
 InitializeMemoryPool(platform_state *PlatformState,
 					 platform_api *PlatformAPI,
@@ -206,7 +980,9 @@ InitializeMemoryPool(platform_state *PlatformState,
 					 const char *DebugName,
 					 u32 BlockSize,
 					 u32 InitialBlocksCount,
-					 u32 DefaultMultiplier)
+					 u32 DefaultMultiplier,
+					 u32 Alignment,
+					 u32 MaxChunkBlocks)
 {
 	Assert(PlatformState);
 	Assert(PlatformAPI);
@@ -215,16 +991,32 @@ InitializeMemoryPool(platform_state *PlatformState,
 	Assert(BlockSize);
 	Assert(InitialBlocksCount);
 	Assert(DefaultMultiplier == 0 || DefaultMultiplier > 1);
+	Assert(Alignment && Alignment <= MAX_MEMORY_ALIGNMENT);
+	Assert((Alignment & (Alignment - 1)) == 0);
 
 	EnterTicketMutex(&MemoryPool->PoolMutex);
 
+	// NOTE(ivan): Free blocks store the free list link in their user data, so it must fit.
+	BlockSize = Max(BlockSize, (u32)sizeof(void *));
+	Alignment = Max(Alignment, (u32)sizeof(memory_pool_block));
+
 	MemoryPool->DebugName = DebugName;
+	MemoryPool->Stats = AcquireMemoryStats(DebugName, MemoryStatsType_Pool);
 	MemoryPool->BlockSize = BlockSize;
 	MemoryPool->DefaultMultiplier = DefaultMultiplier ? DefaultMultiplier : 2; // TODO(ivan): Tune default multiplier value eventually.
+	MemoryPool->MaxChunkBlocks = MaxChunkBlocks ? MaxChunkBlocks : DEFAULT_MEMORY_POOL_MAX_CHUNK_BLOCKS;
+	MemoryPool->NextChunkBlocks = InitialBlocksCount;
+	MemoryPool->Alignment = Alignment;
+	MemoryPool->BlockHeaderBytes = (u32)AlignPow2((uptr)sizeof(memory_pool_block), (uptr)Alignment);
+	MemoryPool->BlockStride = MemoryPool->BlockHeaderBytes + (u32)AlignPow2((uptr)BlockSize, (uptr)Alignment);
+	MemoryPool->Chunks = 0;
+	MemoryPool->FreeList = 0;
+	MemoryPool->NumBlocks = 0;
+	MemoryPool->NumFreeBlocks = 0;
+	MemoryPool->PaddingBytes = 0;
 
 	// NOTE(ivan): Allocate first chunk.
-	MemoryPool->Chunks = AllocateMemoryPoolChunk(PlatformAPI, BlockSize, InitialBlocksCount);
-	if (!MemoryPool->Chunks) {
+	if (!GrowMemoryPool(PlatformAPI, MemoryPool)) {
 		LeaveTicketMutex(&MemoryPool->PoolMutex);
 		PlatformAPI->Log(PlatformState, "MemoryPool[%s]: Out of memory!", DebugName);
 		return;
@@ -241,72 +1033,127 @@ FreeMemoryPool(platform_api *PlatformAPI,
 
 	EnterTicketMutex(&MemoryPool->PoolMutex);
 
-	if (!MemoryPool->Chunks) {
-		LeaveTicketMutex(&MemoryPool->PoolMutex);
-		return;
-	}
-
+	uptr BytesReserved = 0;
 	memory_pool_chunk *Chunk = MemoryPool->Chunks;
 	while (Chunk) {
 		memory_pool_chunk *ChunkToDelete = Chunk;
 		Chunk = Chunk->Next;
 
+		BytesReserved += GetMemoryPoolChunkBytes(MemoryPool, ChunkToDelete->NumBlocks);
 		FreeMemoryPoolChunk(PlatformAPI, ChunkToDelete);
 	}
 
+	if (MemoryPool->Stats) {
+		SubMemoryStatsUsed(MemoryPool->Stats, (uptr)(MemoryPool->NumBlocks - MemoryPool->NumFreeBlocks) * MemoryPool->BlockSize);
+		AtomicAddU64(&MemoryPool->Stats->BytesReserved, (u64)0 - BytesReserved);
+		ReleaseMemoryStats(MemoryPool->Stats);
+		MemoryPool->Stats = 0;
+	}
+
+	MemoryPool->Chunks = 0;
+	MemoryPool->FreeList = 0;
+	MemoryPool->NumBlocks = 0;
+	MemoryPool->NumFreeBlocks = 0;
+
+	LeaveTicketMutex(&MemoryPool->PoolMutex);
+}
+
+void
+TrimMemoryPool(platform_api *PlatformAPI,
+			   memory_pool *MemoryPool)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+
+	EnterTicketMutex(&MemoryPool->PoolMutex);
+
+	// NOTE(ivan): First chunk in the list is the newest one, keep the oldest chunk around.
+	b32 AnyEmptyChunk = false;
+	for (memory_pool_chunk *Chunk = MemoryPool->Chunks; Chunk && Chunk->Next; Chunk = Chunk->Next) {
+		if (Chunk->NumFreeBlocks == Chunk->NumBlocks) {
+			AnyEmptyChunk = true;
+			break;
+		}
+	}
+
+	if (AnyEmptyChunk) {
+		// NOTE(ivan): Unlink blocks of empty chunks from the free list, they are marked by a zero chunk header.
+		memory_pool_chunk **ChunkPtr = &MemoryPool->Chunks;
+		while (*ChunkPtr) {
+			memory_pool_chunk *Chunk = *ChunkPtr;
+			if (Chunk->Next && Chunk->NumFreeBlocks == Chunk->NumBlocks) {
+				for (u32 Index = 0; Index < Chunk->NumBlocks; Index++)
+					GetMemoryPoolBlock((u8 *)Chunk->Blocks + Index * MemoryPool->BlockStride + MemoryPool->BlockHeaderBytes)->ChunkAndFreeBit = 0;
+			}
+			ChunkPtr = &Chunk->Next;
+		}
+
+		void **FreePtr = &MemoryPool->FreeList;
+		while (*FreePtr) {
+			void *Address = *FreePtr;
+			if (GetMemoryPoolBlock(Address)->ChunkAndFreeBit == 0)
+				*FreePtr = GetMemoryPoolNextFree(Address);
+			else
+				FreePtr = (void **)Address;
+		}
+
+		ChunkPtr = &MemoryPool->Chunks;
+		while (*ChunkPtr) {
+			memory_pool_chunk *Chunk = *ChunkPtr;
+			if (Chunk->Next && Chunk->NumFreeBlocks == Chunk->NumBlocks) {
+				*ChunkPtr = Chunk->Next;
+
+				MemoryPool->NumBlocks -= Chunk->NumBlocks;
+				MemoryPool->NumFreeBlocks -= Chunk->NumBlocks;
+				if (MemoryPool->Stats)
+					AtomicAddU64(&MemoryPool->Stats->BytesReserved, (u64)0 - GetMemoryPoolChunkBytes(MemoryPool, Chunk->NumBlocks));
+				MemoryPool->PaddingBytes -= (((uptr)Chunk->Blocks - (uptr)Chunk->Memory) +
+											 (uptr)Chunk->NumBlocks * (MemoryPool->BlockStride - MemoryPool->BlockSize - sizeof(memory_pool_block)));
+				FreeMemoryPoolChunk(PlatformAPI, Chunk);
+			} else {
+				ChunkPtr = &Chunk->Next;
+			}
+		}
+	}
+
 	LeaveTicketMutex(&MemoryPool->PoolMutex);
 }
 
 void *
 PushPoolSize(platform_state *PlatformState,
 			 platform_api *PlatformAPI,
-			 memory_pool *MemoryPool)
+			 memory_pool *MemoryPool,
+			 uptr Alignment)
 {
 	Assert(PlatformState);
 	Assert(PlatformAPI);
 	Assert(MemoryPool);
+	Assert(Alignment <= MemoryPool->Alignment);
 
 	EnterTicketMutex(&MemoryPool->PoolMutex);
 
-	// NOTE(ivan): Search for a chunk that is not full.
-	memory_pool_chunk *Chunk = MemoryPool->Chunks;
-	while (!Chunk->FreeBlocks) {
-		Chunk = Chunk->Next;
-		if (!Chunk)
-			break;
-	}
-
 	// NOTE(ivan): All chunks are full?
-	if (!Chunk) {
-		// NOTE(ivan): Allocate new chunk.
-		memory_pool_chunk *NewChunk = AllocateMemoryPoolChunk(PlatformAPI,
-															  MemoryPool->BlockSize,
-															  MemoryPool->Chunks->NumBlocks * MemoryPool->DefaultMultiplier); // NOTE(ivan): Tune allocation multiplier eventually.
-		if (!NewChunk) {
+	if (!MemoryPool->FreeList) {
+		if (!IsWithinMemoryBudget(MemoryPool->Stats, GetMemoryPoolChunkBytes(MemoryPool, MemoryPool->NextChunkBlocks))) {
+			LeaveTicketMutex(&MemoryPool->PoolMutex);
+			PlatformAPI->Log(PlatformState, "MemoryPool[%s]: Over budget!", MemoryPool->DebugName);
+			return 0;
+		}
+
+		if (!GrowMemoryPool(PlatformAPI, MemoryPool)) {
 			LeaveTicketMutex(&MemoryPool->PoolMutex);
 			PlatformAPI->Log(PlatformState, "MemoryPool[%s]: Out of memory!", MemoryPool->DebugName);
 			return 0;
 		}
-		
-		NewChunk->Next = MemoryPool->Chunks;
-		MemoryPool->Chunks = NewChunk;
-		Chunk = NewChunk;
 	}
 
-	// NOTE(ivan): Allocate space.
-	memory_pool_block *Block = Chunk->FreeBlocks;
-	Chunk->FreeBlocks = Block->Next;
-	if (Chunk->FreeBlocks)
-		Chunk->FreeBlocks->Prev = 0;
-
-	Block->Next = Chunk->AllocBlocks;
-	if (Chunk->AllocBlocks)
-		Chunk->AllocBlocks->Prev = Block;
-	Chunk->AllocBlocks = Block;
+	void *Result = PopMemoryPoolFreeList(MemoryPool);
 
 	LeaveTicketMutex(&MemoryPool->PoolMutex);
 
-	return (void *)((u8 *)Block + sizeof(memory_pool_block));
+	// NOTE(ivan): Blocks come zeroed just like AllocateMemory() results, reused ones included.
+	memset(Result, 0, MemoryPool->BlockSize);
+	return Result;
 }
 
 void
@@ -318,19 +1165,510 @@ FreePoolSize(memory_pool *MemoryPool, void *Address)
 		return;
 
 	EnterTicketMutex(&MemoryPool->PoolMutex);
+	PushMemoryPoolFreeList(MemoryPool, Address);
+	LeaveTicketMutex(&MemoryPool->PoolMutex);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Concurrent memory pool.
+//////////////////////////////////////////////////////////////////////////////////////////////////
 
-	memory_pool_block *Block = (memory_pool_block *)((u8 *)Address - sizeof(memory_pool_block));
-	memory_pool_chunk *Chunk = Block->Chunk;
+// NOTE(ivan): Per-thread cache of free blocks for a single concurrent pool.
+struct concurrent_memory_pool_magazine {
+	u32 PoolId;
+	u32 NumBlocks;
+	void *Blocks[CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE];
+};
 
-	Chunk->AllocBlocks = Block->Next;
-	if (Chunk->AllocBlocks)
-		Chunk->AllocBlocks->Prev = 0;
+// NOTE(ivan): Slots are owned by alive pools, a magazine whose PoolId does not match
+// its slot owner belongs to an already freed pool and is simply dropped.
+static volatile u64 ConcurrentMemoryPoolSlots[MAX_CONCURRENT_MEMORY_POOLS]; // NOTE(ivan): Owning pool addresses.
+static volatile u32 NextConcurrentMemoryPoolId;
+static ThreadLocal concurrent_memory_pool_magazine ConcurrentMemoryPoolMagazines[MAX_CONCURRENT_MEMORY_POOLS];
+
+inline void *
+GetConcurrentPoolHeadAddress(u64 Head)
+{
+	return (void *)(uptr)(Head & ((1ULL << CONCURRENT_MEMORY_POOL_ADDRESS_BITS) - 1));
+}
 
-	Block->Next = Chunk->FreeBlocks;
-	if (Block->Next)
-		Block->Next->Prev = Block;
+inline u64
+MakeConcurrentPoolHead(void *Address, u64 OldHead)
+{
+	Assert(((uptr)Address >> CONCURRENT_MEMORY_POOL_ADDRESS_BITS) == 0);
 
-	Chunk->FreeBlocks = Block;
+	u64 Tag = (OldHead >> CONCURRENT_MEMORY_POOL_ADDRESS_BITS) + 1;
+	return (u64)(uptr)Address | (Tag << CONCURRENT_MEMORY_POOL_ADDRESS_BITS);
+}
 
-	LeaveTicketMutex(&MemoryPool->PoolMutex);
+// NOTE(ivan): Pushes a chain of blocks, already linked from First to Last, with a single compare-exchange.
+static void
+PushConcurrentPoolChain(concurrent_memory_pool *MemoryPool, void *First, void *Last)
+{
+	while (true) {
+		u64 Head = MemoryPool->FreeHead;
+		SetMemoryPoolNextFree(Last, GetConcurrentPoolHeadAddress(Head));
+		CompletePastWritesBeforeFutureWrites();
+
+		if (AtomicCompareExchangeU64(&MemoryPool->FreeHead, MakeConcurrentPoolHead(First, Head), Head) == Head)
+			break;
+	}
+}
+
+static void *
+PopConcurrentPoolBlock(concurrent_memory_pool *MemoryPool)
+{
+	while (true) {
+		u64 Head = MemoryPool->FreeHead;
+		void *Result = GetConcurrentPoolHeadAddress(Head);
+		if (!Result)
+			return 0;
+
+		// NOTE(ivan): Result may be popped by someone else meanwhile, then the link read here
+		// is garbage, but the tag makes the compare-exchange below fail anyway.
+		void *Next = *(void *volatile *)Result;
+		if (AtomicCompareExchangeU64(&MemoryPool->FreeHead, MakeConcurrentPoolHead(Next, Head), Head) == Head)
+			return Result;
+	}
+}
+
+// NOTE(ivan): Must be called with GrowMutex held.
+static b32
+GrowConcurrentMemoryPool(platform_api *PlatformAPI,
+						 concurrent_memory_pool *MemoryPool)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+
+	u32 NumBlocks = MemoryPool->NextChunkBlocks;
+
+	concurrent_memory_pool_chunk *Chunk = (concurrent_memory_pool_chunk *)PlatformAPI->AllocateMemory(sizeof(concurrent_memory_pool_chunk));
+	if (!Chunk)
+		return false;
+
+	Chunk->Memory = PlatformAPI->AllocateMemory((uptr)NumBlocks * MemoryPool->BlockStride + MemoryPool->Alignment - 1);
+	if (!Chunk->Memory) {
+		PlatformAPI->DeallocateMemory(Chunk);
+		return false;
+	}
+	Chunk->NumBlocks = NumBlocks;
+
+	// NOTE(ivan): Link blocks privately first, then publish them all at once.
+	u8 *First = (u8 *)AlignPow2((uptr)Chunk->Memory, (uptr)MemoryPool->Alignment);
+	for (u32 Index = 0; Index < (NumBlocks - 1); Index++)
+		SetMemoryPoolNextFree(First + Index * MemoryPool->BlockStride, First + (Index + 1) * MemoryPool->BlockStride);
+	PushConcurrentPoolChain(MemoryPool, First, First + (NumBlocks - 1) * MemoryPool->BlockStride);
+
+	Chunk->Next = MemoryPool->Chunks;
+	MemoryPool->Chunks = Chunk;
+	MemoryPool->NumBlocks += NumBlocks;
+	if (MemoryPool->Stats) {
+		AtomicAddU64(&MemoryPool->Stats->BytesReserved, sizeof(concurrent_memory_pool_chunk) + (uptr)NumBlocks * MemoryPool->BlockStride + MemoryPool->Alignment - 1);
+		AtomicIncrementU64(&MemoryPool->Stats->BlocksAllocated);
+	}
+
+	u64 NextChunkBlocks = (u64)NumBlocks * MemoryPool->DefaultMultiplier;
+	MemoryPool->NextChunkBlocks = (u32)Min(NextChunkBlocks, (u64)Max(NumBlocks, MemoryPool->MaxChunkBlocks));
+
+	return true;
+}
+
+void
+InitializeConcurrentMemoryPool(platform_state *PlatformState,
+							   platform_api *PlatformAPI,
+							   concurrent_memory_pool *MemoryPool,
+							   const char *DebugName,
+							   u32 BlockSize,
+							   u32 InitialBlocksCount,
+							   u32 DefaultMultiplier,
+							   u32 Alignment,
+							   u32 MaxChunkBlocks)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+	Assert(DebugName);
+	Assert(BlockSize);
+	Assert(InitialBlocksCount);
+	Assert(DefaultMultiplier == 0 || DefaultMultiplier > 1);
+	Assert(Alignment && Alignment <= MAX_MEMORY_ALIGNMENT);
+	Assert((Alignment & (Alignment - 1)) == 0);
+
+	EnterTicketMutex(&MemoryPool->GrowMutex);
+
+	// NOTE(ivan): Free blocks store the free list link in their user data, so it must fit.
+	BlockSize = Max(BlockSize, (u32)sizeof(void *));
+	Alignment = Max(Alignment, (u32)sizeof(void *));
+
+	MemoryPool->DebugName = DebugName;
+	MemoryPool->Stats = AcquireMemoryStats(DebugName, MemoryStatsType_ConcurrentPool);
+	MemoryPool->BytesHandedOut = 0;
+	MemoryPool->DefaultMultiplier = DefaultMultiplier ? DefaultMultiplier : 2;
+	MemoryPool->MaxChunkBlocks = MaxChunkBlocks ? MaxChunkBlocks : DEFAULT_MEMORY_POOL_MAX_CHUNK_BLOCKS;
+	MemoryPool->NextChunkBlocks = InitialBlocksCount;
+	MemoryPool->FreeHead = 0;
+	MemoryPool->Chunks = 0;
+	MemoryPool->NumBlocks = 0;
+	MemoryPool->BlockSize = BlockSize;
+	MemoryPool->Alignment = Alignment;
+	MemoryPool->BlockStride = (u32)AlignPow2((uptr)BlockSize, (uptr)Alignment);
+
+	// NOTE(ivan): Claim a magazine slot, if there is any left.
+	MemoryPool->Id = AtomicIncrementU32(&NextConcurrentMemoryPoolId) + 1;
+	MemoryPool->Slot = -1;
+	for (s32 Slot = 0; Slot < MAX_CONCURRENT_MEMORY_POOLS; Slot++) {
+		if (AtomicCompareExchangeU64(&ConcurrentMemoryPoolSlots[Slot], (u64)(uptr)MemoryPool, 0) == 0) {
+			MemoryPool->Slot = Slot;
+			break;
+		}
+	}
+	if (MemoryPool->Slot == -1)
+		PlatformAPI->Log(PlatformState, "ConcurrentMemoryPool[%s]: No magazine slots left, thread caches are disabled!", DebugName);
+
+	// NOTE(ivan): Allocate first chunk.
+	if (!GrowConcurrentMemoryPool(PlatformAPI, MemoryPool)) {
+		LeaveTicketMutex(&MemoryPool->GrowMutex);
+		PlatformAPI->Log(PlatformState, "ConcurrentMemoryPool[%s]: Out of memory!", DebugName);
+		return;
+	}
+
+	LeaveTicketMutex(&MemoryPool->GrowMutex);
+}
+
+void
+FreeConcurrentMemoryPool(platform_api *PlatformAPI,
+						 concurrent_memory_pool *MemoryPool)
+{
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+
+	EnterTicketMutex(&MemoryPool->GrowMutex);
+
+	uptr BytesReserved = 0;
+	concurrent_memory_pool_chunk *Chunk = MemoryPool->Chunks;
+	while (Chunk) {
+		concurrent_memory_pool_chunk *ChunkToDelete = Chunk;
+		Chunk = Chunk->Next;
+
+		BytesReserved += sizeof(concurrent_memory_pool_chunk) + (uptr)ChunkToDelete->NumBlocks * MemoryPool->BlockStride + MemoryPool->Alignment - 1;
+		PlatformAPI->DeallocateMemory(ChunkToDelete->Memory);
+		PlatformAPI->DeallocateMemory(ChunkToDelete);
+	}
+
+	if (MemoryPool->Stats) {
+		SubMemoryStatsUsed(MemoryPool->Stats, MemoryPool->BytesHandedOut);
+		AtomicAddU64(&MemoryPool->Stats->BytesReserved, (u64)0 - BytesReserved);
+		ReleaseMemoryStats(MemoryPool->Stats);
+		MemoryPool->Stats = 0;
+	}
+
+	MemoryPool->Chunks = 0;
+	MemoryPool->FreeHead = 0;
+	MemoryPool->NumBlocks = 0;
+
+	// NOTE(ivan): Give the magazine slot back, magazines left in other threads are dropped lazily.
+	if (MemoryPool->Slot != -1) {
+		ConcurrentMemoryPoolSlots[MemoryPool->Slot] = 0;
+		MemoryPool->Slot = -1;
+	}
+
+	LeaveTicketMutex(&MemoryPool->GrowMutex);
+}
+
+// NOTE(ivan): Blocks leaving or entering the shared free list, magazines count as used.
+inline void
+AddConcurrentPoolBytesUsed(concurrent_memory_pool *MemoryPool, u32 NumBlocks)
+{
+	uptr Bytes = (uptr)NumBlocks * MemoryPool->BlockSize;
+	AtomicAddU64(&MemoryPool->BytesHandedOut, Bytes);
+	if (MemoryPool->Stats)
+		AddMemoryStatsUsed(MemoryPool->Stats, Bytes);
+}
+
+inline void
+SubConcurrentPoolBytesUsed(concurrent_memory_pool *MemoryPool, u32 NumBlocks)
+{
+	uptr Bytes = (uptr)NumBlocks * MemoryPool->BlockSize;
+	AtomicAddU64(&MemoryPool->BytesHandedOut, (u64)0 - Bytes);
+	if (MemoryPool->Stats)
+		SubMemoryStatsUsed(MemoryPool->Stats, Bytes);
+}
+
+// NOTE(ivan): Returns calling thread's magazine for given pool, or zero if the pool has none.
+inline concurrent_memory_pool_magazine *
+GetConcurrentPoolMagazine(concurrent_memory_pool *MemoryPool)
+{
+	if (MemoryPool->Slot == -1)
+		return 0;
+
+	concurrent_memory_pool_magazine *Magazine = &ConcurrentMemoryPoolMagazines[MemoryPool->Slot];
+	if (Magazine->PoolId != MemoryPool->Id) {
+		// NOTE(ivan): Leftovers of a pool that occupied this slot before, its memory is gone already.
+		Magazine->PoolId = MemoryPool->Id;
+		Magazine->NumBlocks = 0;
+	}
+
+	return Magazine;
+}
+
+void *
+PushConcurrentPoolSize(platform_state *PlatformState,
+					   platform_api *PlatformAPI,
+					   concurrent_memory_pool *MemoryPool)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(MemoryPool);
+
+	void *Result = 0;
+
+	concurrent_memory_pool_magazine *Magazine = GetConcurrentPoolMagazine(MemoryPool);
+	if (Magazine) {
+		// NOTE(ivan): Refill half of an empty magazine from the shared free list.
+		if (!Magazine->NumBlocks) {
+			while (Magazine->NumBlocks < (CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE / 2)) {
+				void *Block = PopConcurrentPoolBlock(MemoryPool);
+				if (!Block)
+					break;
+				Magazine->Blocks[Magazine->NumBlocks++] = Block;
+			}
+			if (Magazine->NumBlocks)
+				AddConcurrentPoolBytesUsed(MemoryPool, Magazine->NumBlocks);
+		}
+
+		if (Magazine->NumBlocks)
+			Result = Magazine->Blocks[--Magazine->NumBlocks];
+	} else {
+		Result = PopConcurrentPoolBlock(MemoryPool);
+		if (Result)
+			AddConcurrentPoolBytesUsed(MemoryPool, 1);
+	}
+
+	while (!Result) {
+		EnterTicketMutex(&MemoryPool->GrowMutex);
+
+		// NOTE(ivan): Someone else might have grown the pool while we were waiting.
+		Result = PopConcurrentPoolBlock(MemoryPool);
+		if (Result) {
+			AddConcurrentPoolBytesUsed(MemoryPool, 1);
+		} else {
+			if (!IsWithinMemoryBudget(MemoryPool->Stats, (uptr)MemoryPool->NextChunkBlocks * MemoryPool->BlockStride)) {
+				LeaveTicketMutex(&MemoryPool->GrowMutex);
+				PlatformAPI->Log(PlatformState, "ConcurrentMemoryPool[%s]: Over budget!", MemoryPool->DebugName);
+				return 0;
+			}
+
+			if (!GrowConcurrentMemoryPool(PlatformAPI, MemoryPool)) {
+				LeaveTicketMutex(&MemoryPool->GrowMutex);
+				PlatformAPI->Log(PlatformState, "ConcurrentMemoryPool[%s]: Out of memory!", MemoryPool->DebugName);
+				return 0;
+			}
+		}
+
+		LeaveTicketMutex(&MemoryPool->GrowMutex);
+	}
+
+	// NOTE(ivan): Blocks come zeroed just like AllocateMemory() results, reused ones included.
+	memset(Result, 0, MemoryPool->BlockSize);
+	return Result;
+}
+
+void
+FreeConcurrentPoolSize(concurrent_memory_pool *MemoryPool,
+					   void *Address)
+{
+	Assert(MemoryPool);
+
+	if (!Address)
+		return;
+
+	concurrent_memory_pool_magazine *Magazine = GetConcurrentPoolMagazine(MemoryPool);
+	if (!Magazine) {
+		PushConcurrentPoolChain(MemoryPool, Address, Address);
+		SubConcurrentPoolBytesUsed(MemoryPool, 1);
+		return;
+	}
+
+	// NOTE(ivan): Flush half of a full magazine back to the shared free list in one go.
+	if (Magazine->NumBlocks == CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE) {
+		u32 FirstIndex = CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE / 2;
+		for (u32 Index = FirstIndex; Index < (CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE - 1); Index++)
+			SetMemoryPoolNextFree(Magazine->Blocks[Index], Magazine->Blocks[Index + 1]);
+		PushConcurrentPoolChain(MemoryPool, Magazine->Blocks[FirstIndex], Magazine->Blocks[CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE - 1]);
+		SubConcurrentPoolBytesUsed(MemoryPool, CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE - FirstIndex);
+
+		Magazine->NumBlocks = FirstIndex;
+	}
+
+	Magazine->Blocks[Magazine->NumBlocks++] = Address;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Slot map.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Moves all arrays to new ones of given capacity.
+static b32
+ResizeSlotMap(platform_state *PlatformState,
+			  platform_api *PlatformAPI,
+			  slot_map *SlotMap,
+			  u32 MaxItems)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(SlotMap);
+	Assert(MaxItems >= SlotMap->NumSlots);
+
+	u8 *Items = (u8 *)AllocateTrackedMemory(PlatformState, PlatformAPI, SlotMap->DebugName, (uptr)MaxItems * SlotMap->ItemSize);
+	u32 *ItemSlots = (u32 *)AllocateTrackedMemory(PlatformState, PlatformAPI, SlotMap->DebugName, sizeof(u32) * MaxItems);
+	slot_map_slot *Slots = (slot_map_slot *)AllocateTrackedMemory(PlatformState, PlatformAPI, SlotMap->DebugName, sizeof(slot_map_slot) * MaxItems);
+	if (!Items || !ItemSlots || !Slots) {
+		DeallocateTrackedMemory(PlatformAPI, Items);
+		DeallocateTrackedMemory(PlatformAPI, ItemSlots);
+		DeallocateTrackedMemory(PlatformAPI, Slots);
+		return false;
+	}
+
+	if (SlotMap->Items) {
+		memcpy(Items, SlotMap->Items, (uptr)SlotMap->NumItems * SlotMap->ItemSize);
+		memcpy(ItemSlots, SlotMap->ItemSlots, sizeof(u32) * SlotMap->NumItems);
+		memcpy(Slots, SlotMap->Slots, sizeof(slot_map_slot) * SlotMap->NumSlots);
+
+		DeallocateTrackedMemory(PlatformAPI, SlotMap->Items);
+		DeallocateTrackedMemory(PlatformAPI, SlotMap->ItemSlots);
+		DeallocateTrackedMemory(PlatformAPI, SlotMap->Slots);
+	}
+
+	SlotMap->Items = Items;
+	SlotMap->ItemSlots = ItemSlots;
+	SlotMap->Slots = Slots;
+	SlotMap->MaxItems = MaxItems;
+
+	return true;
+}
+
+b32
+InitializeSlotMap(platform_state *PlatformState,
+				  platform_api *PlatformAPI,
+				  slot_map *SlotMap,
+				  const char *DebugName,
+				  u32 ItemSize,
+				  u32 InitialItemsCount)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(SlotMap);
+	Assert(DebugName);
+	Assert(ItemSize);
+	Assert(InitialItemsCount);
+
+	SlotMap->DebugName = DebugName;
+	SlotMap->ItemSize = (u32)AlignPow2((uptr)ItemSize, (uptr)DEFAULT_MEMORY_ALIGNMENT);
+	SlotMap->NumItems = 0;
+	SlotMap->MaxItems = 0;
+	SlotMap->NumSlots = 0;
+	SlotMap->FirstFreeSlot = SLOT_MAP_NO_SLOT;
+	SlotMap->Items = 0;
+	SlotMap->ItemSlots = 0;
+	SlotMap->Slots = 0;
+
+	if (!ResizeSlotMap(PlatformState, PlatformAPI, SlotMap, InitialItemsCount)) {
+		PlatformAPI->Log(PlatformState, "SlotMap[%s]: Out of memory!", DebugName);
+		return false;
+	}
+
+	return true;
+}
+
+void
+FreeSlotMap(platform_api *PlatformAPI,
+			slot_map *SlotMap)
+{
+	Assert(PlatformAPI);
+	Assert(SlotMap);
+
+	DeallocateTrackedMemory(PlatformAPI, SlotMap->Items);
+	DeallocateTrackedMemory(PlatformAPI, SlotMap->ItemSlots);
+	DeallocateTrackedMemory(PlatformAPI, SlotMap->Slots);
+
+	SlotMap->Items = 0;
+	SlotMap->ItemSlots = 0;
+	SlotMap->Slots = 0;
+	SlotMap->NumItems = 0;
+	SlotMap->MaxItems = 0;
+	SlotMap->NumSlots = 0;
+	SlotMap->FirstFreeSlot = SLOT_MAP_NO_SLOT;
+}
+
+void *
+InsertSlotMapItem(platform_state *PlatformState,
+				  platform_api *PlatformAPI,
+				  slot_map *SlotMap,
+				  slot_map_handle *Handle)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(SlotMap);
+	Assert(Handle);
+
+	// NOTE(ivan): Reuse a free slot first, new slots are only needed while the map is at its largest.
+	u32 SlotIndex = SlotMap->FirstFreeSlot;
+	if (SlotIndex == SLOT_MAP_NO_SLOT) {
+		if (SlotMap->NumSlots == SlotMap->MaxItems) {
+			u32 MaxItems = SlotMap->MaxItems ? SlotMap->MaxItems * 2 : 16;
+			if (!ResizeSlotMap(PlatformState, PlatformAPI, SlotMap, MaxItems)) {
+				PlatformAPI->Log(PlatformState, "SlotMap[%s]: Out of memory!", SlotMap->DebugName);
+				return 0;
+			}
+		}
+
+		SlotIndex = SlotMap->NumSlots++;
+		SlotMap->Slots[SlotIndex].Generation = 1;
+	} else {
+		SlotMap->FirstFreeSlot = SlotMap->Slots[SlotIndex].DenseIndex;
+	}
+
+	u32 DenseIndex = SlotMap->NumItems++;
+	SlotMap->Slots[SlotIndex].DenseIndex = DenseIndex;
+	SlotMap->ItemSlots[DenseIndex] = SlotIndex;
+
+	Handle->Index = SlotIndex;
+	Handle->Generation = SlotMap->Slots[SlotIndex].Generation;
+
+	void *Result = SlotMap->Items + (uptr)DenseIndex * SlotMap->ItemSize;
+	memset(Result, 0, SlotMap->ItemSize);
+	return Result;
+}
+
+b32
+RemoveSlotMapItem(slot_map *SlotMap,
+				  slot_map_handle Handle)
+{
+	Assert(SlotMap);
+
+	if (!GetSlotMapItem(SlotMap, Handle))
+		return false;
+
+	slot_map_slot *Slot = SlotMap->Slots + Handle.Index;
+	u32 DenseIndex = Slot->DenseIndex;
+	u32 LastIndex = --SlotMap->NumItems;
+
+	// NOTE(ivan): Fill the hole with the last item to keep items packed.
+	if (DenseIndex != LastIndex) {
+		memcpy(SlotMap->Items + (uptr)DenseIndex * SlotMap->ItemSize,
+			   SlotMap->Items + (uptr)LastIndex * SlotMap->ItemSize,
+			   SlotMap->ItemSize);
+
+		u32 MovedSlotIndex = SlotMap->ItemSlots[LastIndex];
+		SlotMap->ItemSlots[DenseIndex] = MovedSlotIndex;
+		SlotMap->Slots[MovedSlotIndex].DenseIndex = DenseIndex;
+	}
+
+	Slot->Generation++;
+	if (!Slot->Generation)
+		Slot->Generation = 1; // NOTE(ivan): Zero is reserved for null handles.
+	Slot->DenseIndex = SlotMap->FirstFreeSlot;
+	SlotMap->FirstFreeSlot = Handle.Index;
+
+	return true;
 }
@@ -3,6 +3,151 @@
 
 #include "game_platform.h"
 
+// NOTE(ivan): Allocations alignment, default one is enough for aligned SSE loads,
+// maximal one allows cache-line isolated data.
+#define DEFAULT_MEMORY_ALIGNMENT 16
+#define MAX_MEMORY_ALIGNMENT 64
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Memory statistics.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Maximal number of distinct allocator debug names tracked.
+#define MAX_MEMORY_STATS 64
+
+enum memory_stats_type {
+	MemoryStatsType_Stack,
+	MemoryStatsType_Pool,
+	MemoryStatsType_ConcurrentPool,
+	MemoryStatsType_Tracked
+};
+
+// NOTE(ivan): Allocator statistics, keyed by DebugName: all allocators sharing a name,
+// e.g. every thread's scratch stack, add up into a single entry.
+// NOTE(ivan): Entries live in a global table, so allocators copied around by value keep reporting properly.
+// NOTE(ivan): Concurrent pools count blocks sitting in per-thread magazines as used, and do not count allocations.
+struct memory_stats {
+	char DebugName[64];
+	memory_stats_type Type;
+	u32 NumAllocators; // NOTE(ivan): Allocators currently initialized with this name.
+
+	volatile u64 BytesReserved; // NOTE(ivan): Obtained from the platform layer and not given back yet.
+	volatile u64 BytesUsed; // NOTE(ivan): Handed out to callers, alignment padding included.
+	volatile u64 HighWaterMark; // NOTE(ivan): Peak of BytesUsed.
+	volatile u64 BlocksAllocated; // NOTE(ivan): Stack blocks or pool chunks obtained from the platform layer so far.
+	volatile u64 Allocations; // NOTE(ivan): Pushes since the current stats frame has begun.
+	u64 AllocationsLastFrame;
+
+	volatile u64 BudgetBytes; // NOTE(ivan): Limit for BytesReserved, zero if unlimited.
+	volatile u64 BudgetFailures; // NOTE(ivan): Allocations refused since the last pressure check.
+};
+
+// NOTE(ivan): Used bytes accounting, also keeps the high-water mark.
+inline void
+AddMemoryStatsUsed(memory_stats *Stats, u64 Bytes)
+{
+	u64 BytesUsed = AtomicAddU64(&Stats->BytesUsed, Bytes) + Bytes;
+
+	u64 HighWaterMark = Stats->HighWaterMark;
+	while (BytesUsed > HighWaterMark) {
+		u64 Original = AtomicCompareExchangeU64(&Stats->HighWaterMark, BytesUsed, HighWaterMark);
+		if (Original == HighWaterMark)
+			break;
+		HighWaterMark = Original;
+	}
+}
+
+inline void
+SubMemoryStatsUsed(memory_stats *Stats, u64 Bytes)
+{
+	AtomicAddU64(&Stats->BytesUsed, (u64)0 - Bytes);
+}
+
+// NOTE(ivan): Copies up to MaxCount entries to Stats, returns number of entries copied.
+#define GET_ALL_MEMORY_STATS(name) u32 name(memory_stats *Stats, u32 MaxCount)
+typedef GET_ALL_MEMORY_STATS(get_all_memory_stats);
+
+// NOTE(ivan): Copies the entry of given DebugName to Stats, returns false if there is none.
+#define FIND_MEMORY_STATS(name) b32 name(const char *DebugName, memory_stats *Stats)
+typedef FIND_MEMORY_STATS(find_memory_stats);
+
+#define DUMP_MEMORY_STATS(name) void name(platform_state *PlatformState, platform_api *PlatformAPI)
+typedef DUMP_MEMORY_STATS(dump_memory_stats);
+
+GET_ALL_MEMORY_STATS(GetAllMemoryStats);
+FIND_MEMORY_STATS(FindMemoryStats);
+DUMP_MEMORY_STATS(DumpMemoryStats);
+
+// NOTE(ivan): Moves per-frame counters to their last frame values, call once per frame.
+void EndMemoryStatsFrame(void);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Memory budgets and pressure.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Budgets are checked whenever an allocator is about to obtain more memory from the platform layer,
+// pushes served from memory already reserved are never refused. Racing threads may overshoot by a block each.
+// NOTE(ivan): Budget of zero means unlimited, entry is created if no allocator uses DebugName yet.
+#define SET_MEMORY_BUDGET(name) void name(const char *DebugName, u64 BudgetBytes)
+typedef SET_MEMORY_BUDGET(set_memory_budget);
+
+// NOTE(ivan): Fraction of a budget reserved that starts signaling low pressure.
+#define MEMORY_BUDGET_LOW_PERCENT 90
+
+// NOTE(ivan): How often the platform is asked for available memory, it is not free on every platform.
+#define MEMORY_PRESSURE_CHECK_SECONDS 0.25f
+
+#define MAX_MEMORY_PRESSURE_CALLBACKS 16
+
+enum memory_pressure_level {
+	MemoryPressureLevel_None,
+	MemoryPressureLevel_Low, // NOTE(ivan): Getting close to the limit, drop what is cheap to rebuild.
+	MemoryPressureLevel_Critical // NOTE(ivan): Allocations are failing or about to, drop everything possible.
+};
+
+// NOTE(ivan): DebugName is the budget in trouble, or zero if the whole system is running low on memory.
+// Callbacks are run from CheckMemoryPressure() only, never from inside allocators, so they are free to deallocate.
+#define MEMORY_PRESSURE_CALLBACK(name) void name(platform_state *PlatformState, platform_api *PlatformAPI, memory_pressure_level Level, const char *DebugName, void *Param)
+typedef MEMORY_PRESSURE_CALLBACK(memory_pressure_callback);
+
+// NOTE(ivan): Entities module callbacks MUST be unregistered before the module gets unloaded.
+#define REGISTER_MEMORY_PRESSURE_CALLBACK(name) b32 name(memory_pressure_callback *Callback, void *Param)
+typedef REGISTER_MEMORY_PRESSURE_CALLBACK(register_memory_pressure_callback);
+
+#define UNREGISTER_MEMORY_PRESSURE_CALLBACK(name) void name(memory_pressure_callback *Callback, void *Param)
+typedef UNREGISTER_MEMORY_PRESSURE_CALLBACK(unregister_memory_pressure_callback);
+
+SET_MEMORY_BUDGET(SetMemoryBudget);
+REGISTER_MEMORY_PRESSURE_CALLBACK(RegisterMemoryPressureCallback);
+UNREGISTER_MEMORY_PRESSURE_CALLBACK(UnregisterMemoryPressureCallback);
+
+// NOTE(ivan): Signals callbacks about budgets over MEMORY_BUDGET_LOW_PERCENT or refusing allocations,
+// and about system available memory under MinAvailableBytes (critical under half of it). Call once per frame.
+void CheckMemoryPressure(platform_state *PlatformState,
+						 platform_api *PlatformAPI,
+						 f32 SecondsElapsed,
+						 u64 MinAvailableBytes);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Tracked memory.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Header in front of every tracked allocation, keeps results 16-byte aligned.
+struct tracked_memory_header {
+	memory_stats *Stats;
+	uptr Bytes;
+};
+#define TRACKED_MEMORY_HEADER_BYTES 16
+
+// NOTE(ivan): Platform memory accounted and budgeted under DebugName, for buffers that fit neither stacks nor pools,
+// e.g. image pixels. Comes zeroed like AllocateMemory() results, returns zero if out of memory or over budget.
+void * AllocateTrackedMemory(platform_state *PlatformState,
+							 platform_api *PlatformAPI,
+							 const char *DebugName,
+							 uptr Bytes);
+void DeallocateTrackedMemory(platform_api *PlatformAPI,
+							 void *Memory);
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // NOTE(ivan): Memory stack.
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -12,20 +157,53 @@ struct memory_stack_block {
 	void *Base;
 
 	uptr BytesTotal;
-	uptr BytesUsed;
+	volatile uptr BytesUsed; // NOTE(ivan): Bumped with compare-exchange by shared stacks.
+	volatile uptr BytesCommitted; // NOTE(ivan): Virtual stacks only, the rest of BytesTotal is reserved but not accessible yet.
 
 	memory_stack_block *Next;
 	memory_stack_block *Prev;
 };
 
+// NOTE(ivan): Memory stack flags.
+enum memory_stack_flags {
+	MemoryStackFlag_ThreadLocal = (1 << 0), // NOTE(ivan): Owned by a single thread, never locked nor bumped atomically.
+	MemoryStackFlag_Virtual = (1 << 1), // NOTE(ivan): Single reserved block committed lazily, set by InitializeMemoryStackVirtual().
+	MemoryStackFlag_LargePages = (1 << 2) // NOTE(ivan): Virtual stacks only, ask for huge pages.
+};
+
+// NOTE(ivan): Virtual stacks commit memory in steps of this size.
+#define MEMORY_STACK_COMMIT_BYTES Kilobytes(256)
+
 // NOTE(ivan): Memory stack structure.
+// NOTE(ivan): Blocks form a doubly linked list starting at FirstBlock, pushes only bump CurrentBlock,
+// and blocks after CurrentBlock are spares kept around for reuse after reset.
+// NOTE(ivan): Shared stacks bump CurrentBlock lock-free, StackMutex is taken only to switch blocks.
 // NOTE(ivan): Must be ZEROED for proper functioning.
 struct memory_stack {
 	const char *DebugName;
+	memory_stats *Stats;
 	ticket_mutex StackMutex;
+	u32 Flags;
 
-	memory_stack_block *CurrentBlock;
+	memory_stack_block *FirstBlock;
+	memory_stack_block *volatile CurrentBlock;
 	uptr MinBlockBytes;
+
+	u32 TempCount; // NOTE(ivan): Number of open temporary memory markers.
+
+	uptr PaddingBytes; // NOTE(ivan): Bytes wasted on alignment since last reset.
+
+	// NOTE(ivan): Thread-local stacks only, pushes not folded into Stats yet. Folded on temporary memory end,
+	// reset, free and block switches, so scratch stacks of all threads do not fight over their shared stats.
+	uptr UnfoldedBytesUsed;
+	u64 UnfoldedAllocations;
+};
+
+// NOTE(ivan): Temporary memory marker, everything pushed after BeginTemporaryMemory() is popped by EndTemporaryMemory().
+struct temporary_memory {
+	memory_stack *Stack;
+	memory_stack_block *Block;
+	uptr BytesUsed;
 };
 
 void InitializeMemoryStack(platform_state *PlatformState,
@@ -33,70 +211,470 @@ void InitializeMemoryStack(platform_state *PlatformState,
 						   memory_stack *MemoryStack,
 						   const char *DebugName,
 						   uptr MinBlockBytes,
-						   uptr Bytes);
+						   uptr Bytes,
+						   u32 Flags = 0);
 void InitializeMemoryStackEmpty(memory_stack *MemoryStack,
 								const char *DebugName,
-								uptr MinBlockBytes);
+								uptr MinBlockBytes,
+								u32 Flags = 0);
+// NOTE(ivan): Reserves ReserveBytes of address space up front and commits it as pushes go,
+// so the stack never chains blocks and its memory addresses stay stable.
+b32 InitializeMemoryStackVirtual(platform_state *PlatformState,
+								 platform_api *PlatformAPI,
+								 memory_stack *MemoryStack,
+								 const char *DebugName,
+								 uptr ReserveBytes,
+								 u32 Flags = 0);
 void FreeMemoryStack(platform_api *PlatformAPI,
 					 memory_stack *MemoryStack);
 
+// NOTE(ivan): Pops everything but keeps all blocks for reuse, so a warmed-up stack never allocates again.
+void ResetMemoryStack(memory_stack *MemoryStack);
+
 #define PushStackType(PlatformState, PlatformAPI, MemoryStack, Type) (Type *)PushStackSize(PlatformState, PlatformAPI, MemoryStack, sizeof(Type))
 #define PushStackTypeArray(PlatformState, PlatformAPI, MemoryStack, Type, Count) (Type *)PushStackSize(PlatformState, PlatformAPI, MemoryStack, sizeof(Type) * Count)
+#define PushStackTypeAligned(PlatformState, PlatformAPI, MemoryStack, Type, Alignment) (Type *)PushStackSize(PlatformState, PlatformAPI, MemoryStack, sizeof(Type), Alignment)
+#define PushStackTypeArrayAligned(PlatformState, PlatformAPI, MemoryStack, Type, Count, Alignment) (Type *)PushStackSize(PlatformState, PlatformAPI, MemoryStack, sizeof(Type) * Count, Alignment)
 void * PushStackSize(platform_state *PlatformState,
 					 platform_api *PlatformAPI,
 					 memory_stack *MemoryStack,
-					 uptr Bytes);
+					 uptr Bytes,
+					 uptr Alignment = DEFAULT_MEMORY_ALIGNMENT);
+
+temporary_memory BeginTemporaryMemory(memory_stack *MemoryStack);
+void EndTemporaryMemory(temporary_memory TempMemory);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // NOTE(ivan): Memory pool.
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-// NOTE(ivan): Memory pool block.
-struct memory_pool_block {
-	struct memory_pool_chunk *Chunk;
+// NOTE(ivan): Default cap on the number of blocks a single pool chunk grows to.
+#define DEFAULT_MEMORY_POOL_MAX_CHUNK_BLOCKS 4096
 
-	memory_pool_block *Next;
-	memory_pool_block *Prev;
+// NOTE(ivan): Memory pool block header, placed right before the user data.
+// Holds owning chunk pointer, lowest bit is set while the block sits in the free list.
+// Free blocks keep the free list link in their first user data bytes.
+struct memory_pool_block {
+	uptr ChunkAndFreeBit;
 };
 
 // NOTE(ivan): Memory pool chunk.
 struct memory_pool_chunk {
 	u32 NumBlocks;
+	u32 NumFreeBlocks;
+	void *Memory; // NOTE(ivan): Raw allocation, Blocks is aligned inside of it.
 	void *Blocks;
-	memory_pool_block *FreeBlocks; // NOTE(ivan): Head pointer to free linked list.
-	memory_pool_block *AllocBlocks; // NOTE(ivan): Head pointer to allocated linked list.
 
 	memory_pool_chunk *Next;
 };
 
 // NOTE(ivan): Memory pool.
+// NOTE(ivan): All chunks share a single intrusive free list, so both push and free are O(1).
 // NOTE(ivan): Must be ZEROED for proper functioning.
 struct memory_pool {
 	const char *DebugName;
+	memory_stats *Stats;
 	ticket_mutex PoolMutex;
+
+	// NOTE(ivan): Each new chunk is DefaultMultiplier times larger than the previous one, up to MaxChunkBlocks.
 	u32 DefaultMultiplier;
+	u32 MaxChunkBlocks;
+	u32 NextChunkBlocks;
 	
 	memory_pool_chunk *Chunks;
+	void *FreeList; // NOTE(ivan): User data address of the first free block.
+	u32 NumBlocks;
+	u32 NumFreeBlocks;
 	u32 BlockSize;
+
+	// NOTE(ivan): Every block is BlockStride bytes, user data starts BlockHeaderBytes after the block start.
+	u32 Alignment;
+	u32 BlockHeaderBytes;
+	u32 BlockStride;
+
+	uptr PaddingBytes; // NOTE(ivan): Bytes wasted on alignment by all chunks.
 };
 
+inline memory_pool_block *
+GetMemoryPoolBlock(void *Address)
+{
+	return (memory_pool_block *)((u8 *)Address - sizeof(memory_pool_block));
+}
+
+inline memory_pool_chunk *
+GetMemoryPoolBlockChunk(memory_pool_block *Block)
+{
+	return (memory_pool_chunk *)(Block->ChunkAndFreeBit & ~(uptr)1);
+}
+
+// NOTE(ivan): Free list link lives in the first bytes of free block's user data.
+inline void *
+GetMemoryPoolNextFree(void *Address)
+{
+	return *(void **)Address;
+}
+
+inline void
+SetMemoryPoolNextFree(void *Address, void *NextFree)
+{
+	*(void **)Address = NextFree;
+}
+
+// NOTE(ivan): Takes the first free block, zero if there is none. Must be called with PoolMutex held.
+inline void *
+PopMemoryPoolFreeList(memory_pool *MemoryPool)
+{
+	void *Result = MemoryPool->FreeList;
+	if (!Result)
+		return 0;
+	
+	MemoryPool->FreeList = GetMemoryPoolNextFree(Result);
+
+	memory_pool_block *Block = GetMemoryPoolBlock(Result);
+	Assert(Block->ChunkAndFreeBit & 1);
+	Block->ChunkAndFreeBit &= ~(uptr)1;
+
+	GetMemoryPoolBlockChunk(Block)->NumFreeBlocks--;
+	MemoryPool->NumFreeBlocks--;
+	if (MemoryPool->Stats) {
+		AddMemoryStatsUsed(MemoryPool->Stats, MemoryPool->BlockSize);
+		AtomicIncrementU64(&MemoryPool->Stats->Allocations);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Must be called with PoolMutex held.
+inline void
+PushMemoryPoolFreeList(memory_pool *MemoryPool, void *Address)
+{
+	memory_pool_block *Block = GetMemoryPoolBlock(Address);
+	Assert(!(Block->ChunkAndFreeBit & 1)); // NOTE(ivan): Double free?
+
+	Block->ChunkAndFreeBit |= 1;
+	SetMemoryPoolNextFree(Address, MemoryPool->FreeList);
+	MemoryPool->FreeList = Address;
+
+	GetMemoryPoolBlockChunk(Block)->NumFreeBlocks++;
+	MemoryPool->NumFreeBlocks++;
+	if (MemoryPool->Stats)
+		SubMemoryStatsUsed(MemoryPool->Stats, MemoryPool->BlockSize);
+}
+
 void InitializeMemoryPool(platform_state *PlatformState,
 						  platform_api *PlatformAPI,
 						  memory_pool *MemoryPool,
 						  const char *DebugName,
 						  u32 BlockSize,
 						  u32 InitialBlocksCount,
-						  u32 DefaultMultiplier = 0);
+						  u32 DefaultMultiplier = 0,
+						  u32 Alignment = DEFAULT_MEMORY_ALIGNMENT,
+						  u32 MaxChunkBlocks = 0);
 void FreeMemoryPool(platform_api *PlatformAPI,
 					memory_pool *MemoryPool);
 
+// NOTE(ivan): Releases chunks that have no allocated blocks, except the first one.
+// Costs O(free blocks), so it is meant to be called rarely, e.g. under memory pressure.
+void TrimMemoryPool(platform_api *PlatformAPI,
+					memory_pool *MemoryPool);
+
+// NOTE(ivan): Pool blocks alignment is fixed by InitializeMemoryPool(), aligned variant only checks the pool satisfies it.
 #define PushPoolType(PlatformState, PlatformAPI, MemoryPool, Type) (Type *)PushPoolSize(PlatformState, PlatformAPI, MemoryPool)
+#define PushPoolTypeAligned(PlatformState, PlatformAPI, MemoryPool, Type, Alignment) (Type *)PushPoolSize(PlatformState, PlatformAPI, MemoryPool, Alignment)
 void * PushPoolSize(platform_state *PlatformState,
 					platform_api *PlatformAPI,
-					memory_pool *MemoryPool);
+					memory_pool *MemoryPool,
+					uptr Alignment = 0);
 
 #define FreePoolType(MemoryPool, Address) FreePoolSize(MemoryPool, Address)
 void FreePoolSize(memory_pool *MemoryPool,
 				  void *Address);
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Concurrent memory pool.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Maximal number of concurrent pools that may use per-thread magazines at once,
+// pools initialized past this limit still work, just without the thread caches.
+#define MAX_CONCURRENT_MEMORY_POOLS 16
+
+// NOTE(ivan): Number of blocks cached per thread per pool, half of them move at once on refill and flush.
+#define CONCURRENT_MEMORY_POOL_MAGAZINE_SIZE 32
+
+// NOTE(ivan): Free list head is a tagged pointer: low 48 bits are the address, high 16 bits are
+// a counter bumped on every change, which protects the compare-exchange from ABA.
+#define CONCURRENT_MEMORY_POOL_ADDRESS_BITS 48
+
+// NOTE(ivan): Concurrent memory pool chunk.
+struct concurrent_memory_pool_chunk {
+	u32 NumBlocks;
+	void *Memory; // NOTE(ivan): Raw allocation, blocks are aligned inside of it.
+
+	concurrent_memory_pool_chunk *Next;
+};
+
+// NOTE(ivan): Lock-free memory pool, safe to push and free from any thread.
+// NOTE(ivan): Blocks have no headers, free ones keep the free list link in their user data.
+// Chunks are never released before FreeConcurrentMemoryPool(), so reading a stale link is always safe.
+// NOTE(ivan): Blocks cached by a thread that exits stay unused until the pool is freed.
+// NOTE(ivan): GrowMutex is taken only when the free list runs dry and a new chunk is needed.
+// NOTE(ivan): Must be ZEROED for proper functioning.
+struct concurrent_memory_pool {
+	const char *DebugName;
+	memory_stats *Stats;
+	ticket_mutex GrowMutex;
+
+	u32 Id; // NOTE(ivan): Unique for every initialization, validates per-thread magazines.
+	s32 Slot; // NOTE(ivan): Index of per-thread magazine, -1 if none.
+
+	u32 DefaultMultiplier;
+	u32 MaxChunkBlocks;
+	u32 NextChunkBlocks;
+
+	volatile u64 FreeHead;
+	volatile u64 BytesHandedOut; // NOTE(ivan): Out of the shared free list, magazines included.
+	concurrent_memory_pool_chunk *Chunks;
+	u32 NumBlocks;
+
+	u32 BlockSize;
+	u32 Alignment;
+	u32 BlockStride;
+};
+
+void InitializeConcurrentMemoryPool(platform_state *PlatformState,
+									platform_api *PlatformAPI,
+									concurrent_memory_pool *MemoryPool,
+									const char *DebugName,
+									u32 BlockSize,
+									u32 InitialBlocksCount,
+									u32 DefaultMultiplier = 0,
+									u32 Alignment = DEFAULT_MEMORY_ALIGNMENT,
+									u32 MaxChunkBlocks = 0);
+// NOTE(ivan): No other thread may use the pool anymore when it is freed.
+void FreeConcurrentMemoryPool(platform_api *PlatformAPI,
+							  concurrent_memory_pool *MemoryPool);
+
+#define PushConcurrentPoolType(PlatformState, PlatformAPI, MemoryPool, Type) (Type *)PushConcurrentPoolSize(PlatformState, PlatformAPI, MemoryPool)
+void * PushConcurrentPoolSize(platform_state *PlatformState,
+							  platform_api *PlatformAPI,
+							  concurrent_memory_pool *MemoryPool);
+
+#define FreeConcurrentPoolType(MemoryPool, Address) FreeConcurrentPoolSize(MemoryPool, Address)
+void FreeConcurrentPoolSize(concurrent_memory_pool *MemoryPool,
+							void *Address);
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Slot map.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Stable reference into a slot map, goes stale once its item is removed.
+// Generations start from one, so a zeroed handle never refers to anything.
+struct slot_map_handle {
+	u32 Index;
+	u32 Generation;
+};
+
+inline b32
+IsSlotMapHandleNull(slot_map_handle Handle)
+{
+	return Handle.Generation == 0;
+}
+
+struct slot_map_slot {
+	u32 Generation; // NOTE(ivan): Bumped on every removal, so old handles stop matching.
+	u32 DenseIndex; // NOTE(ivan): Index of the item if alive, next free slot otherwise.
+};
+
+// NOTE(ivan): Items are packed densely in insertion order, with removal moving the last item into the hole.
+// Handles go through the sparse slots array, so insert, remove and lookup are all O(1),
+// while iteration walks a single contiguous array.
+// NOTE(ivan): Not synchronized. Item addresses change on any insert or remove, keep handles, not pointers.
+struct slot_map {
+	const char *DebugName;
+
+	u32 ItemSize;
+	u32 NumItems;
+	u32 MaxItems;
+	u32 NumSlots;
+	u32 FirstFreeSlot; // NOTE(ivan): SLOT_MAP_NO_SLOT if none.
+
+	u8 *Items;
+	u32 *ItemSlots; // NOTE(ivan): Dense index to slot index.
+	slot_map_slot *Slots;
+};
+
+#define SLOT_MAP_NO_SLOT 0xFFFFFFFF
+
+// NOTE(ivan): Arrays are tracked memory under DebugName, so they respect its budget.
+b32 InitializeSlotMap(platform_state *PlatformState,
+					  platform_api *PlatformAPI,
+					  slot_map *SlotMap,
+					  const char *DebugName,
+					  u32 ItemSize,
+					  u32 InitialItemsCount);
+void FreeSlotMap(platform_api *PlatformAPI,
+				 slot_map *SlotMap);
+
+// NOTE(ivan): Returns zeroed item and its handle, or zero if out of memory.
+void * InsertSlotMapItem(platform_state *PlatformState,
+						 platform_api *PlatformAPI,
+						 slot_map *SlotMap,
+						 slot_map_handle *Handle);
+
+// NOTE(ivan): Returns false if the handle is stale.
+b32 RemoveSlotMapItem(slot_map *SlotMap,
+					  slot_map_handle Handle);
+
+// NOTE(ivan): Returns zero if the handle is stale.
+inline void *
+GetSlotMapItem(slot_map *SlotMap, slot_map_handle Handle)
+{
+	if (Handle.Index >= SlotMap->NumSlots)
+		return 0;
+
+	slot_map_slot *Slot = SlotMap->Slots + Handle.Index;
+	if (Slot->Generation != Handle.Generation)
+		return 0;
+
+	return SlotMap->Items + (uptr)Slot->DenseIndex * SlotMap->ItemSize;
+}
+
+// NOTE(ivan): Dense iteration, Index goes from zero to NumItems. Removing while iterating
+// is fine when walking backwards: only already visited items get moved.
+inline void *
+GetSlotMapItemAt(slot_map *SlotMap, u32 Index)
+{
+	Assert(Index < SlotMap->NumItems);
+	return SlotMap->Items + (uptr)Index * SlotMap->ItemSize;
+}
+
+inline slot_map_handle
+GetSlotMapHandleAt(slot_map *SlotMap, u32 Index)
+{
+	Assert(Index < SlotMap->NumItems);
+
+	slot_map_handle Result;
+	Result.Index = SlotMap->ItemSlots[Index];
+	Result.Generation = SlotMap->Slots[Result.Index].Generation;
+
+	return Result;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// NOTE(ivan): Typed allocators.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ivan): Alignment typed allocators use, never below the default one.
+#define TypedAlignment(Type) (alignof(Type) > DEFAULT_MEMORY_ALIGNMENT ? alignof(Type) : DEFAULT_MEMORY_ALIGNMENT)
+
+// NOTE(ivan): Memory pool of T with block size and alignment known at compile time, growing by fixed
+// ChunkCount blocks. Push inlines down to a free list pop and a constant-size clear, falling back
+// to PushPoolSize() only to grow. Platform pointers are kept, so call sites do not carry them.
+template <typename T, u32 ChunkCount = 64>
+struct typed_pool {
+	memory_pool Pool;
+	platform_state *PlatformState;
+	platform_api *PlatformAPI;
+};
+
+template <typename T, u32 ChunkCount> inline void
+InitializeTypedPool(platform_state *PlatformState,
+					platform_api *PlatformAPI,
+					typed_pool<T, ChunkCount> *TypedPool,
+					const char *DebugName)
+{
+	Assert(TypedPool);
+
+	TypedPool->PlatformState = PlatformState;
+	TypedPool->PlatformAPI = PlatformAPI;
+
+	// NOTE(ivan): Free blocks hold the free list link, so they are never smaller than a pointer.
+	InitializeMemoryPool(PlatformState,
+						 PlatformAPI,
+						 &TypedPool->Pool,
+						 DebugName,
+						 sizeof(T) < sizeof(void *) ? sizeof(void *) : sizeof(T),
+						 ChunkCount,
+						 0,
+						 TypedAlignment(T),
+						 ChunkCount);
+}
+
+template <typename T, u32 ChunkCount> inline void
+FreeTypedPool(typed_pool<T, ChunkCount> *TypedPool)
+{
+	Assert(TypedPool);
+	FreeMemoryPool(TypedPool->PlatformAPI, &TypedPool->Pool);
+}
+
+// NOTE(ivan): Comes zeroed, returns zero if out of memory.
+template <typename T, u32 ChunkCount> inline T *
+PushTypedPoolItem(typed_pool<T, ChunkCount> *TypedPool)
+{
+	Assert(TypedPool);
+
+	EnterTicketMutex(&TypedPool->Pool.PoolMutex);
+	void *Result = PopMemoryPoolFreeList(&TypedPool->Pool);
+	LeaveTicketMutex(&TypedPool->Pool.PoolMutex);
+
+	if (!Result)
+		return (T *)PushPoolSize(TypedPool->PlatformState, TypedPool->PlatformAPI, &TypedPool->Pool, TypedAlignment(T));
+
+	memset(Result, 0, sizeof(T));
+	return (T *)Result;
+}
+
+template <typename T, u32 ChunkCount> inline void
+FreeTypedPoolItem(typed_pool<T, ChunkCount> *TypedPool, T *Address)
+{
+	Assert(TypedPool);
+
+	if (!Address)
+		return;
+
+	EnterTicketMutex(&TypedPool->Pool.PoolMutex);
+	PushMemoryPoolFreeList(&TypedPool->Pool, Address);
+	LeaveTicketMutex(&TypedPool->Pool.PoolMutex);
+}
+
+// NOTE(ivan): Fixed capacity array of T pushed from a memory stack, lives as long as the stack keeps it.
+// Not synchronized.
+template <typename T>
+struct arena_array {
+	T *Items;
+	u32 Count;
+	u32 MaxCount;
+};
+
+template <typename T> inline b32
+InitializeArenaArray(platform_state *PlatformState,
+					 platform_api *PlatformAPI,
+					 memory_stack *MemoryStack,
+					 arena_array<T> *Array,
+					 u32 MaxCount)
+{
+	Assert(Array);
+	Assert(MaxCount);
+
+	Array->Items = (T *)PushStackSize(PlatformState, PlatformAPI, MemoryStack, sizeof(T) * MaxCount, TypedAlignment(T));
+	Array->Count = 0;
+	Array->MaxCount = Array->Items ? MaxCount : 0;
+
+	return Array->Items != 0;
+}
+
+// NOTE(ivan): Appends Count items, returns zero if they do not fit. Contents are not cleared, just like stack pushes.
+template <typename T> inline T *
+PushArenaArray(arena_array<T> *Array, u32 Count = 1)
+{
+	Assert(Array);
+
+	if ((Array->MaxCount - Array->Count) < Count)
+		return 0;
+
+	T *Result = Array->Items + Array->Count;
+	Array->Count += Count;
+	return Result;
+}
+
 #endif // #ifndef GAME_MEMORY_H
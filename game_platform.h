@@ -26,6 +26,11 @@
 #elif GNUC
 #include <x86intrin.h>
 #endif
+#if LINUX
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 // NOTE(ivan): Base integer types.
 typedef uint8_t u8;
@@ -181,6 +186,31 @@ struct work_queue;
 #define WORK_QUEUE_CALLBACK(name) void name(work_queue *Queue, void *Data)
 typedef WORK_QUEUE_CALLBACK(work_queue_callback);
 
+// NOTE(ivan): Work group, counts entries added with it that are not done yet,
+// so one batch can be waited for while others keep running on the same queue.
+// NOTE(ivan): Any instance of this structure MUST be ZERO-initialized, and may be reused once done.
+// NOTE(ivan): Only one thread or fiber may wait for a group at a time.
+#define WORK_GROUP_WAITING 0x80000000 // NOTE(ivan): A thread sleeps on State.
+#define WORK_GROUP_FIBER_WAITING 0x40000000 // NOTE(ivan): Fiber is suspended till the last entry is done.
+#define WORK_GROUP_PENDING_MASK 0x3FFFFFFF
+struct work_fiber;
+struct work_queue_entry;
+struct work_group {
+	volatile u32 State; // NOTE(ivan): Number of pending entries and WORK_GROUP_*WAITING flags.
+	work_fiber *Fiber; // NOTE(ivan): Suspended fiber to resume, valid while WORK_GROUP_FIBER_WAITING is set.
+};
+
+inline b32
+IsWorkGroupDone(work_group *Group)
+{
+	Assert(Group);
+	return !(Group->State & WORK_GROUP_PENDING_MASK);
+}
+
+// NOTE(ivan): Parallel-for callback, does items [First, OnePastLast).
+#define PARALLEL_FOR_CALLBACK(name) void name(void *Data, u32 First, u32 OnePastLast)
+typedef PARALLEL_FOR_CALLBACK(parallel_for_callback);
+
 // NOTE(ivan): Generic-purpose structure for holding a memory piece of information.
 struct piece {
 	u8 *Memory;
@@ -190,6 +220,9 @@ struct piece {
 // NOTE(ivan): Platform-specific state structure.
 struct platform_state;
 
+// NOTE(ivan): Memory stack structure prototype, see game_memory.h.
+struct memory_stack;
+
 // NOTE(ivan): Platform-specific memory stats structure.
 struct platform_memory_stats {
 	u64 BytesTotal;
@@ -218,12 +251,82 @@ typedef PLATFORM_DEALLOCATE_MEMORY(platform_deallocate_memory);
 #define PLATFORM_GET_MEMORY_STATS(name) platform_memory_stats name(void)
 typedef PLATFORM_GET_MEMORY_STATS(platform_get_memory_stats);
 
-#define PLATFORM_ADD_WORK_QUEUE_ENTRY(name) void name(work_queue *Queue, work_queue_callback *Callback, void *Data)
+// NOTE(ivan): Virtual memory flags.
+enum platform_memory_flags {
+	PlatformMemoryFlag_LargePages = (1 << 0) // NOTE(ivan): Back with huge pages where the platform allows it, a hint only.
+};
+
+// NOTE(ivan): Granularity that reserved memory is committed with, addresses and sizes passed to commit/decommit must be aligned to it.
+#define PLATFORM_MEMORY_PAGE_BYTES Kilobytes(64)
+
+// NOTE(ivan): Reserves address space only, no physical memory is used until committed. Returns zero on failure.
+#define PLATFORM_RESERVE_MEMORY(name) void * name(uptr Bytes, u32 Flags)
+typedef PLATFORM_RESERVE_MEMORY(platform_reserve_memory);
+
+// NOTE(ivan): Makes reserved pages accessible, freshly committed pages are zeroed.
+#define PLATFORM_COMMIT_MEMORY(name) b32 name(void *Address, uptr Bytes)
+typedef PLATFORM_COMMIT_MEMORY(platform_commit_memory);
+
+// NOTE(ivan): Gives physical pages back to the system, but keeps address space reserved.
+#define PLATFORM_DECOMMIT_MEMORY(name) void name(void *Address, uptr Bytes)
+typedef PLATFORM_DECOMMIT_MEMORY(platform_decommit_memory);
+
+// NOTE(ivan): Releases the whole reservation, Bytes MUST match the reserved size.
+#define PLATFORM_RELEASE_MEMORY(name) void name(void *Address, uptr Bytes)
+typedef PLATFORM_RELEASE_MEMORY(platform_release_memory);
+
+// NOTE(ivan): Returns calling thread's own scratch memory stack, it is never locked, so never share it with other threads.
+// Work queue threads get theirs on startup, others - on first call.
+#define PLATFORM_GET_THREAD_SCRATCH(name) memory_stack * name(void)
+typedef PLATFORM_GET_THREAD_SCRATCH(platform_get_thread_scratch);
+
+// NOTE(ivan): Group is optional, the entry is counted in it until done.
+#define PLATFORM_ADD_WORK_QUEUE_ENTRY(name) void name(work_queue *Queue, work_queue_callback *Callback, void *Data, work_group *Group)
 typedef PLATFORM_ADD_WORK_QUEUE_ENTRY(platform_add_work_queue_entry);
 
+// NOTE(ivan): Same as above, but the entry runs on a fiber when a worker picks it up,
+// so waiting for work groups inside of it suspends the fiber and the worker goes on with other entries.
+// Fiber stacks come from a fixed per-queue pool, entries run directly on the thread once it is exhausted.
+// NOTE(ivan): A suspended fiber may be resumed on another worker thread, so thread scratch temporary memory
+// and anything else thread-local must not be held across a wait.
+#define PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(name) void name(work_queue *Queue, work_queue_callback *Callback, void *Data, work_group *Group)
+typedef PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(platform_add_fiber_work_queue_entry);
+
+// NOTE(ivan): Adds a batch of entries at the cost of a single wake-up, entries' groups are counted as above.
+#define PLATFORM_ADD_WORK_QUEUE_ENTRIES(name) void name(work_queue *Queue, work_queue_entry *Entries, u32 Count)
+typedef PLATFORM_ADD_WORK_QUEUE_ENTRIES(platform_add_work_queue_entries);
+
+// NOTE(ivan): Background work priority classes.
+enum work_priority {
+	WorkPriority_High,
+	WorkPriority_Normal,
+	WorkPriority_Low,
+
+	WorkPriority_Count
+};
+
+// NOTE(ivan): Adds a background entry, for jobs like asset streaming, capture encoding or config saving.
+// Background entries are picked up only when no plain ones are left, the most urgent first: an entry is due
+// once its priority class latency is over, or by its deadline, DeadlineFrames from now (zero if none), whichever is sooner.
+// So waiting entries become more and more urgent and a stream of higher-priority ones never starves them.
+// The main thread also does them in what is left of every frame.
+#define PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(name) void name(work_queue *Queue, work_queue_callback *Callback, void *Data, work_group *Group, work_priority Priority, u32 DeadlineFrames)
+typedef PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(platform_add_background_work_queue_entry);
+
+// NOTE(ivan): Waits for everything on the queue, including entries added in the meantime.
 #define PLATFORM_COMPLETE_WORK_QUEUE(name) void name(work_queue *Queue)
 typedef PLATFORM_COMPLETE_WORK_QUEUE(platform_complete_work_queue);
 
+// NOTE(ivan): Waits for the group's entries only, doing any entries of the queue meanwhile.
+// Inside of a fiber entry the fiber is suspended instead.
+#define PLATFORM_WAIT_FOR_WORK_GROUP(name) void name(work_queue *Queue, work_group *Group)
+typedef PLATFORM_WAIT_FOR_WORK_GROUP(platform_wait_for_work_group);
+
+// NOTE(ivan): Calls Callback over items [0, Count) in ranges of at least MinGrain items,
+// on the queue's workers and the calling thread, and returns once all are done.
+#define PLATFORM_PARALLEL_FOR(name) void name(work_queue *Queue, u32 Count, u32 MinGrain, parallel_for_callback *Callback, void *Data)
+typedef PLATFORM_PARALLEL_FOR(platform_parallel_for);
+
 #define PLATFORM_READ_ENTIRE_FILE(name) piece name(const char *FileName)
 typedef PLATFORM_READ_ENTIRE_FILE(platform_read_entire_file);
 
@@ -248,8 +351,18 @@ struct platform_api {
 	platform_allocate_memory *AllocateMemory; // NOTE(ivan): This MUST return zero-initialized memory!!!
 	platform_deallocate_memory *DeallocateMemory;
 	platform_get_memory_stats *GetMemoryStats;
+	platform_reserve_memory *ReserveMemory;
+	platform_commit_memory *CommitMemory;
+	platform_decommit_memory *DecommitMemory;
+	platform_release_memory *ReleaseMemory;
+	platform_get_thread_scratch *GetThreadScratch;
 	platform_add_work_queue_entry *AddWorkQueueEntry;
+	platform_add_fiber_work_queue_entry *AddFiberWorkQueueEntry;
+	platform_add_work_queue_entries *AddWorkQueueEntries;
+	platform_add_background_work_queue_entry *AddBackgroundWorkQueueEntry;
 	platform_complete_work_queue *CompleteWorkQueue;
+	platform_wait_for_work_group *WaitForWorkGroup;
+	platform_parallel_for *ParallelFor;
 	platform_read_entire_file *ReadEntireFile;
 	platform_free_entire_file_memory *FreeEntireFileMemory;
 	platform_write_entire_file *WriteEntireFile;
@@ -317,15 +430,19 @@ SwapEndianU16(u16 *Value)
 // NOTE(ivan): Memory barriers.
 // TODO(ivan): _WriteBarrier()/_ReadBarrier() are "sort of" deprecated, according to MSDN:
 // they say these are deprecated, but still these work fine. Should be any replacement?
+// NOTE(ivan): CompletePastWritesBeforeFutureReads() is the only one x86 really needs a fence instruction for.
 #if MSVC
 inline void CompletePastWritesBeforeFutureWrites(void) {_WriteBarrier(); _mm_sfence();}
 inline void CompletePastReadsBeforeFutureReads(void) {_ReadBarrier(); _mm_lfence();}
+inline void CompletePastWritesBeforeFutureReads(void) {_ReadWriteBarrier(); _mm_mfence();}
 #elif GNUC
 inline void CompletePastWritesBeforeFutureWrites(void) {__sync_synchronize();}
 inline void CompletePastReadsBeforeFutureReads(void) {__sync_synchronize();}
+inline void CompletePastWritesBeforeFutureReads(void) {__sync_synchronize();}
 #else
 inline void CompletePastWritesBeforeFutureWrites(void) {NotImplemented();}
 inline void CompletePastReadsBeforeFutureReads(void) {NotImplemented();}
+inline void CompletePastWritesBeforeFutureReads(void) {NotImplemented();}
 #endif
 
 // NOTE(ivan): Interlocked operations.
@@ -336,6 +453,8 @@ inline u32 AtomicDecrementU32(volatile u32 *val) {return _InterlockedDecrement((
 inline u64 AtomicDecrementU64(volatile u64 *val) {return _InterlockedDecrement64((volatile __int64 *)val);}
 inline u32 AtomicCompareExchangeU32(volatile u32 *val, u32 _new, u32 expected) {return _InterlockedCompareExchange((volatile long *)val, _new, expected);}
 inline u64 AtomicCompareExchangeU64(volatile u64 *val, u64 _new, u64 expected) {return _InterlockedCompareExchange64((volatile __int64 *)val, _new, expected);}
+inline u32 AtomicAddU32(volatile u32 *val, u32 add) {return _InterlockedExchangeAdd((volatile long *)val, add);}
+inline u64 AtomicAddU64(volatile u64 *val, u64 add) {return _InterlockedExchangeAdd64((volatile __int64 *)val, add);}
 #elif GNUC
 inline u32 AtomicIncrementU32(volatile u32 *val) {return __sync_fetch_and_add(val, 1);}
 inline u64 AtomicIncrementU64(volatile u64 *val) {return __sync_fetch_and_add(val, 1);}
@@ -343,6 +462,8 @@ inline u32 AtomicDecrementU32(volatile u32 *val) {return __sync_fetch_and_sub(va
 inline u64 AtomicDecrementU64(volatile u64 *val) {return __sync_fetch_and_sub(val, 1);}
 inline u32 AtomicCompareExchangeU32(volatile u32 *val, u32 _new, u32 expected) {return __sync_val_compare_and_swap(val, expected, _new);}
 inline u64 AtomicCompareExchangeU64(volatile u64 *val, u64 _new, u64 expected) {return __sync_val_compare_and_swap(val, expected, _new);}
+inline u32 AtomicAddU32(volatile u32 *val, u32 add) {return __sync_fetch_and_add(val, add);}
+inline u64 AtomicAddU64(volatile u64 *val, u64 add) {return __sync_fetch_and_add(val, add);}
 #else
 inline u32 AtomicIncrementU32(volatile u32 *val) {NotImplemented(); return 0;}
 inline u64 AtomicIncrementU64(volatile u64 *val) {NotImplemented(); return 0;}
@@ -350,6 +471,26 @@ inline u32 AtomicDecrementU32(volatile u32 *val) {NotImplemented(); return 0;}
 inline u64 AtomicDecrementU64(volatile u64 *val) {NotImplemented(); return 0;}
 inline u32 AtomicCompareExchangeU32(volatile u32 *val, u32 _new, u32 expected) {NotImplemented(); return 0;}
 inline u64 AtomicCompareExchangeU64(volatile u64 *val, u64 _new, u64 expected) {NotImplemented(); return 0;}
+inline u32 AtomicAddU32(volatile u32 *val, u32 add) {NotImplemented(); return 0;}
+inline u64 AtomicAddU64(volatile u64 *val, u64 add) {NotImplemented(); return 0;}
+#endif
+
+// NOTE(ivan): Thread-local storage specifier, only for POD types.
+#if MSVC
+#define ThreadLocal __declspec(thread)
+#elif GNUC
+#define ThreadLocal __thread
+#else
+#define ThreadLocal NotImplemented!!!!!!!!!!!!!
+#endif
+
+// NOTE(ivan): Keeps a function out of line, e.g. so the thread-local addresses it uses are taken anew on every call.
+#if MSVC
+#define NoInline __declspec(noinline)
+#elif GNUC
+#define NoInline __attribute__((noinline))
+#else
+#define NoInline NotImplemented!!!!!!!!!!!!!
 #endif
 
 // NOTE(ivan): Yield processor, give its time to other threads.
@@ -361,11 +502,58 @@ inline void YieldProcessor(void) {_mm_pause();}
 inline void YieldProcessor(void) {NotImplemented();}
 #endif
 
-// NOTE(ivan): Cross-platform ticket-mutex.
+// NOTE(ivan): Address waiting, the parking primitive under the mutexes below.
+// WaitOnAddressU32() blocks while *Address still equals Value and may return spuriously,
+// WakeOnAddressU32() wakes up to MaxWaiters threads waiting on Address, every one by default.
+#if LINUX
+inline void
+WaitOnAddressU32(volatile u32 *Address, u32 Value)
+{
+	syscall(SYS_futex, (u32 *)Address, FUTEX_WAIT_PRIVATE, Value, 0, 0, 0);
+}
+inline void
+WakeOnAddressU32(volatile u32 *Address, u32 MaxWaiters = INT_MAX)
+{
+	syscall(SYS_futex, (u32 *)Address, FUTEX_WAKE_PRIVATE, Min(MaxWaiters, (u32)INT_MAX), 0, 0, 0);
+}
+#elif WIN32
+// NOTE(ivan): WaitOnAddress() needs Windows 8 and we target Windows 7, so the waiter gives its time slice away instead.
+extern "C" __declspec(dllimport) int __stdcall SwitchToThread(void);
+extern "C" __declspec(dllimport) void __stdcall Sleep(unsigned long Milliseconds);
+inline void
+WaitOnAddressU32(volatile u32 *Address, u32 Value)
+{
+	if (*Address == Value && !SwitchToThread())
+		Sleep(1);
+}
+inline void
+WakeOnAddressU32(volatile u32 *Address, u32 MaxWaiters = INT_MAX)
+{
+	(void)Address;
+	(void)MaxWaiters;
+}
+#else
+inline void WaitOnAddressU32(volatile u32 *Address, u32 Value) {NotImplemented();}
+inline void WakeOnAddressU32(volatile u32 *Address, u32 MaxWaiters = INT_MAX) {NotImplemented();}
+#endif
+
+// NOTE(ivan): Number of YieldProcessor() calls a waiter spends before parking itself.
+// Most critical sections here are a few dozen instructions, so a short spin catches them without a syscall.
+#define MUTEX_SPIN_COUNT 128
+
+// NOTE(ivan): Number of wait slots per ticket-mutex, parked threads wait on the slot of their ticket.
+#define MUTEX_WAIT_SLOTS 8
+
+// NOTE(ivan): Cross-platform ticket-mutex, FIFO-fair: threads enter in the order they took their tickets.
+// Only the next ticket holder spins, anyone further back in the line parks right away.
+// Parked threads wait on the slot their ticket maps to, so a leave wakes the next ticket holder only,
+// plus whoever shares its slot, that is someone MUTEX_WAIT_SLOTS tickets or more further back.
 // NOTE(ivan): Any instance of this structure MUST be ZERO-initialized for proper functioning of EnterTicketMutex()/LeaveTicketMutex() macros.
 struct ticket_mutex {
-	volatile u64 Ticket;
-	volatile u64 Serving;
+	volatile u32 Ticket;
+	volatile u32 Serving;
+	volatile u32 NumWaiters; // NOTE(ivan): Parked threads, LeaveTicketMutex() makes the syscall only if any.
+	volatile u32 WaitSlots[MUTEX_WAIT_SLOTS]; // NOTE(ivan): Bumped when the slot's ticket is served, parked threads wait on these.
 };
 
 // NOTE(ivan): Ticket-mutex locking/unlocking.
@@ -373,17 +561,787 @@ inline void
 EnterTicketMutex(ticket_mutex *Mutex)
 {
 	Assert(Mutex);
-	AtomicIncrementU64(&Mutex->Ticket);
-	
-	u64 Ticket = Mutex->Ticket - 1;
-	while (Ticket != Mutex->Serving)
-		YieldProcessor();
+
+	u32 Ticket = AtomicAddU32(&Mutex->Ticket, 1);
+	if (Ticket == Mutex->Serving)
+		return;
+
+	if (Ticket - Mutex->Serving == 1) {
+		for (u32 Spin = 0; Spin < MUTEX_SPIN_COUNT; Spin++) {
+			YieldProcessor();
+			if (Ticket == Mutex->Serving)
+				return;
+		}
+	}
+
+	// NOTE(ivan): Waiters count goes up before Serving is sampled, so LeaveTicketMutex() cannot miss us.
+	// The slot is sampled before Serving, so a leave serving us in between bumps it and the wait returns right away.
+	volatile u32 *WaitSlot = &Mutex->WaitSlots[Ticket % MUTEX_WAIT_SLOTS];
+	AtomicIncrementU32(&Mutex->NumWaiters);
+	for (;;) {
+		u32 Wait = *WaitSlot;
+		CompletePastReadsBeforeFutureReads();
+		if (Ticket == Mutex->Serving)
+			break;
+		WaitOnAddressU32(WaitSlot, Wait);
+	}
+	AtomicDecrementU32(&Mutex->NumWaiters);
 }
 inline void
 LeaveTicketMutex(ticket_mutex *Mutex)
 {
 	Assert(Mutex);
-	AtomicIncrementU64(&Mutex->Serving);
+
+	u32 Serving = AtomicAddU32(&Mutex->Serving, 1) + 1;
+	if (Mutex->NumWaiters) {
+		volatile u32 *WaitSlot = &Mutex->WaitSlots[Serving % MUTEX_WAIT_SLOTS];
+		AtomicIncrementU32(WaitSlot);
+		WakeOnAddressU32(WaitSlot);
+	}
+}
+
+// NOTE(ivan): Cross-platform readers-writer mutex, for read-mostly data.
+// Writers are preferred: once one is waiting, new readers wait too, so a steady stream of readers cannot starve it.
+// Writers enter among themselves in FIFO order through the ticket-mutex.
+// NOTE(ivan): Any instance of this structure MUST be ZERO-initialized for proper functioning.
+#define RW_MUTEX_WRITER 0x80000000
+#define RW_MUTEX_WRITER_WAITING 0x40000000
+#define RW_MUTEX_READERS_MASK 0x3FFFFFFF
+struct rw_mutex {
+	volatile u32 State; // NOTE(ivan): Readers count and RW_MUTEX_WRITER* flags.
+	ticket_mutex WriterMutex;
+};
+
+// NOTE(ivan): Readers-writer mutex locking/unlocking.
+inline void
+EnterRWMutexRead(rw_mutex *Mutex)
+{
+	Assert(Mutex);
+
+	u32 Spin = 0;
+	for (;;) {
+		u32 State = Mutex->State;
+		if (!(State & (RW_MUTEX_WRITER | RW_MUTEX_WRITER_WAITING))) {
+			Assert((State & RW_MUTEX_READERS_MASK) != RW_MUTEX_READERS_MASK);
+			if (AtomicCompareExchangeU32(&Mutex->State, State + 1, State) == State)
+				return;
+		} else if (Spin < MUTEX_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else {
+			WaitOnAddressU32(&Mutex->State, State);
+		}
+	}
+}
+inline void
+LeaveRWMutexRead(rw_mutex *Mutex)
+{
+	Assert(Mutex);
+	Assert(Mutex->State & RW_MUTEX_READERS_MASK);
+
+	// NOTE(ivan): The last reader out lets the waiting writer in.
+	u32 State = AtomicAddU32(&Mutex->State, (u32)-1) - 1;
+	if ((State & RW_MUTEX_WRITER_WAITING) && !(State & RW_MUTEX_READERS_MASK))
+		WakeOnAddressU32(&Mutex->State);
+}
+inline void
+EnterRWMutexWrite(rw_mutex *Mutex)
+{
+	Assert(Mutex);
+
+	EnterTicketMutex(&Mutex->WriterMutex);
+
+	// NOTE(ivan): Close the door for new readers, then wait for the ones inside to leave.
+	u32 Spin = 0;
+	for (;;) {
+		u32 State = Mutex->State;
+		Assert(!(State & RW_MUTEX_WRITER));
+		if (!(State & RW_MUTEX_READERS_MASK)) {
+			if (AtomicCompareExchangeU32(&Mutex->State, RW_MUTEX_WRITER, State) == State)
+				return;
+		} else if (!(State & RW_MUTEX_WRITER_WAITING)) {
+			AtomicCompareExchangeU32(&Mutex->State, State | RW_MUTEX_WRITER_WAITING, State);
+		} else if (Spin < MUTEX_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else {
+			WaitOnAddressU32(&Mutex->State, State);
+		}
+	}
+}
+inline void
+LeaveRWMutexWrite(rw_mutex *Mutex)
+{
+	Assert(Mutex);
+	Assert(Mutex->State == RW_MUTEX_WRITER);
+
+	// NOTE(ivan): Nobody can touch State while the writer is inside: readers and other writers only wait on it.
+	Mutex->State = 0;
+	CompletePastWritesBeforeFutureWrites();
+	WakeOnAddressU32(&Mutex->State);
+
+	LeaveTicketMutex(&Mutex->WriterMutex);
+}
+
+// NOTE(ivan): Cache line size, to keep data written by different threads apart.
+#define CACHE_LINE_SIZE 64
+
+// NOTE(ivan): Work queue entry structure.
+// NOTE(ivan): Filled in by callers of AddWorkQueueEntries() directly.
+struct work_queue_entry {
+	work_queue_callback *Callback;
+	void *Data;
+	work_group *Group;
+	b32 RunOnFiber;
+	const char *Name; // NOTE(ivan): For the profiler only, may be zero.
+};
+
+// NOTE(ivan): Chase-Lev work-stealing deque of work queue entries, shared by platform work queue implementations.
+// The owner thread pushes and pops at the bottom, so it keeps working on what it has just spawned,
+// any other thread steals from the top, so it takes the oldest (usually the biggest) piece of work.
+// NOTE(ivan): Arrays grow by doubling, retired ones stay alive until FreeWorkDeque() since a thief may still be reading one.
+struct work_deque_array {
+	work_deque_array *Prev; // NOTE(ivan): Retired smaller array.
+	s64 Mask;
+	work_queue_entry Entries[1];
+};
+struct work_deque {
+	volatile s64 Top;
+	u8 TopPad[CACHE_LINE_SIZE - sizeof(s64)]; // NOTE(ivan): Thieves hammer Top, keep it away from Bottom.
+	volatile s64 Bottom;
+	work_deque_array * volatile Array;
+};
+
+inline work_deque_array *
+AllocateWorkDequeArray(platform_allocate_memory *AllocateMemory, s64 Capacity)
+{
+	Assert(AllocateMemory);
+	Assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0);
+
+	work_deque_array *Array = (work_deque_array *)AllocateMemory(sizeof(work_deque_array) +
+																 sizeof(work_queue_entry) * (Capacity - 1));
+	if (Array) {
+		Array->Prev = 0;
+		Array->Mask = Capacity - 1;
+	}
+
+	return Array;
+}
+
+inline b32
+InitializeWorkDeque(work_deque *Deque, platform_allocate_memory *AllocateMemory, s64 Capacity)
+{
+	Assert(Deque);
+
+	Deque->Top = Deque->Bottom = 0;
+	Deque->Array = AllocateWorkDequeArray(AllocateMemory, Capacity);
+	return Deque->Array != 0;
+}
+
+inline void
+FreeWorkDeque(work_deque *Deque, platform_deallocate_memory *DeallocateMemory)
+{
+	Assert(Deque);
+	Assert(DeallocateMemory);
+
+	work_deque_array *Array = Deque->Array;
+	while (Array) {
+		work_deque_array *Prev = Array->Prev;
+		DeallocateMemory(Array);
+		Array = Prev;
+	}
+
+	Deque->Array = 0;
+}
+
+// NOTE(ivan): Any thread, a hint only: an entry being pushed or stolen at the moment may or may not be seen.
+inline b32
+IsWorkDequeEmpty(work_deque *Deque)
+{
+	Assert(Deque);
+	return Deque->Bottom <= Deque->Top;
+}
+
+// NOTE(ivan): Owner thread only. Returns false if the deque is full and failed to grow.
+inline b32
+PushWorkDeque(work_deque *Deque, work_queue_entry Entry, platform_allocate_memory *AllocateMemory)
+{
+	Assert(Deque);
+
+	s64 Bottom = Deque->Bottom;
+	s64 Top = Deque->Top;
+	work_deque_array *Array = Deque->Array;
+	if (Bottom - Top > Array->Mask) {
+		work_deque_array *NewArray = AllocateWorkDequeArray(AllocateMemory, (Array->Mask + 1) * 2);
+		if (!NewArray)
+			return false;
+
+		for (s64 Index = Top; Index < Bottom; Index++)
+			NewArray->Entries[Index & NewArray->Mask] = Array->Entries[Index & Array->Mask];
+		NewArray->Prev = Array;
+		CompletePastWritesBeforeFutureWrites();
+
+		Deque->Array = Array = NewArray;
+	}
+
+	Array->Entries[Bottom & Array->Mask] = Entry;
+	CompletePastWritesBeforeFutureWrites();
+
+	Deque->Bottom = Bottom + 1;
+	return true;
+}
+
+// NOTE(ivan): Owner thread only.
+inline b32
+PopWorkDeque(work_deque *Deque, work_queue_entry *Entry)
+{
+	Assert(Deque);
+	Assert(Entry);
+
+	// NOTE(ivan): Claim the bottom entry first, then see whether a thief got to it as well.
+	s64 Bottom = Deque->Bottom - 1;
+	work_deque_array *Array = Deque->Array;
+	Deque->Bottom = Bottom;
+	CompletePastWritesBeforeFutureReads();
+	s64 Top = Deque->Top;
+
+	b32 Result = false;
+	if (Top <= Bottom) {
+		*Entry = Array->Entries[Bottom & Array->Mask];
+		Result = true;
+
+		// NOTE(ivan): The last entry, race the thieves for it.
+		if (Top == Bottom) {
+			if (AtomicCompareExchangeU64((volatile u64 *)&Deque->Top, (u64)(Top + 1), (u64)Top) != (u64)Top)
+				Result = false;
+			Deque->Bottom = Bottom + 1;
+		}
+	} else {
+		Deque->Bottom = Bottom + 1;
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Any thread. Returns false only if the deque is empty, lost races are retried.
+inline b32
+StealWorkDeque(work_deque *Deque, work_queue_entry *Entry)
+{
+	Assert(Deque);
+	Assert(Entry);
+
+	for (;;) {
+		s64 Top = Deque->Top;
+		CompletePastWritesBeforeFutureReads();
+		s64 Bottom = Deque->Bottom;
+		if (Top >= Bottom)
+			return false;
+
+		// NOTE(ivan): The entry may be torn if the owner is overwriting it, but then Top has moved and the exchange fails.
+		work_deque_array *Array = Deque->Array;
+		work_queue_entry Result = Array->Entries[Top & Array->Mask];
+		if (AtomicCompareExchangeU64((volatile u64 *)&Deque->Top, (u64)(Top + 1), (u64)Top) == (u64)Top) {
+			*Entry = Result;
+			return true;
+		}
+	}
+}
+
+// NOTE(ivan): Parallel-for state, shared by platform ParallelFor() implementations.
+// A range job keeps halving its range, leaving upper halves on the queue for idle threads,
+// and does the rest itself once it is down to the grain size.
+#define MAX_PARALLEL_FOR_RANGES 512
+// NOTE(ivan): How many ranges every thread should get on average, so early finishers have something left to steal.
+#define PARALLEL_FOR_RANGES_PER_THREAD 4
+
+struct parallel_for_job;
+struct parallel_for_range {
+	parallel_for_job *Job;
+	u32 First;
+	u32 OnePastLast;
+};
+struct parallel_for_job {
+	parallel_for_callback *Callback;
+	void *Data;
+	u32 Grain;
+
+	work_group Group;
+	volatile u32 NumRanges;
+	parallel_for_range Ranges[MAX_PARALLEL_FOR_RANGES];
+};
+
+// NOTE(ivan): Bounded multi-producer multi-consumer ring of work queue entries (D. Vyukov's design),
+// shared by platform work queue implementations. Producers and consumers reserve slots with one
+// compare-exchange on their own position, and every cell's sequence number tells whether it is ready.
+struct work_ring_cell {
+	volatile u64 Sequence;
+	work_queue_entry Entry;
+};
+struct work_ring {
+	volatile u64 EnqueuePos;
+	u8 EnqueuePad[CACHE_LINE_SIZE - sizeof(u64)]; // NOTE(ivan): Producers and consumers do not share a cache line.
+	volatile u64 DequeuePos;
+	u8 DequeuePad[CACHE_LINE_SIZE - sizeof(u64)];
+
+	u64 Mask;
+	work_ring_cell *Cells;
+};
+
+inline b32
+InitializeWorkRing(work_ring *Ring, platform_allocate_memory *AllocateMemory, u64 Capacity)
+{
+	Assert(Ring);
+	Assert(AllocateMemory);
+	Assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0);
+
+	Ring->EnqueuePos = Ring->DequeuePos = 0;
+	Ring->Mask = Capacity - 1;
+	Ring->Cells = (work_ring_cell *)AllocateMemory(sizeof(work_ring_cell) * Capacity);
+	if (!Ring->Cells)
+		return false;
+
+	for (u64 Index = 0; Index < Capacity; Index++)
+		Ring->Cells[Index].Sequence = Index;
+
+	return true;
+}
+
+inline void
+FreeWorkRing(work_ring *Ring, platform_deallocate_memory *DeallocateMemory)
+{
+	Assert(Ring);
+	Assert(DeallocateMemory);
+
+	DeallocateMemory(Ring->Cells);
+	Ring->Cells = 0;
+}
+
+// NOTE(ivan): Any thread, a hint only. A claimed cell counts as taken before its entry is written,
+// so the ring never looks empty once a push has returned and before the entry is popped.
+inline b32
+IsWorkRingEmpty(work_ring *Ring)
+{
+	Assert(Ring);
+	return Ring->EnqueuePos == Ring->DequeuePos;
+}
+
+// NOTE(ivan): Any thread. Returns false if the ring is full.
+inline b32
+PushWorkRing(work_ring *Ring, work_queue_entry Entry)
+{
+	Assert(Ring);
+
+	work_ring_cell *Cell;
+	u64 Pos = Ring->EnqueuePos;
+	for (;;) {
+		Cell = Ring->Cells + (Pos & Ring->Mask);
+		s64 Diff = (s64)(Cell->Sequence - Pos);
+		if (Diff == 0) {
+			u64 OrigPos = AtomicCompareExchangeU64(&Ring->EnqueuePos, Pos + 1, Pos);
+			if (OrigPos == Pos)
+				break;
+			Pos = OrigPos;
+		} else if (Diff < 0) {
+			return false; // NOTE(ivan): The cell still holds an entry from the previous lap.
+		} else {
+			Pos = Ring->EnqueuePos;
+		}
+	}
+
+	Cell->Entry = Entry;
+	CompletePastWritesBeforeFutureWrites();
+	Cell->Sequence = Pos + 1;
+	return true;
+}
+
+// NOTE(ivan): Any thread. Returns false if the ring is empty.
+inline b32
+PopWorkRing(work_ring *Ring, work_queue_entry *Entry)
+{
+	Assert(Ring);
+	Assert(Entry);
+
+	work_ring_cell *Cell;
+	u64 Pos = Ring->DequeuePos;
+	for (;;) {
+		Cell = Ring->Cells + (Pos & Ring->Mask);
+		s64 Diff = (s64)(Cell->Sequence - (Pos + 1));
+		if (Diff == 0) {
+			u64 OrigPos = AtomicCompareExchangeU64(&Ring->DequeuePos, Pos + 1, Pos);
+			if (OrigPos == Pos)
+				break;
+			Pos = OrigPos;
+		} else if (Diff < 0) {
+			return false; // NOTE(ivan): The cell is not written yet.
+		} else {
+			Pos = Ring->DequeuePos;
+		}
+	}
+
+	*Entry = Cell->Entry;
+	CompletePastWritesBeforeFutureReads(); // NOTE(ivan): Entry must be read before the cell is handed to the next lap.
+	Cell->Sequence = Pos + Ring->Mask + 1;
+	return true;
+}
+
+// NOTE(ivan): How many frames a background entry of every priority class waits at most before it is due.
+static const u32 WorkPriorityLatencyFrames[WorkPriority_Count] = {
+	2,   // NOTE(ivan): WorkPriority_High.
+	30,  // NOTE(ivan): WorkPriority_Normal.
+	300  // NOTE(ivan): WorkPriority_Low.
+};
+
+// NOTE(ivan): Locked binary min-heap of background entries, shared by platform work queue implementations, grows by doubling.
+// Entries are ordered by the frame they are due at, then by priority class, then by the order they were added in.
+// Every new entry is due one frame from now at the earliest, so once an entry's frame has come nothing can get ahead of it anymore.
+struct work_heap_entry {
+	work_queue_entry Entry;
+	u64 DueFrame;
+	u64 Sequence;
+	work_priority Priority;
+};
+struct work_heap {
+	ticket_mutex Mutex;
+	volatile u32 NumEntries;
+	u32 MaxEntries;
+	work_heap_entry *Entries;
+
+	u64 Frame; // NOTE(ivan): Advanced once a frame by the platform layer.
+	u64 NextSequence;
+};
+
+inline b32
+InitializeWorkHeap(work_heap *Heap, platform_allocate_memory *AllocateMemory, u32 Capacity)
+{
+	Assert(Heap);
+	Assert(AllocateMemory);
+	Assert(Capacity);
+
+	Heap->Mutex = {};
+	Heap->NumEntries = 0;
+	Heap->MaxEntries = Capacity;
+	Heap->Frame = Heap->NextSequence = 0;
+	Heap->Entries = (work_heap_entry *)AllocateMemory(sizeof(work_heap_entry) * Capacity);
+	return Heap->Entries != 0;
+}
+
+inline void
+FreeWorkHeap(work_heap *Heap, platform_deallocate_memory *DeallocateMemory)
+{
+	Assert(Heap);
+	Assert(DeallocateMemory);
+
+	DeallocateMemory(Heap->Entries);
+	Heap->Entries = 0;
+}
+
+// NOTE(ivan): Any thread, a hint only.
+inline b32
+IsWorkHeapEmpty(work_heap *Heap)
+{
+	Assert(Heap);
+	return !Heap->NumEntries;
+}
+
+inline b32
+IsWorkHeapEntryBefore(work_heap_entry *A, work_heap_entry *B)
+{
+	if (A->DueFrame != B->DueFrame)
+		return A->DueFrame < B->DueFrame;
+	if (A->Priority != B->Priority)
+		return A->Priority < B->Priority;
+	return A->Sequence < B->Sequence;
+}
+
+// NOTE(ivan): Any thread.
+inline void
+AdvanceWorkHeapFrame(work_heap *Heap)
+{
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+	Heap->Frame++;
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+// NOTE(ivan): Any thread. Returns false if the heap is full and failed to grow.
+inline b32
+PushWorkHeap(work_heap *Heap, work_queue_entry Entry, work_priority Priority, u32 DeadlineFrames,
+			 platform_allocate_memory *AllocateMemory, platform_deallocate_memory *DeallocateMemory)
+{
+	Assert(Heap);
+	Assert((u32)Priority < WorkPriority_Count);
+
+	b32 Result = true;
+	EnterTicketMutex(&Heap->Mutex);
+
+	if (Heap->NumEntries == Heap->MaxEntries) {
+		u32 NewMaxEntries = Heap->MaxEntries * 2;
+		work_heap_entry *NewEntries = (work_heap_entry *)AllocateMemory(sizeof(work_heap_entry) * NewMaxEntries);
+		if (NewEntries) {
+			memcpy(NewEntries, Heap->Entries, sizeof(work_heap_entry) * Heap->NumEntries);
+			DeallocateMemory(Heap->Entries);
+			Heap->Entries = NewEntries;
+			Heap->MaxEntries = NewMaxEntries;
+		} else {
+			Result = false;
+		}
+	}
+
+	if (Result) {
+		work_heap_entry New;
+		New.Entry = Entry;
+		New.DueFrame = Heap->Frame + WorkPriorityLatencyFrames[Priority];
+		if (DeadlineFrames)
+			New.DueFrame = Min(New.DueFrame, Heap->Frame + DeadlineFrames);
+		New.Sequence = Heap->NextSequence++;
+		New.Priority = Priority;
+
+		// NOTE(ivan): Sift up.
+		u32 Index = Heap->NumEntries;
+		while (Index) {
+			u32 Parent = (Index - 1) / 2;
+			if (!IsWorkHeapEntryBefore(&New, Heap->Entries + Parent))
+				break;
+			Heap->Entries[Index] = Heap->Entries[Parent];
+			Index = Parent;
+		}
+		Heap->Entries[Index] = New;
+		Heap->NumEntries++;
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+	return Result;
+}
+
+// NOTE(ivan): Any thread. Returns false if the heap is empty, or if OnlyDue is set and nothing is due this frame.
+inline b32
+PopWorkHeap(work_heap *Heap, work_queue_entry *Entry, b32 OnlyDue = false)
+{
+	Assert(Heap);
+	Assert(Entry);
+
+	// NOTE(ivan): Do not take the lock just to find out there is nothing.
+	if (!Heap->NumEntries)
+		return false;
+
+	b32 Result = false;
+	EnterTicketMutex(&Heap->Mutex);
+
+	if (Heap->NumEntries && (!OnlyDue || Heap->Entries[0].DueFrame <= Heap->Frame)) {
+		*Entry = Heap->Entries[0].Entry;
+		Heap->NumEntries--;
+
+		// NOTE(ivan): Sift the last entry down from the root.
+		work_heap_entry Last = Heap->Entries[Heap->NumEntries];
+		u32 Index = 0;
+		for (;;) {
+			u32 Child = Index * 2 + 1;
+			if (Child >= Heap->NumEntries)
+				break;
+			if (Child + 1 < Heap->NumEntries && IsWorkHeapEntryBefore(Heap->Entries + Child + 1, Heap->Entries + Child))
+				Child++;
+			if (!IsWorkHeapEntryBefore(Heap->Entries + Child, &Last))
+				break;
+			Heap->Entries[Index] = Heap->Entries[Child];
+			Index = Child;
+		}
+		Heap->Entries[Index] = Last;
+		Result = true;
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+	return Result;
+}
+
+// NOTE(ivan): Work queue profiler, shared by platform work queue implementations.
+// While a capture is on, every entry done, and every run of a fiber entry between its waits, is recorded
+// by the thread that did it into the thread's own ring buffer, so recording takes neither locks nor atomics.
+// A capture is written out as Chrome trace JSON, for chrome://tracing or Perfetto.
+#define WORK_PROFILE_EVENTS 8192 // NOTE(ivan): Per thread, MUST be a power of two. The oldest events are overwritten.
+
+struct work_profile_event {
+	u64 BeginTicks;
+	u64 EndTicks;
+	const char *Name; // NOTE(ivan): Zero for unnamed entries, the callback address is shown instead.
+	work_queue_callback *Callback;
+	const char *QueueName;
+};
+
+// NOTE(ivan): Written by its own thread only. Buffers are never freed, so events outlive the threads that recorded them.
+struct work_profile_buffer {
+	volatile u64 NumEvents; // NOTE(ivan): Ever recorded, event N is at N % WORK_PROFILE_EVENTS.
+	u32 ThreadID;
+	char ThreadName[64];
+
+	work_profile_buffer *Next;
+	work_profile_event Events[WORK_PROFILE_EVENTS];
+};
+
+// NOTE(ivan): Any instance of this structure MUST be ZERO-initialized.
+struct work_profiler {
+	volatile b32 IsCapturing;
+	u64 CaptureStartTicks; // NOTE(ivan): Events that began earlier are left out of the trace.
+
+	ticket_mutex BuffersMutex;
+	work_profile_buffer *FirstBuffer;
+};
+
+// NOTE(ivan): Any thread.
+inline void
+AddWorkProfileBuffer(work_profiler *Profiler, work_profile_buffer *Buffer)
+{
+	Assert(Profiler);
+	Assert(Buffer);
+
+	EnterTicketMutex(&Profiler->BuffersMutex);
+	Buffer->Next = Profiler->FirstBuffer;
+	Profiler->FirstBuffer = Buffer;
+	LeaveTicketMutex(&Profiler->BuffersMutex);
+}
+
+inline void
+StartWorkProfileCapture(work_profiler *Profiler, u64 NowTicks)
+{
+	Assert(Profiler);
+
+	Profiler->CaptureStartTicks = NowTicks;
+	CompletePastWritesBeforeFutureWrites();
+	Profiler->IsCapturing = true;
+}
+
+// NOTE(ivan): Owner thread only.
+inline void
+RecordWorkProfileEvent(work_profile_buffer *Buffer, work_queue_entry *Entry, const char *QueueName, u64 BeginTicks, u64 EndTicks)
+{
+	Assert(Buffer);
+	Assert(Entry);
+
+	u64 Index = Buffer->NumEvents;
+	work_profile_event *Event = Buffer->Events + (Index & (WORK_PROFILE_EVENTS - 1));
+	Event->BeginTicks = BeginTicks;
+	Event->EndTicks = EndTicks;
+	Event->Name = Entry->Name;
+	Event->Callback = Entry->Callback;
+	Event->QueueName = QueueName;
+	CompletePastWritesBeforeFutureWrites();
+
+	Buffer->NumEvents = Index + 1;
+}
+
+// NOTE(ivan): Appends formatted text to Trace, growing it by doubling.
+inline b32
+AppendWorkProfileTrace(piece *Trace, uptr *MaxBytes,
+					   platform_allocate_memory *AllocateMemory, platform_deallocate_memory *DeallocateMemory,
+					   const char *Format, ...)
+{
+	Assert(Trace);
+	Assert(MaxBytes);
+	Assert(Format);
+
+	for (;;) {
+		va_list Args;
+		va_start(Args, Format);
+		int Length = vsnprintf((char *)Trace->Memory + Trace->Bytes, *MaxBytes - Trace->Bytes, Format, Args);
+		va_end(Args);
+		if (Length < 0)
+			return false;
+
+		if (Trace->Bytes + Length < *MaxBytes) {
+			Trace->Bytes += Length;
+			return true;
+		}
+
+		uptr NewMaxBytes = Max(*MaxBytes * 2, Trace->Bytes + Length + 1);
+		u8 *NewMemory = (u8 *)AllocateMemory(NewMaxBytes);
+		if (!NewMemory)
+			return false;
+		memcpy(NewMemory, Trace->Memory, Trace->Bytes);
+		DeallocateMemory(Trace->Memory);
+		Trace->Memory = NewMemory;
+		*MaxBytes = NewMaxBytes;
+	}
+}
+
+// NOTE(ivan): Any thread, even while others keep recording. Formats the capture as Chrome trace JSON,
+// events a thread has overwritten while they were being read are left out.
+// Returned memory comes from AllocateMemory, and is zero if out of memory.
+inline piece
+FormatWorkProfileTrace(work_profiler *Profiler, u64 TicksPerSecond,
+					   platform_allocate_memory *AllocateMemory, platform_deallocate_memory *DeallocateMemory)
+{
+	Assert(Profiler);
+	Assert(TicksPerSecond);
+	Assert(AllocateMemory);
+	Assert(DeallocateMemory);
+
+	piece Result = {};
+	uptr MaxBytes = Kilobytes(64);
+	Result.Memory = (u8 *)AllocateMemory(MaxBytes);
+	work_profile_event *Events = (work_profile_event *)AllocateMemory(sizeof(work_profile_event) * WORK_PROFILE_EVENTS);
+
+	b32 IsOK = (Result.Memory && Events);
+	IsOK = IsOK && AppendWorkProfileTrace(&Result, &MaxBytes, AllocateMemory, DeallocateMemory, "{\"traceEvents\":[");
+
+	f64 MicrosecondsPerTick = 1000000.0 / (f64)TicksPerSecond;
+	const char *Separator = "\n";
+
+	EnterTicketMutex(&Profiler->BuffersMutex);
+	for (work_profile_buffer *Buffer = Profiler->FirstBuffer; Buffer && IsOK; Buffer = Buffer->Next) {
+		IsOK = AppendWorkProfileTrace(&Result, &MaxBytes, AllocateMemory, DeallocateMemory,
+									  "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+									  Separator, Buffer->ThreadID, Buffer->ThreadName);
+		Separator = ",\n";
+
+		// NOTE(ivan): Copy the events out first, then see which of them the thread may have lapped meanwhile.
+		// An event is rewritten before NumEvents moves past it, so the one after the last published may be torn too.
+		u64 OnePastLast = Buffer->NumEvents;
+		CompletePastReadsBeforeFutureReads();
+		u64 First = (OnePastLast > WORK_PROFILE_EVENTS) ? OnePastLast - WORK_PROFILE_EVENTS : 0;
+		for (u64 Index = First; Index < OnePastLast; Index++)
+			Events[Index - First] = Buffer->Events[Index & (WORK_PROFILE_EVENTS - 1)];
+		CompletePastReadsBeforeFutureReads();
+		u64 NewOnePastLast = Buffer->NumEvents;
+		u64 FirstValid = (NewOnePastLast + 1 > WORK_PROFILE_EVENTS) ? NewOnePastLast + 1 - WORK_PROFILE_EVENTS : 0;
+
+		for (u64 Index = Max(First, FirstValid); Index < OnePastLast && IsOK; Index++) {
+			work_profile_event *Event = Events + (Index - First);
+			if (Event->BeginTicks < Profiler->CaptureStartTicks)
+				continue;
+
+			// NOTE(ivan): Names come from the code, but quotes and backslashes would still break the JSON.
+			char Name[128] = {};
+			if (Event->Name) {
+				u32 Length = 0;
+				for (const char *Char = Event->Name; *Char && Length < CountOf(Name) - 1; Char++)
+					Name[Length++] = (*Char == '"' || *Char == '\\' || (u8)*Char < ' ') ? '_' : *Char;
+			} else {
+				snprintf(Name, CountOf(Name) - 1, "%p", (void *)(uptr)Event->Callback);
+			}
+
+			IsOK = AppendWorkProfileTrace(&Result, &MaxBytes, AllocateMemory, DeallocateMemory,
+										  ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+										  Name, Event->QueueName ? Event->QueueName : "",
+										  Buffer->ThreadID,
+										  (f64)(Event->BeginTicks - Profiler->CaptureStartTicks) * MicrosecondsPerTick,
+										  (f64)(Event->EndTicks - Event->BeginTicks) * MicrosecondsPerTick);
+		}
+	}
+	LeaveTicketMutex(&Profiler->BuffersMutex);
+
+	IsOK = IsOK && AppendWorkProfileTrace(&Result, &MaxBytes, AllocateMemory, DeallocateMemory,
+										  "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	if (Events)
+		DeallocateMemory(Events);
+	if (!IsOK) {
+		if (Result.Memory)
+			DeallocateMemory(Result.Memory);
+		Result.Memory = 0;
+		Result.Bytes = 0;
+	}
+
+	return Result;
 }
 
 // NOTE(ivan): DLL file extension.
@@ -1,6 +1,7 @@
 #include "game.h"
 #include "game_platform.h"
 #include "game_platform_linux.h"
+#include "game_memory.h"
 
 #include "ents.h"
 
@@ -116,19 +117,361 @@ PLATFORM_ERROR(LinuxError)
 	exit(0);
 }
 
-// TODO(ivan): Implement a reliable Linux memory allocator.
+// NOTE(ivan): Huge page size of x86-64, large page reservations are aligned to it so THP can back them.
+#define LINUX_HUGE_PAGE_BYTES Megabytes(2)
+
+PLATFORM_RESERVE_MEMORY(LinuxReserveMemory)
+{
+	Assert(Bytes);
+
+	uptr Alignment = (Flags & PlatformMemoryFlag_LargePages) ? LINUX_HUGE_PAGE_BYTES : PLATFORM_MEMORY_PAGE_BYTES;
+	Bytes = AlignPow2(Bytes, PLATFORM_MEMORY_PAGE_BYTES);
+
+	// NOTE(ivan): Over-reserve and trim, mmap() guarantees system page alignment only.
+	uptr ReserveBytes = Bytes + Alignment;
+	u8 *Memory = (u8 *)mmap(0, ReserveBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (Memory == MAP_FAILED)
+		return 0;
+
+	u8 *Result = (u8 *)AlignPow2((uptr)Memory, Alignment);
+	if (Result != Memory)
+		munmap(Memory, Result - Memory);
+	if ((Memory + ReserveBytes) != (Result + Bytes))
+		munmap(Result + Bytes, (Memory + ReserveBytes) - (Result + Bytes));
+
+#if defined(MADV_HUGEPAGE)
+	// NOTE(ivan): Transparent huge pages need no preallocated pool unlike MAP_HUGETLB, and quietly fall back to
+	// regular pages when disabled, so they suit lazily committed reservations better.
+	if (Flags & PlatformMemoryFlag_LargePages)
+		madvise(Result, Bytes, MADV_HUGEPAGE);
+#endif
+
+	return Result;
+}
+
+PLATFORM_COMMIT_MEMORY(LinuxCommitMemory)
+{
+	Assert(Address);
+	Assert(Bytes);
+
+	// NOTE(ivan): Anonymous pages are zeroed by the kernel on first touch.
+	return mprotect(Address, Bytes, PROT_READ | PROT_WRITE) == 0;
+}
+
+PLATFORM_DECOMMIT_MEMORY(LinuxDecommitMemory)
+{
+	Assert(Address);
+	Assert(Bytes);
+
+	// NOTE(ivan): Dropped anonymous pages come back zeroed if they are ever committed again.
+	madvise(Address, Bytes, MADV_DONTNEED);
+	mprotect(Address, Bytes, PROT_NONE);
+}
+
+PLATFORM_RELEASE_MEMORY(LinuxReleaseMemory)
+{
+	if (!Address)
+		return;
+
+	munmap(Address, AlignPow2(Bytes, PLATFORM_MEMORY_PAGE_BYTES));
+}
+
+// NOTE(ivan): General purpose allocator.
+// Small requests are served from size classes carved out of 64KB-aligned slabs, the slab header
+// is found by masking the address. Each thread caches free blocks per size class and
+// trades them with the shared per-class lists in batches.
+// Large requests get their own mapping, with the same header at its 64KB-aligned start.
+// Fresh slab memory comes from the kernel already zeroed, so only reused blocks need zeroing.
+#define LINUX_SLAB_BYTES Kilobytes(64)
+#define LINUX_SLAB_HEADER_BYTES 64
+#define LINUX_SLAB_ARENA_BYTES Megabytes(4) // NOTE(ivan): Slabs are mapped this many at once.
+#define LINUX_MAX_SMALL_BYTES Kilobytes(16)
+#define LINUX_NUM_SIZE_CLASSES 36
+#define LINUX_LARGE_SIZE_CLASS 0xFFFFFFFF
+
+// NOTE(ivan): Freed large mappings up to LINUX_LARGE_CACHE_MAX_BYTES are kept for reuse, binned by size,
+// since zeroing them again is much cheaper than page faulting fresh ones in.
+#define LINUX_LARGE_CACHE_MAX_BYTES Megabytes(1)
+#define LINUX_LARGE_CACHE_BUDGET_BYTES Megabytes(32)
+#define LINUX_NUM_LARGE_CACHE_BINS (LINUX_LARGE_CACHE_MAX_BYTES / LINUX_SLAB_BYTES)
+
+// NOTE(ivan): Header at the start of every slab and every large allocation.
+struct linux_slab_header {
+	u32 SizeClass;
+	uptr Bytes; // NOTE(ivan): Whole mapping size, large allocations only.
+	linux_slab_header *NextCached; // NOTE(ivan): Large allocations only, while in the cache.
+};
+
+// NOTE(ivan): Free blocks of a single size class, either shared or thread-local.
+// Free blocks are linked through their first bytes, Fresh range is untouched zeroed memory.
+struct linux_size_class_list {
+	void *FreeBlocks;
+	u32 NumFreeBlocks;
+
+	u8 *FreshCursor;
+	u8 *FreshEnd;
+};
+
+// NOTE(ivan): Allocator locks are pthread mutexes: these need no FIFO order,
+// and unlike ticket_mutex a pthread mutex lets the unlocking thread re-take the lock without a handoff.
+struct linux_allocator {
+	pthread_mutex_t SlabMutex;
+	u8 *SlabCursor;
+	u8 *SlabEnd;
+
+	pthread_mutex_t ClassMutexes[LINUX_NUM_SIZE_CLASSES];
+	linux_size_class_list Classes[LINUX_NUM_SIZE_CLASSES];
+
+	pthread_mutex_t LargeCacheMutex;
+	linux_slab_header *LargeCache[LINUX_NUM_LARGE_CACHE_BINS];
+	uptr LargeCacheBytes;
+};
+
+// NOTE(ivan): Statically initialized, allocations may happen before main().
+static linux_allocator LinuxAllocator = {
+	PTHREAD_MUTEX_INITIALIZER, 0, 0,
+	{PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	 PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER},
+	{},
+	PTHREAD_MUTEX_INITIALIZER, {}, 0
+};
+static ThreadLocal linux_size_class_list LinuxAllocatorCache[LINUX_NUM_SIZE_CLASSES];
+
+// NOTE(ivan): Up to 128 bytes classes are 16 bytes apart, above that every power of two is split into 4 classes.
+inline u32
+LinuxGetSizeClass(uptr Bytes)
+{
+	Assert(Bytes && Bytes <= LINUX_MAX_SMALL_BYTES);
+
+	if (Bytes <= 128)
+		return (u32)((Bytes + 15) >> 4) - 1;
+
+	u32 Log = 31 - __builtin_clz((u32)(Bytes - 1));
+	uptr Step = ((uptr)1 << Log) >> 2;
+	return 8 + (Log - 7) * 4 + (u32)((Bytes - 1 - ((uptr)1 << Log)) / Step);
+}
+
+inline uptr
+LinuxGetSizeClassBytes(u32 SizeClass)
+{
+	Assert(SizeClass < LINUX_NUM_SIZE_CLASSES);
+
+	if (SizeClass < 8)
+		return (SizeClass + 1) * 16;
+
+	u32 Log = 7 + (SizeClass - 8) / 4;
+	return ((uptr)1 << Log) + (((SizeClass - 8) % 4) + 1) * (((uptr)1 << Log) >> 2);
+}
+
+// NOTE(ivan): Number of blocks moved between thread cache and shared list at once.
+inline u32
+LinuxGetSizeClassBatch(u32 SizeClass)
+{
+	uptr Batch = Kilobytes(8) / LinuxGetSizeClassBytes(SizeClass);
+	return (u32)Min(Max(Batch, (uptr)2), (uptr)64);
+}
+
+static u8 *
+LinuxAllocateSlab(u32 SizeClass)
+{
+	pthread_mutex_lock(&LinuxAllocator.SlabMutex);
+
+	if (LinuxAllocator.SlabCursor == LinuxAllocator.SlabEnd) {
+		// NOTE(ivan): Reservations are PLATFORM_MEMORY_PAGE_BYTES aligned, which matches the slab size.
+		u8 *Arena = (u8 *)LinuxReserveMemory(LINUX_SLAB_ARENA_BYTES, 0);
+		if (!Arena || !LinuxCommitMemory(Arena, LINUX_SLAB_ARENA_BYTES)) {
+			pthread_mutex_unlock(&LinuxAllocator.SlabMutex);
+			return 0;
+		}
+
+		LinuxAllocator.SlabCursor = Arena;
+		LinuxAllocator.SlabEnd = Arena + LINUX_SLAB_ARENA_BYTES;
+	}
+
+	u8 *Result = LinuxAllocator.SlabCursor;
+	LinuxAllocator.SlabCursor += LINUX_SLAB_BYTES;
+
+	pthread_mutex_unlock(&LinuxAllocator.SlabMutex);
+
+	((linux_slab_header *)Result)->SizeClass = SizeClass;
+	return Result;
+}
+
+// NOTE(ivan): Moves a batch of blocks from the shared list to the thread cache, or a fresh range if there are none.
+static b32
+LinuxRefillSizeClassCache(u32 SizeClass, linux_size_class_list *Cache)
+{
+	uptr BlockBytes = LinuxGetSizeClassBytes(SizeClass);
+	u32 Batch = LinuxGetSizeClassBatch(SizeClass);
+	linux_size_class_list *Shared = &LinuxAllocator.Classes[SizeClass];
+
+	pthread_mutex_lock(&LinuxAllocator.ClassMutexes[SizeClass]);
+
+	if (Shared->FreeBlocks) {
+		while (Shared->FreeBlocks && Cache->NumFreeBlocks < Batch) {
+			void *Block = Shared->FreeBlocks;
+			Shared->FreeBlocks = *(void **)Block;
+			Shared->NumFreeBlocks--;
+
+			*(void **)Block = Cache->FreeBlocks;
+			Cache->FreeBlocks = Block;
+			Cache->NumFreeBlocks++;
+		}
+	} else {
+		if ((uptr)(Shared->FreshEnd - Shared->FreshCursor) < BlockBytes) {
+			u8 *Slab = LinuxAllocateSlab(SizeClass);
+			if (!Slab) {
+				pthread_mutex_unlock(&LinuxAllocator.ClassMutexes[SizeClass]);
+				return false;
+			}
+
+			Shared->FreshCursor = Slab + LINUX_SLAB_HEADER_BYTES;
+			Shared->FreshEnd = Shared->FreshCursor + ((LINUX_SLAB_BYTES - LINUX_SLAB_HEADER_BYTES) / BlockBytes) * BlockBytes;
+		}
+
+		uptr Bytes = Min((uptr)(Shared->FreshEnd - Shared->FreshCursor), Batch * BlockBytes);
+		Cache->FreshCursor = Shared->FreshCursor;
+		Cache->FreshEnd = Shared->FreshCursor + Bytes;
+		Shared->FreshCursor += Bytes;
+	}
+
+	pthread_mutex_unlock(&LinuxAllocator.ClassMutexes[SizeClass]);
+	return true;
+}
+
+static void
+LinuxFlushSizeClassCache(u32 SizeClass, linux_size_class_list *Cache, u32 NumBlocks)
+{
+	// NOTE(ivan): Link the batch privately, then splice it in under the lock.
+	void *First = Cache->FreeBlocks;
+	void *Last = First;
+	for (u32 Index = 1; Index < NumBlocks; Index++)
+		Last = *(void **)Last;
+	Cache->FreeBlocks = *(void **)Last;
+	Cache->NumFreeBlocks -= NumBlocks;
+
+	linux_size_class_list *Shared = &LinuxAllocator.Classes[SizeClass];
+	pthread_mutex_lock(&LinuxAllocator.ClassMutexes[SizeClass]);
+	*(void **)Last = Shared->FreeBlocks;
+	Shared->FreeBlocks = First;
+	Shared->NumFreeBlocks += NumBlocks;
+	pthread_mutex_unlock(&LinuxAllocator.ClassMutexes[SizeClass]);
+}
+
 PLATFORM_ALLOCATE_MEMORY(LinuxAllocateMemory)
 {
 	Assert(Bytes);
-	return malloc(Bytes);
+
+	// NOTE(ivan): Large allocations go straight to the kernel, unless a cached mapping fits.
+	if (Bytes > LINUX_MAX_SMALL_BYTES) {
+		uptr MapBytes = AlignPow2(Bytes + LINUX_SLAB_HEADER_BYTES, (uptr)LINUX_SLAB_BYTES);
+		if (MapBytes <= LINUX_LARGE_CACHE_MAX_BYTES) {
+			uptr Bin = (MapBytes / LINUX_SLAB_BYTES) - 1;
+
+			pthread_mutex_lock(&LinuxAllocator.LargeCacheMutex);
+			linux_slab_header *Header = LinuxAllocator.LargeCache[Bin];
+			if (Header) {
+				LinuxAllocator.LargeCache[Bin] = Header->NextCached;
+				LinuxAllocator.LargeCacheBytes -= MapBytes;
+			}
+			pthread_mutex_unlock(&LinuxAllocator.LargeCacheMutex);
+
+			if (Header) {
+				// NOTE(ivan): Only the requested part is ever visible to the caller, so only it is zeroed.
+				u8 *Result = (u8 *)Header + LINUX_SLAB_HEADER_BYTES;
+				memset(Result, 0, Bytes);
+				return Result;
+			}
+		}
+
+		u8 *Memory = (u8 *)LinuxReserveMemory(MapBytes, 0);
+		if (!Memory)
+			return 0;
+		if (!LinuxCommitMemory(Memory, MapBytes)) {
+			LinuxReleaseMemory(Memory, MapBytes);
+			return 0;
+		}
+
+		linux_slab_header *Header = (linux_slab_header *)Memory;
+		Header->SizeClass = LINUX_LARGE_SIZE_CLASS;
+		Header->Bytes = MapBytes;
+		return Memory + LINUX_SLAB_HEADER_BYTES;
+	}
+
+	u32 SizeClass = LinuxGetSizeClass(Bytes);
+	linux_size_class_list *Cache = &LinuxAllocatorCache[SizeClass];
+	while (true) {
+		// NOTE(ivan): Reused blocks are dirty, zero them as the API promises.
+		if (Cache->FreeBlocks) {
+			void *Result = Cache->FreeBlocks;
+			Cache->FreeBlocks = *(void **)Result;
+			Cache->NumFreeBlocks--;
+
+			memset(Result, 0, LinuxGetSizeClassBytes(SizeClass));
+			return Result;
+		}
+
+		// NOTE(ivan): Fresh blocks are zeroed already.
+		if (Cache->FreshCursor != Cache->FreshEnd) {
+			void *Result = Cache->FreshCursor;
+			Cache->FreshCursor += LinuxGetSizeClassBytes(SizeClass);
+			return Result;
+		}
+
+		if (!LinuxRefillSizeClassCache(SizeClass, Cache))
+			return 0;
+	}
 }
 
-// TODO(ivan): Implement a reliable Linux memory allocator.
 PLATFORM_DEALLOCATE_MEMORY(LinuxDeallocateMemory)
 {
 	if (!Address)
 		return;
-	free(Address);
+
+	linux_slab_header *Header = (linux_slab_header *)((uptr)Address & ~((uptr)LINUX_SLAB_BYTES - 1));
+	// NOTE(ivan): Range check rather than equality against LINUX_LARGE_SIZE_CLASS, so the cache index below is provably in bounds.
+	if (Header->SizeClass >= LINUX_NUM_SIZE_CLASSES) {
+		Assert(Header->SizeClass == LINUX_LARGE_SIZE_CLASS);
+		if (Header->Bytes <= LINUX_LARGE_CACHE_MAX_BYTES) {
+			uptr Bin = (Header->Bytes / LINUX_SLAB_BYTES) - 1;
+			b32 Cached = false;
+
+			pthread_mutex_lock(&LinuxAllocator.LargeCacheMutex);
+			if ((LinuxAllocator.LargeCacheBytes + Header->Bytes) <= LINUX_LARGE_CACHE_BUDGET_BYTES) {
+				Header->NextCached = LinuxAllocator.LargeCache[Bin];
+				LinuxAllocator.LargeCache[Bin] = Header;
+				LinuxAllocator.LargeCacheBytes += Header->Bytes;
+				Cached = true;
+			}
+			pthread_mutex_unlock(&LinuxAllocator.LargeCacheMutex);
+
+			if (Cached)
+				return;
+		}
+
+		LinuxReleaseMemory(Header, Header->Bytes);
+		return;
+	}
+
+	u32 SizeClass = Header->SizeClass;
+	Assert(SizeClass < LINUX_NUM_SIZE_CLASSES);
+
+	linux_size_class_list *Cache = &LinuxAllocatorCache[SizeClass];
+	*(void **)Address = Cache->FreeBlocks;
+	Cache->FreeBlocks = Address;
+	Cache->NumFreeBlocks++;
+
+	// NOTE(ivan): Keep at most two batches per thread, so blocks freed on one thread flow back to the others.
+	u32 Batch = LinuxGetSizeClassBatch(SizeClass);
+	if (Cache->NumFreeBlocks > (2 * Batch))
+		LinuxFlushSizeClassCache(SizeClass, Cache, Batch);
 }
 
 PLATFORM_GET_MEMORY_STATS(LinuxGetMemoryStats)
@@ -138,109 +481,897 @@ PLATFORM_GET_MEMORY_STATS(LinuxGetMemoryStats)
 	Result.BytesTotal = (u64)sysconf(_SC_PHYS_PAGES) * (u64)sysconf(_SC_PAGE_SIZE);
 	Result.BytesAvailable = (u64)sysconf(_SC_AVPHYS_PAGES) * (u64)sysconf(_SC_PAGE_SIZE);
 
+	// NOTE(ivan): Free pages leave out page cache the kernel drops at will, MemAvailable estimates
+	// what can really be allocated without swapping. Older kernels do not have it, keep free pages then.
+	FILE *MemInfo = fopen("/proc/meminfo", "r");
+	if (MemInfo) {
+		char Line[256];
+		while (fgets(Line, CountOf(Line), MemInfo)) {
+			unsigned long long KilobytesAvailable;
+			if (sscanf(Line, "MemAvailable: %llu kB", &KilobytesAvailable) == 1) {
+				Result.BytesAvailable = (u64)KilobytesAvailable * 1024;
+				break;
+			}
+		}
+		
+		fclose(MemInfo);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Per-thread scratch stack, blocks are allocated lazily on first push.
+static ThreadLocal memory_stack LinuxThreadScratch;
+static ThreadLocal b32 LinuxThreadScratchInitialized;
+
+PLATFORM_GET_THREAD_SCRATCH(LinuxGetThreadScratch)
+{
+	if (!LinuxThreadScratchInitialized) {
+		InitializeMemoryStackEmpty(&LinuxThreadScratch, "ThreadScratch", Kilobytes(64), MemoryStackFlag_ThreadLocal);
+		LinuxThreadScratchInitialized = true;
+	}
+
+	return &LinuxThreadScratch;
+}
+
+// NOTE(ivan): Worker the calling thread is, zero for non-worker threads.
+static ThreadLocal work_queue_worker *LinuxCurrentWorker;
+static ThreadLocal u32 LinuxStealSeed;
+static ThreadLocal work_fiber *LinuxCurrentFiber;
+
+// NOTE(ivan): Work queues profiler, every thread gets its buffer on the first event it records.
+static work_profiler LinuxWorkProfiler;
+static ThreadLocal work_profile_buffer *LinuxWorkProfileBuffer;
+
+// NOTE(ivan): Initial capacity of worker deques and overflow queues, both grow on demand.
+#define WORK_QUEUE_INITIAL_ENTRIES 256
+// NOTE(ivan): Capacity of the lock-free ring, enough for a frame's worth of jobs without touching the overflow lock.
+#define WORK_QUEUE_RING_ENTRIES 1024
+// NOTE(ivan): Number of empty polls an idle worker spends before parking itself,
+// so a steady stream of tiny entries is picked up without a single syscall on either side.
+#define WORK_QUEUE_SPIN_COUNT 256
+
+static b32
+LinuxPushWorkQueueOverflow(work_queue *Queue, work_queue_entry Entry)
+{
+	Assert(Queue);
+
+	b32 Result = true;
+	EnterTicketMutex(&Queue->OverflowMutex);
+
+	if (Queue->NumOverflowEntries == Queue->MaxOverflowEntries) {
+		u32 NewMaxOverflowEntries = Queue->MaxOverflowEntries * 2;
+		work_queue_entry *NewOverflowEntries = (work_queue_entry *)LinuxAllocateMemory(sizeof(work_queue_entry) * NewMaxOverflowEntries);
+		if (NewOverflowEntries) {
+			for (u32 Index = 0; Index < Queue->NumOverflowEntries; Index++)
+				NewOverflowEntries[Index] = Queue->OverflowEntries[(Queue->FirstOverflowEntry + Index) % Queue->MaxOverflowEntries];
+
+			LinuxDeallocateMemory(Queue->OverflowEntries);
+			Queue->OverflowEntries = NewOverflowEntries;
+			Queue->MaxOverflowEntries = NewMaxOverflowEntries;
+			Queue->FirstOverflowEntry = 0;
+		} else {
+			Result = false;
+		}
+	}
+
+	if (Result) {
+		Queue->OverflowEntries[(Queue->FirstOverflowEntry + Queue->NumOverflowEntries) % Queue->MaxOverflowEntries] = Entry;
+		CompletePastWritesBeforeFutureWrites();
+		Queue->NumOverflowEntries++;
+	}
+
+	LeaveTicketMutex(&Queue->OverflowMutex);
 	return Result;
 }
 
+static b32
+LinuxPopWorkQueueOverflow(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	// NOTE(ivan): Do not take the lock just to find out there is nothing.
+	if (!Queue->NumOverflowEntries)
+		return false;
+
+	b32 Result = false;
+	EnterTicketMutex(&Queue->OverflowMutex);
+
+	if (Queue->NumOverflowEntries) {
+		*Entry = Queue->OverflowEntries[Queue->FirstOverflowEntry];
+		Queue->FirstOverflowEntry = (Queue->FirstOverflowEntry + 1) % Queue->MaxOverflowEntries;
+		Queue->NumOverflowEntries--;
+		Result = true;
+	}
+
+	LeaveTicketMutex(&Queue->OverflowMutex);
+	return Result;
+}
+
+static b32
+LinuxStealWorkQueueEntry(work_queue *Queue, work_queue_worker *Self, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	// NOTE(ivan): Start from a random victim, so thieves do not all line up behind the first worker.
+	if (!LinuxStealSeed)
+		LinuxStealSeed = (u32)(uptr)&LinuxStealSeed | 1;
+	LinuxStealSeed ^= LinuxStealSeed << 13;
+	LinuxStealSeed ^= LinuxStealSeed >> 17;
+	LinuxStealSeed ^= LinuxStealSeed << 5;
+
+	u32 FirstVictim = LinuxStealSeed % Queue->NumWorkers;
+	for (u32 Index = 0; Index < Queue->NumWorkers; Index++) {
+		work_queue_worker *Victim = Queue->Workers + (FirstVictim + Index) % Queue->NumWorkers;
+		if (Victim != Self && StealWorkDeque(&Victim->Deque, Entry))
+			return true;
+	}
+
+	return false;
+}
+
+// NOTE(ivan): A hint only, see IsWorkDequeEmpty() and IsWorkRingEmpty().
+static b32
+LinuxHasWorkQueueEntries(work_queue *Queue)
+{
+	Assert(Queue);
+
+	if (Queue->NumReadyFibers || Queue->NumOverflowEntries || !IsWorkRingEmpty(&Queue->Ring) || !IsWorkHeapEmpty(&Queue->Heap))
+		return true;
+
+	for (u32 Index = 0; Index < Queue->NumWorkers; Index++) {
+		if (!IsWorkDequeEmpty(&Queue->Workers[Index].Deque))
+			return true;
+	}
+
+	return false;
+}
+
+// NOTE(ivan): Called after Count entries are added, costs nothing unless some workers are parked.
+static void
+LinuxWakeWorkQueueWorkers(work_queue *Queue, u32 Count)
+{
+	Assert(Queue);
+
+	if (!Count)
+		return;
+
+	// NOTE(ivan): Entries must be visible before the sleepers are counted, pairs with the barrier in LinuxParkWorkQueueWorker().
+	CompletePastWritesBeforeFutureReads();
+	if (Queue->NumSleepers) {
+		AtomicAddU32(&Queue->WakeEpoch, 1);
+		WakeOnAddressU32(&Queue->WakeEpoch, Count);
+	}
+}
+
+static void
+LinuxParkWorkQueueWorker(work_queue *Queue)
+{
+	Assert(Queue);
+
+	// NOTE(ivan): Counted as a sleeper before taking the last look, so an entry added meanwhile
+	// is either seen here, or bumps the epoch and the wait returns right away.
+	u32 Epoch = Queue->WakeEpoch;
+	AtomicAddU32(&Queue->NumSleepers, 1);
+	if (!Queue->Quit && !LinuxHasWorkQueueEntries(Queue))
+		WaitOnAddressU32(&Queue->WakeEpoch, Epoch);
+	AtomicAddU32(&Queue->NumSleepers, (u32)-1);
+}
+
+static work_fiber *
+LinuxAllocateWorkFiber(work_queue *Queue)
+{
+	Assert(Queue);
+
+	EnterTicketMutex(&Queue->FiberMutex);
+	work_fiber *Result = Queue->FirstFreeFiber;
+	if (Result)
+		Queue->FirstFreeFiber = Result->Next;
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	return Result;
+}
+
+static void
+LinuxFreeWorkFiber(work_fiber *Fiber)
+{
+	Assert(Fiber);
+
+	work_queue *Queue = Fiber->Queue;
+	EnterTicketMutex(&Queue->FiberMutex);
+	Fiber->Next = Queue->FirstFreeFiber;
+	Queue->FirstFreeFiber = Fiber;
+	LeaveTicketMutex(&Queue->FiberMutex);
+}
+
+static void
+LinuxPushReadyWorkFiber(work_fiber *Fiber)
+{
+	Assert(Fiber);
+
+	work_queue *Queue = Fiber->Queue;
+	EnterTicketMutex(&Queue->FiberMutex);
+	Fiber->Next = 0;
+	if (Queue->LastReadyFiber)
+		Queue->LastReadyFiber->Next = Fiber;
+	else
+		Queue->FirstReadyFiber = Fiber;
+	Queue->LastReadyFiber = Fiber;
+	Queue->NumReadyFibers++;
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	LinuxWakeWorkQueueWorkers(Queue, 1);
+}
+
+static work_fiber *
+LinuxPopReadyWorkFiber(work_queue *Queue)
+{
+	Assert(Queue);
+
+	// NOTE(ivan): Do not take the lock just to find out there is nothing.
+	if (!Queue->NumReadyFibers)
+		return 0;
+
+	EnterTicketMutex(&Queue->FiberMutex);
+	work_fiber *Result = Queue->FirstReadyFiber;
+	if (Result) {
+		Queue->FirstReadyFiber = Result->Next;
+		if (!Queue->FirstReadyFiber)
+			Queue->LastReadyFiber = 0;
+		Queue->NumReadyFibers--;
+	}
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	return Result;
+}
+
+// NOTE(ivan): Never inlined, since code running on a fiber may find itself on another thread between two calls.
+static NoInline work_profile_buffer *
+LinuxGetWorkProfileBuffer(void)
+{
+	work_profile_buffer *Buffer = LinuxWorkProfileBuffer;
+	if (Buffer)
+		return Buffer;
+
+	Buffer = (work_profile_buffer *)LinuxAllocateMemory(sizeof(work_profile_buffer));
+	if (!Buffer)
+		return 0;
+
+	Buffer->ThreadID = (u32)syscall(SYS_gettid);
+	work_queue_worker *Worker = LinuxCurrentWorker;
+	if (Worker)
+		snprintf(Buffer->ThreadName, CountOf(Buffer->ThreadName) - 1, "%s worker %u",
+				 Worker->Queue->Name, (u32)(Worker - Worker->Queue->Workers));
+	else if (Buffer->ThreadID == (u32)getpid())
+		strcpy(Buffer->ThreadName, "Main thread");
+	else
+		snprintf(Buffer->ThreadName, CountOf(Buffer->ThreadName) - 1, "Thread %u", Buffer->ThreadID);
+
+	AddWorkProfileBuffer(&LinuxWorkProfiler, Buffer);
+	LinuxWorkProfileBuffer = Buffer;
+	return Buffer;
+}
+
+static void
+LinuxRecordWorkProfileEvent(work_queue *Queue, work_queue_entry *Entry, u64 BeginTicks)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	work_profile_buffer *Buffer = LinuxGetWorkProfileBuffer();
+	if (Buffer)
+		RecordWorkProfileEvent(Buffer, Entry, Queue->Name, BeginTicks, LinuxGetClockTicks());
+}
+
+static void
+LinuxFinishWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	Entry->Callback(Queue, Entry->Data);
+
+	// NOTE(ivan): The group may be gone as soon as its last entry is done, so nothing but the wake touches it afterwards.
+	// A suspended fiber is the exception: it cannot leave till resumed, and the group stays alive on its stack.
+	if (Entry->Group) {
+		work_group *Group = Entry->Group;
+		u32 OrigState = AtomicAddU32(&Group->State, (u32)-1);
+		if (OrigState & WORK_GROUP_WAITING)
+			WakeOnAddressU32(&Group->State);
+		else if ((OrigState & WORK_GROUP_FIBER_WAITING) && (OrigState & WORK_GROUP_PENDING_MASK) == 1)
+			LinuxPushReadyWorkFiber(Group->Fiber);
+	}
+
+	AtomicIncrementU32(&Queue->CompletionCount);
+}
+
+// NOTE(ivan): Entry point of every fiber, reached once since fibers are reused.
+// Nothing thread-local is touched past the first switch, as the fiber may come back on another thread.
+static void
+LinuxWorkFiberProc(void)
+{
+	work_fiber *Fiber = LinuxCurrentFiber;
+	for (;;) {
+		LinuxFinishWorkQueueEntry(Fiber->Queue, &Fiber->Entry);
+
+		Fiber->State = WorkFiberState_Done;
+		swapcontext(&Fiber->Context, &Fiber->Worker->SchedulerContext);
+	}
+}
+
+// NOTE(ivan): Runs the fiber on the calling worker till it is done or suspended.
+static void
+LinuxSwitchToWorkFiber(work_queue_worker *Worker, work_fiber *Fiber)
+{
+	Assert(Worker);
+	Assert(Fiber);
+	Assert(!LinuxCurrentFiber);
+
+	for (;;) {
+		// NOTE(ivan): Every run of the fiber till it is done or suspended is a separate event.
+		b32 IsProfiling = LinuxWorkProfiler.IsCapturing;
+		u64 BeginTicks = IsProfiling ? LinuxGetClockTicks() : 0;
+
+		Fiber->Worker = Worker;
+		Fiber->State = WorkFiberState_Running;
+		LinuxCurrentFiber = Fiber;
+		swapcontext(&Worker->SchedulerContext, &Fiber->Context);
+		LinuxCurrentFiber = 0;
+
+		if (IsProfiling)
+			LinuxRecordWorkProfileEvent(Fiber->Queue, &Fiber->Entry, BeginTicks);
+
+		if (Fiber->State == WorkFiberState_Done) {
+			LinuxFreeWorkFiber(Fiber);
+			return;
+		}
+
+		// NOTE(ivan): The wait is published only now that the fiber is switched out,
+		// so whoever finishes the group's last entry never resumes a fiber that is still running.
+		Assert(Fiber->State == WorkFiberState_Waiting);
+		work_group *Group = Fiber->WaitGroup;
+		Group->Fiber = Fiber;
+		for (;;) {
+			u32 State = Group->State;
+			Assert(!(State & (WORK_GROUP_WAITING | WORK_GROUP_FIBER_WAITING)));
+			if (!(State & WORK_GROUP_PENDING_MASK))
+				break; // NOTE(ivan): Done in the meantime, resume right away.
+			if (AtomicCompareExchangeU32(&Group->State, State | WORK_GROUP_FIBER_WAITING, State) == State)
+				return;
+		}
+	}
+}
+
+// NOTE(ivan): Runs the entry right on the calling thread, recording it if the profiler is capturing.
+static void
+LinuxRunWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	b32 IsProfiling = LinuxWorkProfiler.IsCapturing;
+	u64 BeginTicks = IsProfiling ? LinuxGetClockTicks() : 0;
+
+	LinuxFinishWorkQueueEntry(Queue, Entry);
+
+	if (IsProfiling)
+		LinuxRecordWorkProfileEvent(Queue, Entry, BeginTicks);
+}
+
 static b32
 LinuxDoNextWorkQueueEntry(work_queue *Queue)
 {
 	Assert(Queue);
 
-	b32 ShouldSleep = false;
-
-	u32 OrigNextEntryToRead = Queue->NextEntryToRead;
-	u32 NewNextEntryToRead = (OrigNextEntryToRead + 1) % CountOf(Queue->Entries);
-	if (OrigNextEntryToRead != Queue->NextEntryToWrite) {
-		u32 Index = AtomicCompareExchangeU32(&Queue->NextEntryToRead,
-											 NewNextEntryToRead,
-											 OrigNextEntryToRead);
-		if (Index == OrigNextEntryToRead) {
-			work_queue_entry Entry = Queue->Entries[Index];
-			Entry.Callback(Queue, Entry.Data);
-			AtomicIncrementU32(&Queue->CompletionCount);
+	work_queue_worker *Worker = LinuxCurrentWorker;
+	if (Worker && Worker->Queue != Queue)
+		Worker = 0;
+
+	// NOTE(ivan): Fibers run on the queue's own workers only, and are never switched to from inside of another fiber.
+	b32 CanSwitchFibers = (Worker && !LinuxCurrentFiber);
+
+	// NOTE(ivan): Suspended fibers come first, they hold on to their stacks till done.
+	if (CanSwitchFibers) {
+		work_fiber *Fiber = LinuxPopReadyWorkFiber(Queue);
+		if (Fiber) {
+			LinuxSwitchToWorkFiber(Worker, Fiber);
+			return false;
 		}
-	} else {
-		ShouldSleep = true;
 	}
 
+	// NOTE(ivan): Own entries first, they are the most cache-warm, then outside ones, then other workers' ones,
+	// and background ones only once there is nothing else.
+	work_queue_entry Entry;
+	b32 Found = (Worker && PopWorkDeque(&Worker->Deque, &Entry));
+	if (!Found)
+		Found = PopWorkRing(&Queue->Ring, &Entry);
+	if (!Found)
+		Found = LinuxPopWorkQueueOverflow(Queue, &Entry);
+	if (!Found)
+		Found = LinuxStealWorkQueueEntry(Queue, Worker, &Entry);
+	if (!Found)
+		Found = PopWorkHeap(&Queue->Heap, &Entry);
+
+	if (Found) {
+		// NOTE(ivan): Out of fibers, the entry runs on the thread and its waits block it.
+		work_fiber *Fiber = (Entry.RunOnFiber && CanSwitchFibers) ? LinuxAllocateWorkFiber(Queue) : 0;
+		if (Fiber) {
+			Fiber->Entry = Entry;
+			LinuxSwitchToWorkFiber(Worker, Fiber);
+		} else {
+			LinuxRunWorkQueueEntry(Queue, &Entry);
+		}
+	}
+
+	b32 ShouldSleep = !Found;
 	return ShouldSleep;
 }
 
+// NOTE(ivan): Reads a single integer from the CPU's sysfs topology directory, returns -1 if unavailable.
+static s32
+LinuxReadCPUTopologyValue(u32 CPU, const char *Name)
+{
+	char Path[128] = {};
+	snprintf(Path, CountOf(Path) - 1, "/sys/devices/system/cpu/cpu%u/topology/%s", CPU, Name);
+
+	s32 Result = -1;
+	int File = open(Path, O_RDONLY);
+	if (File != -1) {
+		char Buffer[32] = {};
+		if (read(File, Buffer, CountOf(Buffer) - 1) > 0)
+			Result = atoi(Buffer);
+		close(File);
+	}
+
+	return Result;
+}
+
+static void
+LinuxDetectCPUTopology(cpu_topology *Topology)
+{
+	Assert(Topology);
+
+	memset(Topology, 0, sizeof(*Topology));
+
+	// NOTE(ivan): Only CPUs we are allowed to run on count, taskset and cgroup cpusets shrink this.
+	cpu_set_t Allowed;
+	CPU_ZERO(&Allowed);
+	if (sched_getaffinity(0, sizeof(Allowed), &Allowed) != 0) {
+		long NumOnline = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long CPU = 0; CPU < Max(NumOnline, 1L) && CPU < CPU_SETSIZE; CPU++)
+			CPU_SET(CPU, &Allowed);
+	}
+
+	// NOTE(ivan): Package and core IDs together identify a physical core, its SMT siblings share them.
+	u64 CoreKeys[MAX_CPU_CORES];
+	for (u32 CPU = 0; CPU < CPU_SETSIZE; CPU++) {
+		if (!CPU_ISSET(CPU, &Allowed))
+			continue;
+		Topology->NumLogicalCPUs++;
+
+		s32 PackageID = LinuxReadCPUTopologyValue(CPU, "physical_package_id");
+		s32 CoreID = LinuxReadCPUTopologyValue(CPU, "core_id");
+
+		// NOTE(ivan): No sysfs topology (some containers), so every logical CPU is its own core.
+		u64 Key;
+		if (PackageID < 0 || CoreID < 0)
+			Key = ((u64)1 << 63) | CPU;
+		else
+			Key = ((u64)(u32)PackageID << 32) | (u32)CoreID;
+
+		u32 Core = 0;
+		while (Core < Topology->NumCores && CoreKeys[Core] != Key)
+			Core++;
+		if (Core == Topology->NumCores) {
+			if (Topology->NumCores == MAX_CPU_CORES)
+				continue;
+			CoreKeys[Core] = Key;
+			CPU_ZERO(&Topology->CoreCPUs[Core]);
+			Topology->NumCores++;
+		}
+
+		CPU_SET(CPU, &Topology->CoreCPUs[Core]);
+	}
+
+	if (!Topology->NumLogicalCPUs) {
+		Topology->NumLogicalCPUs = Topology->NumCores = 1;
+		CPU_ZERO(&Topology->CoreCPUs[0]);
+		CPU_SET(0, &Topology->CoreCPUs[0]);
+	}
+}
+
 static void *
 LinuxWorkQueueProc(void *Param)
 {
-	work_queue_startup *Startup = (work_queue_startup *)Param;
-	work_queue *Queue = Startup->Queue;
+	work_queue_worker *Worker = (work_queue_worker *)Param;
+	work_queue *Queue = Worker->Queue;
+	LinuxCurrentWorker = Worker;
+
+	// NOTE(ivan): SCHED_IDLE is per-thread on Linux, so it is set from the worker itself.
+	if (Queue->IsLowPriority) {
+		struct sched_param SchedParam = {};
+		if (sched_setscheduler(0, SCHED_IDLE, &SchedParam) != 0)
+			setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+	}
 
-	while (true) {
-		if (LinuxDoNextWorkQueueEntry(Queue))
-			sem_wait(&Queue->Semaphore);
+	// NOTE(ivan): Every worker gets its own scratch stack up front.
+	LinuxGetThreadScratch();
+
+	u32 Spin = 0;
+	while (!Queue->Quit) {
+		if (!LinuxDoNextWorkQueueEntry(Queue)) {
+			Spin = 0;
+		} else if (Spin < WORK_QUEUE_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else {
+			LinuxParkWorkQueueWorker(Queue);
+			Spin = 0;
+		}
 	}
+
+	// NOTE(ivan): Released, give the scratch stack back. FreeMemoryStack() needs nothing but the deallocators.
+	platform_api PlatformAPI = {};
+	PlatformAPI.DeallocateMemory = LinuxDeallocateMemory;
+	PlatformAPI.ReleaseMemory = LinuxReleaseMemory;
+	FreeMemoryStack(&PlatformAPI, LinuxGetThreadScratch());
+
+	LinuxCurrentWorker = 0;
+	return 0;
 }
 
+// NOTE(ivan): If Topology is given, worker N is pinned to the SMT siblings of physical core N + FirstCore,
+// wrapping around once cores run out. Otherwise workers are left to the scheduler.
 static void
 LinuxInitializeWorkQueue(platform_state *PlatformState,
 						 work_queue *Queue,
-						 u32 ThreadCount)
+						 const char *Name,
+						 u32 ThreadCount,
+						 cpu_topology *Topology = 0,
+						 u32 FirstCore = 0,
+						 b32 IsLowPriority = false)
 {
 	Assert(PlatformState);
 	Assert(Queue);
+	Assert(Name);
 	Assert(ThreadCount);
 
+	Queue->Name = Name;
 	Queue->CompletionGoal = Queue->CompletionCount = 0;
-	Queue->NextEntryToWrite = Queue->NextEntryToRead = 0;
+	Queue->IsLowPriority = IsLowPriority;
+
+	Queue->WakeEpoch = Queue->NumSleepers = 0;
+	Queue->Quit = false;
 
-	u32 InitialCount = 0;
-	sem_init(&Queue->Semaphore, 0, InitialCount);
+	if (!InitializeWorkRing(&Queue->Ring, LinuxAllocateMemory, WORK_QUEUE_RING_ENTRIES))
+		LinuxError(PlatformState, "Failed allocating resources for work queue!");
+
+	Queue->OverflowMutex = {};
+	Queue->NumOverflowEntries = Queue->FirstOverflowEntry = 0;
+	Queue->MaxOverflowEntries = WORK_QUEUE_INITIAL_ENTRIES;
+	Queue->OverflowEntries = (work_queue_entry *)LinuxAllocateMemory(sizeof(work_queue_entry) * Queue->MaxOverflowEntries);
+	if (!Queue->OverflowEntries)
+		LinuxError(PlatformState, "Failed allocating resources for work queue!");
+
+	if (!InitializeWorkHeap(&Queue->Heap, LinuxAllocateMemory, WORK_QUEUE_INITIAL_ENTRIES))
+		LinuxError(PlatformState, "Failed allocating resources for work queue!");
 
-	Queue->Startups = (work_queue_startup *)LinuxAllocateMemory(sizeof(work_queue_startup) * ThreadCount);
-	if (!Queue->Startups)
+	// NOTE(ivan): All deques must exist before the first worker starts stealing from them.
+	Queue->NumWorkers = ThreadCount;
+	Queue->Workers = (work_queue_worker *)LinuxAllocateMemory(sizeof(work_queue_worker) * ThreadCount);
+	if (!Queue->Workers)
 		LinuxError(PlatformState, "Failed allocating resources for work queue!");
 	for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++) {
-		Queue->Startups[ThreadIndex].Queue = Queue;
+		Queue->Workers[ThreadIndex].Queue = Queue;
+		if (!InitializeWorkDeque(&Queue->Workers[ThreadIndex].Deque, LinuxAllocateMemory, WORK_QUEUE_INITIAL_ENTRIES))
+			LinuxError(PlatformState, "Failed allocating resources for work queue!");
+	}
 
+	// NOTE(ivan): Fibers start out free, each one on its own stack with a guard page below.
+	uptr FiberSlotBytes = WORK_FIBER_STACK_SIZE + PLATFORM_MEMORY_PAGE_BYTES;
+	Queue->FiberMutex = {};
+	Queue->FirstFreeFiber = Queue->FirstReadyFiber = Queue->LastReadyFiber = 0;
+	Queue->NumReadyFibers = 0;
+	Queue->Fibers = (work_fiber *)LinuxAllocateMemory(sizeof(work_fiber) * WORK_QUEUE_FIBERS);
+	Queue->FiberStacks = (u8 *)LinuxReserveMemory(FiberSlotBytes * WORK_QUEUE_FIBERS, 0);
+	if (!Queue->Fibers || !Queue->FiberStacks)
+		LinuxError(PlatformState, "Failed allocating resources for work queue!");
+	for (u32 FiberIndex = 0; FiberIndex < WORK_QUEUE_FIBERS; FiberIndex++) {
+		work_fiber *Fiber = Queue->Fibers + FiberIndex;
+		u8 *Stack = Queue->FiberStacks + FiberSlotBytes * FiberIndex + PLATFORM_MEMORY_PAGE_BYTES;
+		if (!LinuxCommitMemory(Stack, WORK_FIBER_STACK_SIZE))
+			LinuxError(PlatformState, "Failed allocating resources for work queue!");
+
+		getcontext(&Fiber->Context);
+		Fiber->Context.uc_stack.ss_sp = Stack;
+		Fiber->Context.uc_stack.ss_size = WORK_FIBER_STACK_SIZE;
+		Fiber->Context.uc_link = 0;
+		makecontext(&Fiber->Context, LinuxWorkFiberProc, 0);
+
+		Fiber->Queue = Queue;
+		Fiber->Next = Queue->FirstFreeFiber;
+		Queue->FirstFreeFiber = Fiber;
+	}
+
+	for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++) {
 		pthread_attr_t ThreadAttr;
 		pthread_attr_init(&ThreadAttr);
-		pthread_attr_setdetachstate(&ThreadAttr, PTHREAD_CREATE_DETACHED);
+		if (Topology) {
+			cpu_set_t *CoreCPUs = &Topology->CoreCPUs[(FirstCore + ThreadIndex) % Topology->NumCores];
+			pthread_attr_setaffinity_np(&ThreadAttr, sizeof(*CoreCPUs), CoreCPUs);
+		}
 
-		pthread_t Thread;
-		int Result = pthread_create(&Thread, &ThreadAttr, LinuxWorkQueueProc, &Queue->Startups[ThreadIndex]);
+		if (pthread_create(&Queue->Workers[ThreadIndex].Thread, &ThreadAttr, LinuxWorkQueueProc, &Queue->Workers[ThreadIndex]) != 0)
+			LinuxError(PlatformState, "Failed creating work queue thread!");
 		pthread_attr_destroy(&ThreadAttr);
 	}
 }
 
+// NOTE(ivan): Entries still queued are dropped, complete the queue first if they matter.
 static void
 LinuxReleaseWorkQueue(work_queue *Queue)
 {
 	Assert(Queue);
-	LinuxDeallocateMemory(Queue->Startups);
+
+	// NOTE(ivan): Quit must be visible before the epoch moves, so a worker that parks meanwhile
+	// either sees it or gets woken. Nothing may be freed until every worker is gone.
+	Queue->Quit = true;
+	CompletePastWritesBeforeFutureWrites();
+	AtomicAddU32(&Queue->WakeEpoch, 1);
+	WakeOnAddressU32(&Queue->WakeEpoch);
+	for (u32 ThreadIndex = 0; ThreadIndex < Queue->NumWorkers; ThreadIndex++)
+		pthread_join(Queue->Workers[ThreadIndex].Thread, 0);
+
+	for (u32 ThreadIndex = 0; ThreadIndex < Queue->NumWorkers; ThreadIndex++)
+		FreeWorkDeque(&Queue->Workers[ThreadIndex].Deque, LinuxDeallocateMemory);
+	LinuxDeallocateMemory(Queue->Workers);
+	FreeWorkRing(&Queue->Ring, LinuxDeallocateMemory);
+	LinuxDeallocateMemory(Queue->OverflowEntries);
+	FreeWorkHeap(&Queue->Heap, LinuxDeallocateMemory);
+	LinuxDeallocateMemory(Queue->Fibers);
+	LinuxReleaseMemory(Queue->FiberStacks, (WORK_FIBER_STACK_SIZE + PLATFORM_MEMORY_PAGE_BYTES) * WORK_QUEUE_FIBERS);
+}
+
+// NOTE(ivan): Any thread may add entries, so counters are bumped atomically and before the entry is visible.
+static void
+LinuxCountWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	AtomicIncrementU32(&Queue->CompletionGoal);
+	if (Entry->Group) {
+		Assert((Entry->Group->State & WORK_GROUP_PENDING_MASK) != WORK_GROUP_PENDING_MASK);
+		AtomicIncrementU32(&Entry->Group->State);
+	}
+}
+
+// NOTE(ivan): Returns false if out of memory, the entry is counted but not added then.
+static b32
+LinuxPushWorkQueueEntry(work_queue *Queue, work_queue_entry Entry)
+{
+	Assert(Queue);
+	Assert(Entry.Callback);
+
+	LinuxCountWorkQueueEntry(Queue, &Entry);
+
+	// NOTE(ivan): A worker keeps what its own jobs add, others will steal it if it is busy for too long.
+	work_queue_worker *Worker = LinuxCurrentWorker;
+	b32 Result = (Worker && Worker->Queue == Queue && PushWorkDeque(&Worker->Deque, Entry, LinuxAllocateMemory));
+	if (!Result)
+		Result = PushWorkRing(&Queue->Ring, Entry);
+	if (!Result)
+		Result = LinuxPushWorkQueueOverflow(Queue, Entry);
+
+	return Result;
+}
+
+PLATFORM_ADD_WORK_QUEUE_ENTRIES(LinuxAddWorkQueueEntries)
+{
+	Assert(Queue);
+	Assert(Entries);
+
+	u32 NumAdded = 0;
+	for (u32 Index = 0; Index < Count; Index++) {
+		if (LinuxPushWorkQueueEntry(Queue, Entries[Index])) {
+			NumAdded++;
+		} else {
+			// NOTE(ivan): Out of memory, do the job right here rather than lose it, after waking others for what is added so far.
+			LinuxWakeWorkQueueWorkers(Queue, NumAdded);
+			NumAdded = 0;
+			LinuxFinishWorkQueueEntry(Queue, Entries + Index);
+		}
+	}
+
+	LinuxWakeWorkQueueWorkers(Queue, NumAdded);
 }
 
 PLATFORM_ADD_WORK_QUEUE_ENTRY(LinuxAddWorkQueueEntry)
 {
 	Assert(Queue);
 	Assert(Callback);
-	
-	// TODO(ivan): Switch to AtomicCompareExchange() eventually so that any thread can add?
-	u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % CountOf(Queue->Entries);
-	Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
-
-	work_queue_entry *Entry = Queue->Entries + Queue->NextEntryToWrite;
-	Entry->Callback = Callback;
-	Entry->Data = Data;
-	Queue->CompletionGoal++;
-	CompletePastWritesBeforeFutureWrites();
 
-	Queue->NextEntryToWrite = NewNextEntryToWrite;
-	sem_post(&Queue->Semaphore);
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = false;
+	Entry.Name = 0;
+
+	LinuxAddWorkQueueEntries(Queue, &Entry, 1);
+}
+
+PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(LinuxAddFiberWorkQueueEntry)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = true;
+	Entry.Name = 0;
+
+	LinuxAddWorkQueueEntries(Queue, &Entry, 1);
+}
+
+PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(LinuxAddBackgroundWorkQueueEntry)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = false;
+	Entry.Name = 0;
+
+	LinuxCountWorkQueueEntry(Queue, &Entry);
+	if (PushWorkHeap(&Queue->Heap, Entry, Priority, DeadlineFrames, LinuxAllocateMemory, LinuxDeallocateMemory))
+		LinuxWakeWorkQueueWorkers(Queue, 1);
+	else
+		LinuxFinishWorkQueueEntry(Queue, &Entry); // NOTE(ivan): Out of memory, do the job right here rather than lose it.
+}
+
+// NOTE(ivan): Called by the main thread once a frame, starts the queue's next frame and does background entries.
+// Entries that are due are all done whatever the budget, so a frame running late cannot starve them,
+// the rest are done while SecondsLeft lasts. An entry is never cut short, so the last one may overrun the budget.
+static void
+LinuxEndWorkQueueFrame(work_queue *Queue, f32 SecondsLeft)
+{
+	Assert(Queue);
+
+	AdvanceWorkHeapFrame(&Queue->Heap);
+
+	struct timespec Start = LinuxGetClock();
+	work_queue_entry Entry;
+	while (PopWorkHeap(&Queue->Heap, &Entry, true))
+		LinuxRunWorkQueueEntry(Queue, &Entry);
+	while (LinuxGetSecondsElapsed(Start, LinuxGetClock()) < SecondsLeft && PopWorkHeap(&Queue->Heap, &Entry))
+		LinuxRunWorkQueueEntry(Queue, &Entry);
 }
 
+// NOTE(ivan): Counters are never reset, since other threads may be adding entries at any time.
 PLATFORM_COMPLETE_WORK_QUEUE(LinuxCompleteWorkQueue)
 {
+	Assert(Queue);
+
 	while (Queue->CompletionGoal != Queue->CompletionCount)
 		LinuxDoNextWorkQueueEntry(Queue);
+}
 
-	Queue->CompletionGoal = Queue->CompletionCount = 0;
+PLATFORM_WAIT_FOR_WORK_GROUP(LinuxWaitForWorkGroup)
+{
+	Assert(Queue);
+	Assert(Group);
+
+	// NOTE(ivan): Inside of a fiber, switch back to the worker and let it do something else till the group is done.
+	work_fiber *Fiber = LinuxCurrentFiber;
+	if (Fiber) {
+		if (Group->State & WORK_GROUP_PENDING_MASK) {
+			Fiber->State = WorkFiberState_Waiting;
+			Fiber->WaitGroup = Group;
+			swapcontext(&Fiber->Context, &Fiber->Worker->SchedulerContext);
+		}
+
+		AtomicCompareExchangeU32(&Group->State, 0, WORK_GROUP_FIBER_WAITING);
+		return;
+	}
+
+	u32 Spin = 0;
+	for (;;) {
+		u32 State = Group->State;
+		if (!(State & WORK_GROUP_PENDING_MASK))
+			break;
+
+		// NOTE(ivan): Help out with whatever is there, it may well be the group's own entries.
+		if (!LinuxDoNextWorkQueueEntry(Queue)) {
+			Spin = 0;
+		} else if (Spin < MUTEX_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else if (!(State & WORK_GROUP_WAITING)) {
+			AtomicCompareExchangeU32(&Group->State, State | WORK_GROUP_WAITING, State);
+		} else {
+			// NOTE(ivan): Nothing to do but the group's entries others are running, sleep till one of them is done.
+			WaitOnAddressU32(&Group->State, State);
+		}
+	}
+
+	// NOTE(ivan): Spare future entries the wakes, unless the group has been reused already.
+	AtomicCompareExchangeU32(&Group->State, 0, WORK_GROUP_WAITING);
+}
+
+// NOTE(ivan): Work queue callback of a single parallel-for range.
+static WORK_QUEUE_CALLBACK(LinuxDoParallelForRange)
+{
+	parallel_for_range *Range = (parallel_for_range *)Data;
+	parallel_for_job *Job = Range->Job;
+
+	// NOTE(ivan): Halving a u32 range takes 32 splits at most, and all of them are added at the cost of a single wake.
+	work_queue_entry Splits[32];
+	u32 NumSplits = 0;
+
+	u32 First = Range->First;
+	u32 OnePastLast = Range->OnePastLast;
+	while (OnePastLast - First > Job->Grain && NumSplits < CountOf(Splits)) {
+		u32 RangeIndex = AtomicAddU32(&Job->NumRanges, 1);
+		if (RangeIndex >= MAX_PARALLEL_FOR_RANGES)
+			break; // NOTE(ivan): Out of ranges, do all of what is left here.
+
+		u32 Middle = First + (OnePastLast - First) / 2;
+		parallel_for_range *Upper = Job->Ranges + RangeIndex;
+		Upper->Job = Job;
+		Upper->First = Middle;
+		Upper->OnePastLast = OnePastLast;
+
+		work_queue_entry *Split = Splits + NumSplits++;
+		Split->Callback = LinuxDoParallelForRange;
+		Split->Data = Upper;
+		Split->Group = &Job->Group;
+		Split->RunOnFiber = false;
+		Split->Name = "ParallelFor";
+
+		OnePastLast = Middle;
+	}
+	LinuxAddWorkQueueEntries(Queue, Splits, NumSplits);
+
+	Job->Callback(Job->Data, First, OnePastLast);
+}
+
+PLATFORM_PARALLEL_FOR(LinuxParallelFor)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	if (!Count)
+		return;
+
+	// NOTE(ivan): Grain adapts to the number of threads, but never goes below the one asked for.
+	u32 NumThreads = Queue->NumWorkers + 1;
+	u32 Grain = Max(Max(MinGrain, Count / (NumThreads * PARALLEL_FOR_RANGES_PER_THREAD)), 1u);
+	if (Count <= Grain) {
+		Callback(Data, 0, Count);
+		return;
+	}
+
+	parallel_for_job Job;
+	Job.Callback = Callback;
+	Job.Data = Data;
+	Job.Grain = Grain;
+	Job.Group = {};
+	Job.NumRanges = 1;
+	Job.Ranges[0].Job = &Job;
+	Job.Ranges[0].First = 0;
+	Job.Ranges[0].OnePastLast = Count;
+
+	// NOTE(ivan): The calling thread takes the whole range itself, splitting it off to others as it goes.
+	LinuxDoParallelForRange(Queue, Job.Ranges);
+	LinuxWaitForWorkGroup(Queue, &Job.Group);
 }
 
 PLATFORM_READ_ENTIRE_FILE(LinuxReadEntireFile)
@@ -290,7 +1421,7 @@ PLATFORM_WRITE_ENTIRE_FILE(LinuxWriteEntireFile)
 
 	b32 Result = false;
 	
-	int File = open(FileName, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+	int File = open(FileName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
 	if (File != -1) {
 		ssize_t BytesWritten = write(File, Memory, Bytes);
 		if (fsync(File) >= 0)
@@ -663,10 +1794,11 @@ LinuxResizeSurfaceBuffer(platform_state *PlatformState,
 		shmdt(Buffer->SegmentInfo.shmaddr);
 		shmctl(Buffer->SegmentInfo.shmid, IPC_RMID, 0);
 
-		LinuxDeallocateMemory(Buffer->Pixels);
+		LinuxReleaseMemory(Buffer->Pixels, Buffer->PixelsBytes);
 		
 		Buffer->Image = 0;
 		Buffer->Pixels = 0;
+		Buffer->PixelsBytes = 0;
 	}
 
 	static const s32 BytesPerPixel = 4; // NOTE(ivan): Hardcoded 32-bit color.
@@ -689,7 +1821,11 @@ LinuxResizeSurfaceBuffer(platform_state *PlatformState,
 		XShmAttach(PlatformState->XDisplay,
 				   &Buffer->SegmentInfo);
 
-		Buffer->Pixels = LinuxAllocateMemory(NewWidth * NewHeight * BytesPerPixel);
+		// NOTE(ivan): Surface is touched all over every frame, huge pages save a lot of TLB misses here.
+		Buffer->PixelsBytes = NewWidth * NewHeight * BytesPerPixel;
+		Buffer->Pixels = LinuxReserveMemory(Buffer->PixelsBytes, PlatformMemoryFlag_LargePages);
+		if (!Buffer->Pixels || !LinuxCommitMemory(Buffer->Pixels, AlignPow2(Buffer->PixelsBytes, PLATFORM_MEMORY_PAGE_BYTES)))
+			LinuxError(PlatformState, "Failed allocating surface buffer memory!");
 		LinuxLog(PlatformState, "Surface buffer (%dx%d) created.", NewWidth, NewHeight);
 	}
 	
@@ -789,6 +1925,320 @@ LinuxCreateNullCursor(Display *XDisplay, Window RootWindow)
 	return Result;
 }
 
+// NOTE(ivan): Starts a work queues' profile capture, or stops the running one and writes it out next to the log.
+static void
+LinuxToggleWorkProfileCapture(platform_state *PlatformState)
+{
+	Assert(PlatformState);
+
+	if (!LinuxWorkProfiler.IsCapturing) {
+		StartWorkProfileCapture(&LinuxWorkProfiler, LinuxGetClockTicks());
+		LinuxLog(PlatformState, "Work queues profile capture started.");
+		return;
+	}
+
+	LinuxWorkProfiler.IsCapturing = false;
+
+	char FileName[sizeof(PlatformState->ExeNameNoExt) + sizeof("_jobs.json")] = {};
+	snprintf(FileName, CountOf(FileName) - 1, "%s_jobs.json", PlatformState->ExeNameNoExt);
+
+	piece Trace = FormatWorkProfileTrace(&LinuxWorkProfiler, 1000000000ull, LinuxAllocateMemory, LinuxDeallocateMemory);
+	if (Trace.Memory && LinuxWriteEntireFile(FileName, Trace.Memory, SafeTruncateU64(Trace.Bytes)))
+		LinuxLog(PlatformState, "Work queues profile capture written to '%s'.", FileName);
+	else
+		LinuxLog(PlatformState, "Failed writing work queues profile capture to '%s'!", FileName);
+
+	if (Trace.Memory)
+		LinuxDeallocateMemory(Trace.Memory);
+}
+
+#if INTERNAL
+// NOTE(ivan): Pool stress benchmark parameters, see LinuxBenchmarkPools().
+#define BENCH_POOL_THREADS 8
+#define BENCH_POOL_ITERATIONS 250000
+#define BENCH_POOL_LIVE_BLOCKS 64
+#define BENCH_POOL_SHARED_BLOCKS 256
+#define BENCH_POOL_BLOCK_SIZE 48
+
+struct linux_bench_pool_startup {
+	platform_state *PlatformState;
+	platform_api *PlatformAPI;
+
+	// NOTE(ivan): Exactly one of these is set.
+	memory_pool *Pool;
+	concurrent_memory_pool *ConcurrentPool;
+
+	// NOTE(ivan): Blocks handed over between threads, so frees happen on foreign threads too.
+	volatile u64 *SharedBlocks;
+	u32 Seed;
+};
+
+inline void *
+LinuxBenchPoolPush(linux_bench_pool_startup *Startup)
+{
+	if (Startup->Pool)
+		return PushPoolSize(Startup->PlatformState, Startup->PlatformAPI, Startup->Pool);
+	return PushConcurrentPoolSize(Startup->PlatformState, Startup->PlatformAPI, Startup->ConcurrentPool);
+}
+
+inline void
+LinuxBenchPoolFree(linux_bench_pool_startup *Startup, void *Address)
+{
+	if (Startup->Pool)
+		FreePoolSize(Startup->Pool, Address);
+	else
+		FreeConcurrentPoolSize(Startup->ConcurrentPool, Address);
+}
+
+static void *
+LinuxBenchPoolProc(void *Param)
+{
+	linux_bench_pool_startup *Startup = (linux_bench_pool_startup *)Param;
+
+	void *LiveBlocks[BENCH_POOL_LIVE_BLOCKS] = {};
+	u32 Random = Startup->Seed;
+	for (u32 Iteration = 0; Iteration < BENCH_POOL_ITERATIONS; Iteration++) {
+		Random = Random * 1664525 + 1013904223;
+		u32 Index = (Random >> 8) % BENCH_POOL_LIVE_BLOCKS;
+
+		if (!LiveBlocks[Index]) {
+			LiveBlocks[Index] = LinuxBenchPoolPush(Startup);
+			*(u32 *)LiveBlocks[Index] = Iteration;
+		} else if ((Random >> 24) & 3) {
+			LinuxBenchPoolFree(Startup, LiveBlocks[Index]);
+			LiveBlocks[Index] = 0;
+		} else {
+			// NOTE(ivan): Swap the block with a shared one and free whatever was there.
+			volatile u64 *Shared = Startup->SharedBlocks + ((Random >> 16) % BENCH_POOL_SHARED_BLOCKS);
+			u64 Other;
+			do {
+				Other = *Shared;
+			} while (AtomicCompareExchangeU64(Shared, (u64)(uptr)LiveBlocks[Index], Other) != Other);
+
+			if (Other)
+				LinuxBenchPoolFree(Startup, (void *)(uptr)Other);
+			LiveBlocks[Index] = 0;
+		}
+	}
+
+	for (u32 Index = 0; Index < BENCH_POOL_LIVE_BLOCKS; Index++)
+		LinuxBenchPoolFree(Startup, LiveBlocks[Index]);
+
+	return 0;
+}
+
+// NOTE(ivan): Allocator benchmark parameters, see LinuxBenchmarkAllocator().
+#define BENCH_ALLOC_THREADS 8
+#define BENCH_ALLOC_ROUNDS 50
+#define BENCH_ALLOC_LIVE_BLOCKS 4096
+
+struct linux_bench_alloc_startup {
+	b32 UseLibc;
+	u32 Seed;
+};
+
+// NOTE(ivan): Mimics load paths: lots of small token-sized blocks, some file-sized ones, all freed in bulk.
+static void *
+LinuxBenchAllocProc(void *Param)
+{
+	linux_bench_alloc_startup *Startup = (linux_bench_alloc_startup *)Param;
+
+	static ThreadLocal void *LiveBlocks[BENCH_ALLOC_LIVE_BLOCKS];
+	u32 Random = Startup->Seed;
+	for (u32 Round = 0; Round < BENCH_ALLOC_ROUNDS; Round++) {
+		for (u32 Index = 0; Index < BENCH_ALLOC_LIVE_BLOCKS; Index++) {
+			Random = Random * 1664525 + 1013904223;
+			uptr Bytes = ((Random >> 8) & 63) ? (16 + ((Random >> 16) & 255)) : (Kilobytes(4) + ((Random >> 12) & 0xFFFF));
+
+			// NOTE(ivan): calloc() is the fair libc counterpart, AllocateMemory() must return zeroed memory too.
+			LiveBlocks[Index] = Startup->UseLibc ? calloc(1, Bytes) : LinuxAllocateMemory(Bytes);
+			*(u8 *)LiveBlocks[Index] = (u8)Index;
+		}
+
+		for (u32 Index = 0; Index < BENCH_ALLOC_LIVE_BLOCKS; Index++) {
+			if (Startup->UseLibc)
+				free(LiveBlocks[Index]);
+			else
+				LinuxDeallocateMemory(LiveBlocks[Index]);
+		}
+	}
+
+	return 0;
+}
+
+// NOTE(ivan): Compares LinuxAllocateMemory() against libc on one and on several threads and logs the timings.
+static void
+LinuxBenchmarkAllocator(platform_state *PlatformState)
+{
+	Assert(PlatformState);
+
+	u32 ThreadCounts[] = {1, BENCH_ALLOC_THREADS};
+	for (u32 CountIndex = 0; CountIndex < CountOf(ThreadCounts); CountIndex++) {
+		u32 NumThreads = ThreadCounts[CountIndex];
+		for (u32 Pass = 0; Pass < 2; Pass++) {
+			b32 UseLibc = (Pass == 1);
+
+			linux_bench_alloc_startup Startups[BENCH_ALLOC_THREADS] = {};
+			pthread_t Threads[BENCH_ALLOC_THREADS];
+
+			struct timespec Start = LinuxGetClock();
+			for (u32 ThreadIndex = 0; ThreadIndex < NumThreads; ThreadIndex++) {
+				Startups[ThreadIndex].UseLibc = UseLibc;
+				Startups[ThreadIndex].Seed = ThreadIndex * 7919 + 1;
+				pthread_create(&Threads[ThreadIndex], 0, LinuxBenchAllocProc, &Startups[ThreadIndex]);
+			}
+			for (u32 ThreadIndex = 0; ThreadIndex < NumThreads; ThreadIndex++)
+				pthread_join(Threads[ThreadIndex], 0);
+			f32 Seconds = LinuxGetSecondsElapsed(Start, LinuxGetClock());
+
+			LinuxLog(PlatformState, "BenchAlloc: %s, %u threads x %u allocations, %.3f s, %.2f Mallocs/s",
+					 UseLibc ? "libc calloc" : "AllocateMemory",
+					 NumThreads, BENCH_ALLOC_ROUNDS * BENCH_ALLOC_LIVE_BLOCKS, Seconds,
+					 ((f32)NumThreads * BENCH_ALLOC_ROUNDS * BENCH_ALLOC_LIVE_BLOCKS) / (Seconds * 1000000.0f));
+		}
+	}
+}
+
+// NOTE(ivan): Runs mixed push/free traffic from several threads against the locked
+// memory_pool and the lock-free concurrent_memory_pool and logs their throughput.
+static void
+LinuxBenchmarkPools(platform_state *PlatformState, platform_api *PlatformAPI)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+
+	// NOTE(ivan): Lock-free pool goes first, the spinning locked one may take ages when threads outnumber cores.
+	for (u32 Pass = 0; Pass < 2; Pass++) {
+		b32 Locked = (Pass == 1);
+		memory_pool Pool = {};
+		concurrent_memory_pool ConcurrentPool = {};
+		if (Locked)
+			InitializeMemoryPool(PlatformState, PlatformAPI, &Pool, "BenchPool", BENCH_POOL_BLOCK_SIZE, 256);
+		else
+			InitializeConcurrentMemoryPool(PlatformState, PlatformAPI, &ConcurrentPool, "BenchConcurrentPool", BENCH_POOL_BLOCK_SIZE, 256);
+
+		volatile u64 SharedBlocks[BENCH_POOL_SHARED_BLOCKS] = {};
+		linux_bench_pool_startup Startups[BENCH_POOL_THREADS] = {};
+		pthread_t Threads[BENCH_POOL_THREADS];
+
+		struct timespec Start = LinuxGetClock();
+		for (u32 ThreadIndex = 0; ThreadIndex < BENCH_POOL_THREADS; ThreadIndex++) {
+			linux_bench_pool_startup *Startup = &Startups[ThreadIndex];
+			Startup->PlatformState = PlatformState;
+			Startup->PlatformAPI = PlatformAPI;
+			Startup->Pool = Locked ? &Pool : 0;
+			Startup->ConcurrentPool = Locked ? 0 : &ConcurrentPool;
+			Startup->SharedBlocks = SharedBlocks;
+			Startup->Seed = ThreadIndex * 7919 + 1;
+
+			pthread_create(&Threads[ThreadIndex], 0, LinuxBenchPoolProc, Startup);
+		}
+		for (u32 ThreadIndex = 0; ThreadIndex < BENCH_POOL_THREADS; ThreadIndex++)
+			pthread_join(Threads[ThreadIndex], 0);
+		f32 Seconds = LinuxGetSecondsElapsed(Start, LinuxGetClock());
+
+		for (u32 Index = 0; Index < BENCH_POOL_SHARED_BLOCKS; Index++)
+			LinuxBenchPoolFree(&Startups[0], (void *)(uptr)SharedBlocks[Index]);
+
+		LinuxLog(PlatformState, "BenchPool: %s pool, %u threads x %u ops, %.3f s, %.2f Mops/s",
+				 Locked ? "locked" : "concurrent",
+				 BENCH_POOL_THREADS, BENCH_POOL_ITERATIONS, Seconds,
+				 ((f32)BENCH_POOL_THREADS * BENCH_POOL_ITERATIONS) / (Seconds * 1000000.0f));
+
+		if (Locked)
+			FreeMemoryPool(PlatformAPI, &Pool);
+		else
+			FreeConcurrentMemoryPool(PlatformAPI, &ConcurrentPool);
+	}
+}
+
+// NOTE(ivan): Work queue submission benchmark parameters, see LinuxBenchmarkWorkQueue().
+#define BENCH_QUEUE_MAX_THREADS 8
+#define BENCH_QUEUE_WORKERS 2
+#define BENCH_QUEUE_ENTRIES 200000
+#define BENCH_QUEUE_BATCH 64
+
+static volatile u32 LinuxBenchQueueJobCount;
+
+static WORK_QUEUE_CALLBACK(LinuxBenchQueueJob)
+{
+	UnreferencedParam(Queue);
+	UnreferencedParam(Data);
+
+	AtomicIncrementU32(&LinuxBenchQueueJobCount);
+}
+
+static void *
+LinuxBenchQueueProc(void *Param)
+{
+	work_queue *Queue = (work_queue *)Param;
+	for (u32 Index = 0; Index < BENCH_QUEUE_ENTRIES; Index++)
+		LinuxAddWorkQueueEntry(Queue, LinuxBenchQueueJob, 0, 0);
+
+	return 0;
+}
+
+static void *
+LinuxBenchQueueBatchedProc(void *Param)
+{
+	work_queue *Queue = (work_queue *)Param;
+
+	work_queue_entry Entries[BENCH_QUEUE_BATCH];
+	for (u32 Index = 0; Index < BENCH_QUEUE_BATCH; Index++) {
+		Entries[Index].Callback = LinuxBenchQueueJob;
+		Entries[Index].Data = 0;
+		Entries[Index].Group = 0;
+		Entries[Index].RunOnFiber = false;
+		Entries[Index].Name = 0;
+	}
+
+	for (u32 Index = 0; Index < BENCH_QUEUE_ENTRIES; Index += BENCH_QUEUE_BATCH)
+		LinuxAddWorkQueueEntries(Queue, Entries, Min(BENCH_QUEUE_ENTRIES - Index, BENCH_QUEUE_BATCH));
+
+	return 0;
+}
+
+// NOTE(ivan): Adds empty jobs to a work queue from 1 to BENCH_QUEUE_MAX_THREADS threads at once,
+// one by one and then in batches of BENCH_QUEUE_BATCH, while its workers drain it,
+// and logs submission throughput and the time to complete the rest.
+static void
+LinuxBenchmarkWorkQueue(platform_state *PlatformState)
+{
+	Assert(PlatformState);
+
+	work_queue *Queue = (work_queue *)LinuxAllocateMemory(sizeof(work_queue));
+	if (!Queue)
+		return;
+	LinuxInitializeWorkQueue(PlatformState, Queue, "Bench", BENCH_QUEUE_WORKERS);
+
+	for (u32 IsBatched = 0; IsBatched < 2; IsBatched++) {
+		for (u32 NumThreads = 1; NumThreads <= BENCH_QUEUE_MAX_THREADS; NumThreads *= 2) {
+			pthread_t Threads[BENCH_QUEUE_MAX_THREADS];
+			LinuxBenchQueueJobCount = 0;
+
+			struct timespec Start = LinuxGetClock();
+			for (u32 ThreadIndex = 0; ThreadIndex < NumThreads; ThreadIndex++)
+				pthread_create(&Threads[ThreadIndex], 0, IsBatched ? LinuxBenchQueueBatchedProc : LinuxBenchQueueProc, Queue);
+			for (u32 ThreadIndex = 0; ThreadIndex < NumThreads; ThreadIndex++)
+				pthread_join(Threads[ThreadIndex], 0);
+			f32 Seconds = LinuxGetSecondsElapsed(Start, LinuxGetClock());
+
+			struct timespec CompleteStart = LinuxGetClock();
+			LinuxCompleteWorkQueue(Queue);
+			f32 CompleteSeconds = LinuxGetSecondsElapsed(CompleteStart, LinuxGetClock());
+			Assert(LinuxBenchQueueJobCount == NumThreads * BENCH_QUEUE_ENTRIES);
+
+			LinuxLog(PlatformState, "BenchQueue: %s, %u threads x %u entries, %.3f s, %.2f Madds/s, completed in %.3f s more",
+					 IsBatched ? "batched" : "one by one", NumThreads, BENCH_QUEUE_ENTRIES, Seconds,
+					 ((f32)NumThreads * BENCH_QUEUE_ENTRIES) / (Seconds * 1000000.0f), CompleteSeconds);
+		}
+	}
+
+	LinuxReleaseWorkQueue(Queue);
+	LinuxDeallocateMemory(Queue);
+}
+#endif // #if INTERNAL
+
 int
 main(int NumParams, char **Params)
 {
@@ -845,8 +2295,36 @@ main(int NumParams, char **Params)
 #endif // #if INTERNAL	
 
 	// NOTE(ivan): Initialize work queues for multithreading.
-	LinuxInitializeWorkQueue(&PlatformState, &PlatformState.HighPriorityWorkQueue, 6);
-	LinuxInitializeWorkQueue(&PlatformState, &PlatformState.LowPriorityWorkQueue, 2);
+	// High-priority workers get one physical core each except the first one, which is left for the main thread,
+	// SMT siblings share execution units so they do not count. Low-priority workers only soak up idle time.
+	cpu_topology Topology;
+	LinuxDetectCPUTopology(&Topology);
+
+	u32 NumHighPriorityThreads = Max(Topology.NumCores, 2u) - 1;
+	u32 NumLowPriorityThreads = Max(Topology.NumCores / 4, 1u);
+
+	const char *HighThreadsParam = LinuxCheckParamValue(&PlatformState, "-highthreads");
+	if (HighThreadsParam)
+		NumHighPriorityThreads = (u32)Min(Max(atoi(HighThreadsParam), 1), 256);
+	const char *LowThreadsParam = LinuxCheckParamValue(&PlatformState, "-lowthreads");
+	if (LowThreadsParam)
+		NumLowPriorityThreads = (u32)Min(Max(atoi(LowThreadsParam), 1), 256);
+
+	b32 IsPinned = (LinuxCheckParam(&PlatformState, "-noaffinity") == -1);
+	u32 FirstWorkerCore = (Topology.NumCores > 1) ? 1 : 0;
+
+	LinuxLog(&PlatformState, "CPU: %u logical CPUs, %u physical cores, %u high-priority and %u low-priority workers%s.",
+			 Topology.NumLogicalCPUs, Topology.NumCores, NumHighPriorityThreads, NumLowPriorityThreads,
+			 IsPinned ? "" : ", not pinned");
+
+	LinuxInitializeWorkQueue(&PlatformState, &PlatformState.HighPriorityWorkQueue, "High-priority", NumHighPriorityThreads,
+							 IsPinned ? &Topology : 0, FirstWorkerCore);
+	LinuxInitializeWorkQueue(&PlatformState, &PlatformState.LowPriorityWorkQueue, "Low-priority", NumLowPriorityThreads,
+							 0, 0, true);
+
+	// NOTE(ivan): Profile work queues from the very start if requested, the capture is written out on exit.
+	if (LinuxCheckParam(&PlatformState, "-profilework") != -1)
+		LinuxToggleWorkProfileCapture(&PlatformState);
 
 	// NOTE(ivan): Initialize platform API structure.
 	platform_api PlatformAPI = {};
@@ -857,8 +2335,18 @@ main(int NumParams, char **Params)
 	PlatformAPI.AllocateMemory = LinuxAllocateMemory;
 	PlatformAPI.DeallocateMemory = LinuxDeallocateMemory;
 	PlatformAPI.GetMemoryStats = LinuxGetMemoryStats;
+	PlatformAPI.ReserveMemory = LinuxReserveMemory;
+	PlatformAPI.CommitMemory = LinuxCommitMemory;
+	PlatformAPI.DecommitMemory = LinuxDecommitMemory;
+	PlatformAPI.ReleaseMemory = LinuxReleaseMemory;
+	PlatformAPI.GetThreadScratch = LinuxGetThreadScratch;
 	PlatformAPI.AddWorkQueueEntry = LinuxAddWorkQueueEntry;
+	PlatformAPI.AddFiberWorkQueueEntry = LinuxAddFiberWorkQueueEntry;
+	PlatformAPI.AddWorkQueueEntries = LinuxAddWorkQueueEntries;
+	PlatformAPI.AddBackgroundWorkQueueEntry = LinuxAddBackgroundWorkQueueEntry;
 	PlatformAPI.CompleteWorkQueue = LinuxCompleteWorkQueue;
+	PlatformAPI.WaitForWorkGroup = LinuxWaitForWorkGroup;
+	PlatformAPI.ParallelFor = LinuxParallelFor;
 	PlatformAPI.ReadEntireFile = LinuxReadEntireFile;
 	PlatformAPI.FreeEntireFileMemory = LinuxFreeEntireFileMemory;
 	PlatformAPI.WriteEntireFile = LinuxWriteEntireFile;
@@ -872,6 +2360,22 @@ main(int NumParams, char **Params)
 	PlatformAPI.ExeName = PlatformState.ExeName;
 	PlatformAPI.ExeNameNoExt = PlatformState.ExeNameNoExt;
 
+#if INTERNAL
+	// NOTE(ivan): Run benchmarks instead of the game if requested.
+	if (LinuxCheckParam(&PlatformState, "-benchpool") != -1) {
+		LinuxBenchmarkPools(&PlatformState, &PlatformAPI);
+		return 0;
+	}
+	if (LinuxCheckParam(&PlatformState, "-benchalloc") != -1) {
+		LinuxBenchmarkAllocator(&PlatformState);
+		return 0;
+	}
+	if (LinuxCheckParam(&PlatformState, "-benchqueue") != -1) {
+		LinuxBenchmarkWorkQueue(&PlatformState);
+		return 0;
+	}
+#endif
+
 	// NOTE(ivan): Initialize input structure for future use.
 	game_input Input = {};
 
@@ -994,6 +2498,12 @@ main(int NumParams, char **Params)
 	struct timespec LastFPSCounter = LinuxGetClock();
 	u32 NumFrames = 0;
 
+	// NOTE(ivan): Frame time the main thread spends on background work whatever is left of, frames are not capped by it.
+	f32 TargetSecondsPerFrame = 1.0f / 60.0f;
+	const char *TargetFPSParam = LinuxCheckParamValue(&PlatformState, "-targetfps");
+	if (TargetFPSParam)
+		TargetSecondsPerFrame = 1.0f / (f32)Min(Max(atoi(TargetFPSParam), 1), 1000);
+
 	// NOTE(ivan): Primary cycle;
 	while (PlatformState.Running) {
 		// NOTE(ivan): Reset keyboard half-transition counters.
@@ -1168,6 +2678,8 @@ main(int NumParams, char **Params)
 #if INTERNAL
 		if (IsSinglePress(Input.KeyboardButtons[KeyCode_F2]))
 			PlatformState.DebugCursor = !PlatformState.DebugCursor;
+		if (IsSinglePress(Input.KeyboardButtons[KeyCode_F6]))
+			LinuxToggleWorkProfileCapture(&PlatformState);
 #endif
 		if (Input.KeyboardButtons[KeyCode_LeftAlt].IsDown && IsSinglePress(Input.KeyboardButtons[KeyCode_Enter]))
 			LinuxToggleFullscreen(&PlatformState, PlatformState.MainWindow);
@@ -1212,6 +2724,11 @@ main(int NumParams, char **Params)
 		if (PlatformAPI.QuitRequested)
 			PlatformState.Running = false;
 
+		// NOTE(ivan): Start work queues' next frame, doing background work in what is left of this one.
+		f32 SecondsLeft = TargetSecondsPerFrame - LinuxGetSecondsElapsed(LastCycleCounter, LinuxGetClock());
+		LinuxEndWorkQueueFrame(&PlatformState.HighPriorityWorkQueue, 0.0f);
+		LinuxEndWorkQueueFrame(&PlatformState.LowPriorityWorkQueue, SecondsLeft);
+
 		// NOTE(ivan): Finish timings.
 		struct timespec EndCycleCounter = LinuxGetClock();
 		struct timespec EndFPSCounter = LinuxGetClock();
@@ -1258,10 +2775,17 @@ main(int NumParams, char **Params)
 	// NOTE(ivan): Destroy joysticks.
 	LinuxReleaseJoysticks(&PlatformState);
 
+	// NOTE(ivan): Write out the capture if still running.
+	if (LinuxWorkProfiler.IsCapturing)
+		LinuxToggleWorkProfileCapture(&PlatformState);
+
 	// NOTE(ivan): Release work queues.
 	LinuxReleaseWorkQueue(&PlatformState.HighPriorityWorkQueue);
 	LinuxReleaseWorkQueue(&PlatformState.LowPriorityWorkQueue);
 
+	// NOTE(ivan): Release main thread scratch stack.
+	FreeMemoryStack(&PlatformAPI, LinuxGetThreadScratch());
+
 	// NOTE(ivan): Release log file.
 	if (PlatformState.LogFile != -1)
 		close(PlatformState.LogFile);
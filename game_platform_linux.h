@@ -13,10 +13,13 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <ucontext.h>
 
 // NOTE(ivan): POSIX threads includes.
 #include <pthread.h>
-#include <semaphore.h>
 
 // NOTE(ivan): X11 includes.
 #include <X11/Xlib.h>
@@ -34,28 +37,92 @@
 // NOTE(ivan): Maximal number of joysticks.
 #define MAX_JOYSTICKS 8
 
-// NOTE(ivan): Work queue entry structure.
-struct work_queue_entry {
-	work_queue_callback *Callback;
-	void *Data;
+// NOTE(ivan): Maximal number of physical cores worker threads are spread over.
+#define MAX_CPU_CORES 256
+
+// NOTE(ivan): Logical CPUs the process is allowed to run on, SMT siblings grouped by physical core.
+struct cpu_topology {
+	u32 NumLogicalCPUs;
+	u32 NumCores;
+	cpu_set_t CoreCPUs[MAX_CPU_CORES];
 };
 
-// NOTE(ivan): Work queue thread startup parameters structure.
-struct work_queue_startup {
+// NOTE(ivan): Number of fibers per work queue, that is how many fiber entries may be started and not done yet at once.
+#define WORK_QUEUE_FIBERS 64
+// NOTE(ivan): Fiber stack size, every stack also has an inaccessible guard page below it.
+#define WORK_FIBER_STACK_SIZE Kilobytes(256)
+
+// NOTE(ivan): Work queue worker thread, also its startup parameters.
+struct work_queue_worker {
 	work_queue *Queue;
+	work_deque Deque; // NOTE(ivan): Entries added by this worker's own jobs.
+
+	pthread_t Thread; // NOTE(ivan): Joined on release, the queue storage outlives every worker.
+
+	ucontext_t SchedulerContext; // NOTE(ivan): Where fibers running on this worker switch back to.
+};
+
+enum work_fiber_state {
+	WorkFiberState_Running,
+	WorkFiberState_Waiting,
+	WorkFiberState_Done
+};
+
+// NOTE(ivan): Fiber that runs fiber work queue entries, one at a time, and is reused afterwards.
+struct work_fiber {
+	ucontext_t Context;
+
+	work_queue *Queue;
+	work_queue_worker *Worker; // NOTE(ivan): Worker the fiber runs on, updated on every switch to it.
+
+	work_queue_entry Entry;
+	work_fiber_state State;
+	work_group *WaitGroup;
+
+	work_fiber *Next; // NOTE(ivan): Free or ready list link.
 };
 
 // NOTE(ivan): Work queue implementation.
+// Every worker has its own deque and steals from the others once it runs dry,
+// entries added from outside of the workers go to the ring, or to the overflow queue once the ring is full.
+// Background entries wait in the heap till nothing else is left.
 struct work_queue {
+	const char *Name; // NOTE(ivan): Shown by the profiler.
+
 	volatile u32 CompletionGoal;
 	volatile u32 CompletionCount;
 
-	volatile u32 NextEntryToWrite;
-	volatile u32 NextEntryToRead;
-	sem_t Semaphore;
+	// NOTE(ivan): Event count idle workers park on, bumped when entries are added while anyone sleeps.
+	volatile u32 WakeEpoch;
+	volatile u32 NumSleepers;
+
+	volatile b32 Quit; // NOTE(ivan): Set on release, workers exit instead of looking for more entries.
+
+	u32 NumWorkers;
+	work_queue_worker *Workers;
+
+	work_ring Ring;
+
+	// NOTE(ivan): Unbounded locked FIFO ring, grows by doubling.
+	ticket_mutex OverflowMutex;
+	volatile u32 NumOverflowEntries;
+	u32 FirstOverflowEntry;
+	u32 MaxOverflowEntries;
+	work_queue_entry *OverflowEntries;
 
-	work_queue_startup *Startups;
-	work_queue_entry Entries[256];
+	work_heap Heap; // NOTE(ivan): Background entries, picked up once there are no others.
+
+	b32 IsLowPriority; // NOTE(ivan): Workers run under SCHED_IDLE, or at the lowest nice if not permitted.
+
+	// NOTE(ivan): Fiber pool, the stacks are reserved in one piece.
+	// Free fibers and suspended ones that are ready to be resumed are kept in lists under one lock.
+	ticket_mutex FiberMutex;
+	work_fiber *Fibers;
+	u8 *FiberStacks;
+	work_fiber *FirstFreeFiber;
+	work_fiber *FirstReadyFiber;
+	work_fiber *LastReadyFiber;
+	volatile u32 NumReadyFibers;
 };
 
 inline struct timespec
@@ -66,6 +133,14 @@ LinuxGetClock(void)
 	return Clock;
 }
 
+// NOTE(ivan): Same clock in nanoseconds, for profiler timestamps.
+inline u64
+LinuxGetClockTicks(void)
+{
+	struct timespec Clock = LinuxGetClock();
+	return (u64)Clock.tv_sec * 1000000000ull + (u64)Clock.tv_nsec;
+}
+
 inline f32
 LinuxGetSecondsElapsed(struct timespec Start, struct timespec End)
 {
@@ -111,7 +186,8 @@ struct linux_surface_buffer {
 	XImage *Image;
 	XShmSegmentInfo SegmentInfo;
 
-	void *Pixels;
+	void *Pixels; // NOTE(ivan): Reserved and committed as a whole, so it may sit on huge pages.
+	uptr PixelsBytes;
 	s32 Width;
 	s32 Height;
 	s32 BytesPerPixel;
@@ -170,8 +246,18 @@ PLATFORM_ERROR(LinuxError);
 PLATFORM_ALLOCATE_MEMORY(LinuxAllocateMemory);
 PLATFORM_DEALLOCATE_MEMORY(LinuxDeallocateMemory);
 PLATFORM_GET_MEMORY_STATS(LinuxGetMemoryStats);
+PLATFORM_RESERVE_MEMORY(LinuxReserveMemory);
+PLATFORM_COMMIT_MEMORY(LinuxCommitMemory);
+PLATFORM_DECOMMIT_MEMORY(LinuxDecommitMemory);
+PLATFORM_RELEASE_MEMORY(LinuxReleaseMemory);
+PLATFORM_GET_THREAD_SCRATCH(LinuxGetThreadScratch);
 PLATFORM_ADD_WORK_QUEUE_ENTRY(LinuxAddWorkQueueEntry);
+PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(LinuxAddFiberWorkQueueEntry);
+PLATFORM_ADD_WORK_QUEUE_ENTRIES(LinuxAddWorkQueueEntries);
+PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(LinuxAddBackgroundWorkQueueEntry);
 PLATFORM_COMPLETE_WORK_QUEUE(LinuxCompleteWorkQueue);
+PLATFORM_WAIT_FOR_WORK_GROUP(LinuxWaitForWorkGroup);
+PLATFORM_PARALLEL_FOR(LinuxParallelFor);
 PLATFORM_READ_ENTIRE_FILE(LinuxReadEntireFile);
 PLATFORM_FREE_ENTIRE_FILE_MEMORY(LinuxFreeEntireFileMemory);
 PLATFORM_WRITE_ENTIRE_FILE(LinuxWriteEntireFile);
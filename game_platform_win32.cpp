@@ -1,6 +1,7 @@
 #include "game.h"
 #include "game_platform.h"
 #include "game_platform_win32.h"
+#include "game_memory.h"
 
 #include "ents.h"
 
@@ -109,6 +110,35 @@ PLATFORM_DEALLOCATE_MEMORY(Win32DeallocateMemory)
 	VirtualFree(Address, 0, MEM_RELEASE);
 }
 
+// NOTE(ivan): Large pages need SeLockMemoryPrivilege and must be committed at reservation time,
+// which defeats lazy commit, so PlatformMemoryFlag_LargePages is ignored here.
+PLATFORM_RESERVE_MEMORY(Win32ReserveMemory)
+{
+	Assert(Bytes);
+	return VirtualAlloc(0, AlignPow2(Bytes, PLATFORM_MEMORY_PAGE_BYTES), MEM_RESERVE, PAGE_NOACCESS);
+}
+
+PLATFORM_COMMIT_MEMORY(Win32CommitMemory)
+{
+	Assert(Address);
+	Assert(Bytes);
+	return VirtualAlloc(Address, Bytes, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+
+PLATFORM_DECOMMIT_MEMORY(Win32DecommitMemory)
+{
+	Assert(Address);
+	Assert(Bytes);
+	VirtualFree(Address, Bytes, MEM_DECOMMIT);
+}
+
+PLATFORM_RELEASE_MEMORY(Win32ReleaseMemory)
+{
+	if (!Address)
+		return;
+	VirtualFree(Address, 0, MEM_RELEASE);
+}
+
 PLATFORM_GET_MEMORY_STATS(Win32GetMemoryStats)
 {
 	platform_memory_stats Result = {};
@@ -163,57 +193,513 @@ Win32GetThreadId(void)
 	return (DWORD)(*(u32 *)(ThreadLocalStorage + 0x48));
 }
 
+// NOTE(ivan): Per-thread scratch stack, blocks are allocated lazily on first push.
+static ThreadLocal memory_stack Win32ThreadScratch;
+static ThreadLocal b32 Win32ThreadScratchInitialized;
+
+PLATFORM_GET_THREAD_SCRATCH(Win32GetThreadScratch)
+{
+	if (!Win32ThreadScratchInitialized) {
+		InitializeMemoryStackEmpty(&Win32ThreadScratch, "ThreadScratch", Kilobytes(64), MemoryStackFlag_ThreadLocal);
+		Win32ThreadScratchInitialized = true;
+	}
+
+	return &Win32ThreadScratch;
+}
+
+// NOTE(ivan): Worker the calling thread is, zero for non-worker threads.
+static ThreadLocal work_queue_worker *Win32CurrentWorker;
+static ThreadLocal work_fiber *Win32CurrentFiber;
+static ThreadLocal u32 Win32StealSeed;
+
+// NOTE(ivan): Work queues profiler, every thread gets its buffer on the first event it records.
+static work_profiler Win32WorkProfiler;
+static ThreadLocal work_profile_buffer *Win32WorkProfileBuffer;
+static DWORD Win32MainThreadID;
+
+// NOTE(ivan): Initial capacity of worker deques and overflow queues, both grow on demand.
+#define WORK_QUEUE_INITIAL_ENTRIES 256
+// NOTE(ivan): Capacity of the lock-free ring, enough for a frame's worth of jobs without touching the overflow lock.
+#define WORK_QUEUE_RING_ENTRIES 1024
+// NOTE(ivan): Number of empty polls an idle worker spends before parking itself,
+// so a steady stream of tiny entries is picked up without a single syscall on either side.
+#define WORK_QUEUE_SPIN_COUNT 256
+
+static b32
+Win32PushWorkQueueOverflow(work_queue *Queue, work_queue_entry Entry)
+{
+	Assert(Queue);
+
+	b32 Result = true;
+	EnterTicketMutex(&Queue->OverflowMutex);
+
+	if (Queue->NumOverflowEntries == Queue->MaxOverflowEntries) {
+		u32 NewMaxOverflowEntries = Queue->MaxOverflowEntries * 2;
+		work_queue_entry *NewOverflowEntries = (work_queue_entry *)Win32AllocateMemory(sizeof(work_queue_entry) * NewMaxOverflowEntries);
+		if (NewOverflowEntries) {
+			for (u32 Index = 0; Index < Queue->NumOverflowEntries; Index++)
+				NewOverflowEntries[Index] = Queue->OverflowEntries[(Queue->FirstOverflowEntry + Index) % Queue->MaxOverflowEntries];
+
+			Win32DeallocateMemory(Queue->OverflowEntries);
+			Queue->OverflowEntries = NewOverflowEntries;
+			Queue->MaxOverflowEntries = NewMaxOverflowEntries;
+			Queue->FirstOverflowEntry = 0;
+		} else {
+			Result = false;
+		}
+	}
+
+	if (Result) {
+		Queue->OverflowEntries[(Queue->FirstOverflowEntry + Queue->NumOverflowEntries) % Queue->MaxOverflowEntries] = Entry;
+		CompletePastWritesBeforeFutureWrites();
+		Queue->NumOverflowEntries++;
+	}
+
+	LeaveTicketMutex(&Queue->OverflowMutex);
+	return Result;
+}
+
+static b32
+Win32PopWorkQueueOverflow(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	// NOTE(ivan): Do not take the lock just to find out there is nothing.
+	if (!Queue->NumOverflowEntries)
+		return false;
+
+	b32 Result = false;
+	EnterTicketMutex(&Queue->OverflowMutex);
+
+	if (Queue->NumOverflowEntries) {
+		*Entry = Queue->OverflowEntries[Queue->FirstOverflowEntry];
+		Queue->FirstOverflowEntry = (Queue->FirstOverflowEntry + 1) % Queue->MaxOverflowEntries;
+		Queue->NumOverflowEntries--;
+		Result = true;
+	}
+
+	LeaveTicketMutex(&Queue->OverflowMutex);
+	return Result;
+}
+
+static b32
+Win32StealWorkQueueEntry(work_queue *Queue, work_queue_worker *Self, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	// NOTE(ivan): Start from a random victim, so thieves do not all line up behind the first worker.
+	if (!Win32StealSeed)
+		Win32StealSeed = (u32)(uptr)&Win32StealSeed | 1;
+	Win32StealSeed ^= Win32StealSeed << 13;
+	Win32StealSeed ^= Win32StealSeed >> 17;
+	Win32StealSeed ^= Win32StealSeed << 5;
+
+	u32 FirstVictim = Win32StealSeed % Queue->NumWorkers;
+	for (u32 Index = 0; Index < Queue->NumWorkers; Index++) {
+		work_queue_worker *Victim = Queue->Workers + (FirstVictim + Index) % Queue->NumWorkers;
+		if (Victim != Self && StealWorkDeque(&Victim->Deque, Entry))
+			return true;
+	}
+
+	return false;
+}
+
+// NOTE(ivan): A hint only, see IsWorkDequeEmpty() and IsWorkRingEmpty().
+static b32
+Win32HasWorkQueueEntries(work_queue *Queue)
+{
+	Assert(Queue);
+
+	if (Queue->NumReadyFibers || Queue->NumOverflowEntries || !IsWorkRingEmpty(&Queue->Ring) || !IsWorkHeapEmpty(&Queue->Heap))
+		return true;
+
+	for (u32 Index = 0; Index < Queue->NumWorkers; Index++) {
+		if (!IsWorkDequeEmpty(&Queue->Workers[Index].Deque))
+			return true;
+	}
+
+	return false;
+}
+
+// NOTE(ivan): Called after Count entries are added, costs nothing unless some workers are parked.
+static void
+Win32WakeWorkQueueWorkers(work_queue *Queue, u32 Count)
+{
+	Assert(Queue);
+
+	if (!Count)
+		return;
+
+	// NOTE(ivan): Entries must be visible before the sleepers are counted, pairs with the barrier in Win32ParkWorkQueueWorker().
+	// Releases past the semaphore's maximum fail, which is fine: nobody is blocked on a full semaphore.
+	CompletePastWritesBeforeFutureReads();
+	u32 NumSleepers = Queue->NumSleepers;
+	if (NumSleepers)
+		ReleaseSemaphore(Queue->Semaphore, Min(Count, NumSleepers), 0);
+}
+
+static void
+Win32ParkWorkQueueWorker(work_queue *Queue)
+{
+	Assert(Queue);
+
+	// NOTE(ivan): Counted as a sleeper before taking the last look, so an entry added meanwhile
+	// is either seen here, or releases the semaphore and the wait returns right away.
+	AtomicAddU32(&Queue->NumSleepers, 1);
+	if (!Queue->Quit && !Win32HasWorkQueueEntries(Queue))
+		WaitForSingleObjectEx(Queue->Semaphore, INFINITE, FALSE);
+	AtomicAddU32(&Queue->NumSleepers, (u32)-1);
+}
+
+static work_fiber *
+Win32AllocateWorkFiber(work_queue *Queue)
+{
+	Assert(Queue);
+
+	EnterTicketMutex(&Queue->FiberMutex);
+	work_fiber *Result = Queue->FirstFreeFiber;
+	if (Result)
+		Queue->FirstFreeFiber = Result->Next;
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	return Result;
+}
+
+static void
+Win32FreeWorkFiber(work_fiber *Fiber)
+{
+	Assert(Fiber);
+
+	work_queue *Queue = Fiber->Queue;
+	EnterTicketMutex(&Queue->FiberMutex);
+	Fiber->Next = Queue->FirstFreeFiber;
+	Queue->FirstFreeFiber = Fiber;
+	LeaveTicketMutex(&Queue->FiberMutex);
+}
+
+static void
+Win32PushReadyWorkFiber(work_fiber *Fiber)
+{
+	Assert(Fiber);
+
+	work_queue *Queue = Fiber->Queue;
+	EnterTicketMutex(&Queue->FiberMutex);
+	Fiber->Next = 0;
+	if (Queue->LastReadyFiber)
+		Queue->LastReadyFiber->Next = Fiber;
+	else
+		Queue->FirstReadyFiber = Fiber;
+	Queue->LastReadyFiber = Fiber;
+	Queue->NumReadyFibers++;
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	Win32WakeWorkQueueWorkers(Queue, 1);
+}
+
+static work_fiber *
+Win32PopReadyWorkFiber(work_queue *Queue)
+{
+	Assert(Queue);
+
+	// NOTE(ivan): Do not take the lock just to find out there is nothing.
+	if (!Queue->NumReadyFibers)
+		return 0;
+
+	EnterTicketMutex(&Queue->FiberMutex);
+	work_fiber *Result = Queue->FirstReadyFiber;
+	if (Result) {
+		Queue->FirstReadyFiber = Result->Next;
+		if (!Queue->FirstReadyFiber)
+			Queue->LastReadyFiber = 0;
+		Queue->NumReadyFibers--;
+	}
+	LeaveTicketMutex(&Queue->FiberMutex);
+
+	return Result;
+}
+
+// NOTE(ivan): Never inlined, since code running on a fiber may find itself on another thread between two calls.
+static NoInline work_profile_buffer *
+Win32GetWorkProfileBuffer(void)
+{
+	work_profile_buffer *Buffer = Win32WorkProfileBuffer;
+	if (Buffer)
+		return Buffer;
+
+	Buffer = (work_profile_buffer *)Win32AllocateMemory(sizeof(work_profile_buffer));
+	if (!Buffer)
+		return 0;
+
+	Buffer->ThreadID = (u32)GetCurrentThreadId();
+	work_queue_worker *Worker = Win32CurrentWorker;
+	if (Worker)
+		snprintf(Buffer->ThreadName, CountOf(Buffer->ThreadName) - 1, "%s worker %u",
+				 Worker->Queue->Name, (u32)(Worker - Worker->Queue->Workers));
+	else if (Buffer->ThreadID == (u32)Win32MainThreadID)
+		strcpy(Buffer->ThreadName, "Main thread");
+	else
+		snprintf(Buffer->ThreadName, CountOf(Buffer->ThreadName) - 1, "Thread %u", Buffer->ThreadID);
+
+	AddWorkProfileBuffer(&Win32WorkProfiler, Buffer);
+	Win32WorkProfileBuffer = Buffer;
+	return Buffer;
+}
+
+static void
+Win32RecordWorkProfileEvent(work_queue *Queue, work_queue_entry *Entry, u64 BeginTicks)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	work_profile_buffer *Buffer = Win32GetWorkProfileBuffer();
+	if (Buffer)
+		RecordWorkProfileEvent(Buffer, Entry, Queue->Name, BeginTicks, Win32GetClock());
+}
+
+static void
+Win32FinishWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	Entry->Callback(Queue, Entry->Data);
+
+	// NOTE(ivan): The group may be gone as soon as its last entry is done, so nothing but the wake touches it afterwards.
+	// A suspended fiber is the exception: it cannot leave till resumed, and the group stays alive on its stack.
+	if (Entry->Group) {
+		work_group *Group = Entry->Group;
+		u32 OrigState = AtomicAddU32(&Group->State, (u32)-1);
+		if (OrigState & WORK_GROUP_WAITING)
+			WakeOnAddressU32(&Group->State);
+		else if ((OrigState & WORK_GROUP_FIBER_WAITING) && (OrigState & WORK_GROUP_PENDING_MASK) == 1)
+			Win32PushReadyWorkFiber(Group->Fiber);
+	}
+
+	AtomicIncrementU32(&Queue->CompletionCount);
+}
+
+// NOTE(ivan): Entry point of every fiber, reached once since fibers are reused.
+// Nothing thread-local is touched by the fiber itself, as it may come back on another thread.
+static void CALLBACK
+Win32WorkFiberProc(LPVOID Param)
+{
+	work_fiber *Fiber = (work_fiber *)Param;
+	for (;;) {
+		Win32FinishWorkQueueEntry(Fiber->Queue, &Fiber->Entry);
+
+		Fiber->State = WorkFiberState_Done;
+		SwitchToFiber(Fiber->Worker->SchedulerFiber);
+	}
+}
+
+// NOTE(ivan): Runs the fiber on the calling worker till it is done or suspended.
+static void
+Win32SwitchToWorkFiber(work_queue_worker *Worker, work_fiber *Fiber)
+{
+	Assert(Worker);
+	Assert(Fiber);
+	Assert(!Win32CurrentFiber);
+
+	for (;;) {
+		// NOTE(ivan): Every run of the fiber till it is done or suspended is a separate event.
+		b32 IsProfiling = Win32WorkProfiler.IsCapturing;
+		u64 BeginTicks = IsProfiling ? Win32GetClock() : 0;
+
+		Fiber->Worker = Worker;
+		Fiber->State = WorkFiberState_Running;
+		Win32CurrentFiber = Fiber;
+		SwitchToFiber(Fiber->Handle);
+		Win32CurrentFiber = 0;
+
+		if (IsProfiling)
+			Win32RecordWorkProfileEvent(Fiber->Queue, &Fiber->Entry, BeginTicks);
+
+		if (Fiber->State == WorkFiberState_Done) {
+			Win32FreeWorkFiber(Fiber);
+			return;
+		}
+
+		// NOTE(ivan): The wait is published only now that the fiber is switched out,
+		// so whoever finishes the group's last entry never resumes a fiber that is still running.
+		Assert(Fiber->State == WorkFiberState_Waiting);
+		work_group *Group = Fiber->WaitGroup;
+		Group->Fiber = Fiber;
+		for (;;) {
+			u32 State = Group->State;
+			Assert(!(State & (WORK_GROUP_WAITING | WORK_GROUP_FIBER_WAITING)));
+			if (!(State & WORK_GROUP_PENDING_MASK))
+				break; // NOTE(ivan): Done in the meantime, resume right away.
+			if (AtomicCompareExchangeU32(&Group->State, State | WORK_GROUP_FIBER_WAITING, State) == State)
+				return;
+		}
+	}
+}
+
+// NOTE(ivan): Runs the entry right on the calling thread, recording it if the profiler is capturing.
+static void
+Win32RunWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	b32 IsProfiling = Win32WorkProfiler.IsCapturing;
+	u64 BeginTicks = IsProfiling ? Win32GetClock() : 0;
+
+	Win32FinishWorkQueueEntry(Queue, Entry);
+
+	if (IsProfiling)
+		Win32RecordWorkProfileEvent(Queue, Entry, BeginTicks);
+}
+
 static b32
 Win32DoNextWorkQueueEntry(work_queue *Queue)
 {
 	Assert(Queue);
 
-	b32 ShouldSleep = false;
-
-	u32 OrigNextEntryToRead = Queue->NextEntryToRead;
-	u32 NewNextEntryToRead = (OrigNextEntryToRead + 1) % CountOf(Queue->Entries);
-	if (OrigNextEntryToRead != Queue->NextEntryToWrite) {
-		u32 Index = AtomicCompareExchangeU32(&Queue->NextEntryToRead,
-											 NewNextEntryToRead,
-											 OrigNextEntryToRead);
-		if (Index == OrigNextEntryToRead) {
-			work_queue_entry Entry = Queue->Entries[Index];
-			Entry.Callback(Queue, Entry.Data);
-			AtomicIncrementU32(&Queue->CompletionCount);
+	work_queue_worker *Worker = Win32CurrentWorker;
+	if (Worker && Worker->Queue != Queue)
+		Worker = 0;
+
+	// NOTE(ivan): Fibers run on the queue's own workers only, and are never switched to from inside of another fiber.
+	b32 CanSwitchFibers = (Worker && !Win32CurrentFiber);
+
+	// NOTE(ivan): Suspended fibers come first, they hold on to their stacks till done.
+	if (CanSwitchFibers) {
+		work_fiber *Fiber = Win32PopReadyWorkFiber(Queue);
+		if (Fiber) {
+			Win32SwitchToWorkFiber(Worker, Fiber);
+			return false;
+		}
+	}
+
+	// NOTE(ivan): Own entries first, they are the most cache-warm, then outside ones, then other workers' ones,
+	// and background ones only once there is nothing else.
+	work_queue_entry Entry;
+	b32 Found = (Worker && PopWorkDeque(&Worker->Deque, &Entry));
+	if (!Found)
+		Found = PopWorkRing(&Queue->Ring, &Entry);
+	if (!Found)
+		Found = Win32PopWorkQueueOverflow(Queue, &Entry);
+	if (!Found)
+		Found = Win32StealWorkQueueEntry(Queue, Worker, &Entry);
+	if (!Found)
+		Found = PopWorkHeap(&Queue->Heap, &Entry);
+
+	if (Found) {
+		// NOTE(ivan): Out of fibers, the entry runs on the thread and its waits block it.
+		work_fiber *Fiber = (Entry.RunOnFiber && CanSwitchFibers) ? Win32AllocateWorkFiber(Queue) : 0;
+		if (Fiber) {
+			Fiber->Entry = Entry;
+			Win32SwitchToWorkFiber(Worker, Fiber);
+		} else {
+			Win32RunWorkQueueEntry(Queue, &Entry);
 		}
-	} else {
-		ShouldSleep = true;
 	}
 
+	b32 ShouldSleep = !Found;
 	return ShouldSleep;
 }
 
+static void
+Win32DetectCPUTopology(cpu_topology *Topology)
+{
+	Assert(Topology);
+
+	memset(Topology, 0, sizeof(*Topology));
+
+	// NOTE(ivan): Only CPUs we are allowed to run on count, within the current processor group.
+	DWORD_PTR ProcessMask, SystemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &ProcessMask, &SystemMask) || !ProcessMask)
+		ProcessMask = 1;
+
+	for (u32 CPU = 0; CPU < sizeof(ProcessMask) * 8; CPU++) {
+		if (ProcessMask & ((DWORD_PTR)1 << CPU))
+			Topology->NumLogicalCPUs++;
+	}
+
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION Infos[256];
+	DWORD InfosSize = sizeof(Infos);
+	if (GetLogicalProcessorInformation(Infos, &InfosSize)) {
+		for (u32 Index = 0; Index < InfosSize / sizeof(Infos[0]); Index++) {
+			if (Infos[Index].Relationship != RelationProcessorCore)
+				continue;
+
+			DWORD_PTR CoreMask = Infos[Index].ProcessorMask & ProcessMask;
+			if (CoreMask && Topology->NumCores < MAX_CPU_CORES)
+				Topology->CoreMasks[Topology->NumCores++] = CoreMask;
+		}
+	}
+
+	// NOTE(ivan): No topology information, so every logical CPU is its own core.
+	if (!Topology->NumCores) {
+		for (u32 CPU = 0; CPU < sizeof(ProcessMask) * 8 && Topology->NumCores < MAX_CPU_CORES; CPU++) {
+			if (ProcessMask & ((DWORD_PTR)1 << CPU))
+				Topology->CoreMasks[Topology->NumCores++] = (DWORD_PTR)1 << CPU;
+		}
+	}
+}
+
 static unsigned __stdcall
 Win32WorkQueueProc(void *Param)
 {
-	work_queue_startup *Startup = (work_queue_startup *)Param;
-	work_queue *Queue = Startup->Queue;
+	work_queue_worker *Worker = (work_queue_worker *)Param;
+	work_queue *Queue = Worker->Queue;
+	Win32CurrentWorker = Worker;
+	Worker->SchedulerFiber = ConvertThreadToFiber(0);
 
 	u32 TestThreadId = Win32GetThreadId();
 	Assert(TestThreadId == GetCurrentThreadId());
 
-	while (true) {
-		if (Win32DoNextWorkQueueEntry(Queue))
-			WaitForSingleObjectEx(Queue->Semaphore, INFINITE, FALSE);
+	// NOTE(ivan): Every worker gets its own scratch stack up front.
+	Win32GetThreadScratch();
+
+	u32 Spin = 0;
+	while (!Queue->Quit) {
+		if (!Win32DoNextWorkQueueEntry(Queue)) {
+			Spin = 0;
+		} else if (Spin < WORK_QUEUE_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else {
+			Win32ParkWorkQueueWorker(Queue);
+			Spin = 0;
+		}
 	}
+
+	// NOTE(ivan): Released, give the scratch stack back. FreeMemoryStack() needs nothing but the deallocators.
+	platform_api PlatformAPI = {};
+	PlatformAPI.DeallocateMemory = Win32DeallocateMemory;
+	PlatformAPI.ReleaseMemory = Win32ReleaseMemory;
+	FreeMemoryStack(&PlatformAPI, Win32GetThreadScratch());
+
+	ConvertFiberToThread();
+	Win32CurrentWorker = 0;
+	return 0;
 }
 
+// NOTE(ivan): If Topology is given, worker N is pinned to the SMT siblings of physical core N + FirstCore,
+// wrapping around once cores run out. Otherwise workers are left to the scheduler.
 static void
 Win32InitializeWorkQueue(platform_state *PlatformState,
 						 work_queue *Queue,
-						 u32 ThreadCount)
+						 const char *Name,
+						 u32 ThreadCount,
+						 cpu_topology *Topology = 0,
+						 u32 FirstCore = 0,
+						 b32 IsLowPriority = false)
 {
 	Assert(PlatformState);
 	Assert(Queue);
+	Assert(Name);
 	Assert(ThreadCount);
 
+	Queue->Name = Name;
 	Queue->CompletionGoal = Queue->CompletionCount = 0;
-	Queue->NextEntryToWrite = Queue->NextEntryToRead = 0;
+	Queue->NumSleepers = 0;
+	Queue->Quit = false;
+	Queue->IsLowPriority = IsLowPriority;
 
 	u32 InitialCount = 0;
 	Queue->Semaphore = CreateSemaphoreExA(0,
@@ -222,51 +708,332 @@ Win32InitializeWorkQueue(platform_state *PlatformState,
 										  0, 0,
 										  SEMAPHORE_ALL_ACCESS);
 
-	Queue->Startups = (work_queue_startup *)Win32AllocateMemory(sizeof(work_queue_startup) * ThreadCount);
-	if (!Queue->Startups)
+	if (!InitializeWorkRing(&Queue->Ring, Win32AllocateMemory, WORK_QUEUE_RING_ENTRIES))
+		Win32Error(PlatformState, "Failed allocating resources for work queue!");
+
+	Queue->OverflowMutex = {};
+	Queue->NumOverflowEntries = Queue->FirstOverflowEntry = 0;
+	Queue->MaxOverflowEntries = WORK_QUEUE_INITIAL_ENTRIES;
+	Queue->OverflowEntries = (work_queue_entry *)Win32AllocateMemory(sizeof(work_queue_entry) * Queue->MaxOverflowEntries);
+	if (!Queue->OverflowEntries)
+		Win32Error(PlatformState, "Failed allocating resources for work queue!");
+
+	if (!InitializeWorkHeap(&Queue->Heap, Win32AllocateMemory, WORK_QUEUE_INITIAL_ENTRIES))
+		Win32Error(PlatformState, "Failed allocating resources for work queue!");
+
+	// NOTE(ivan): All deques must exist before the first worker starts stealing from them.
+	Queue->NumWorkers = ThreadCount;
+	Queue->Workers = (work_queue_worker *)Win32AllocateMemory(sizeof(work_queue_worker) * ThreadCount);
+	if (!Queue->Workers)
 		Win32Error(PlatformState, "Failed allocating resources for work queue!");
 	for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++) {
-		Queue->Startups[ThreadIndex].Queue = Queue;
+		Queue->Workers[ThreadIndex].Queue = Queue;
+		if (!InitializeWorkDeque(&Queue->Workers[ThreadIndex].Deque, Win32AllocateMemory, WORK_QUEUE_INITIAL_ENTRIES))
+			Win32Error(PlatformState, "Failed allocating resources for work queue!");
+	}
+
+	// NOTE(ivan): Fibers start out free.
+	Queue->FiberMutex = {};
+	Queue->FirstFreeFiber = Queue->FirstReadyFiber = Queue->LastReadyFiber = 0;
+	Queue->NumReadyFibers = 0;
+	Queue->Fibers = (work_fiber *)Win32AllocateMemory(sizeof(work_fiber) * WORK_QUEUE_FIBERS);
+	if (!Queue->Fibers)
+		Win32Error(PlatformState, "Failed allocating resources for work queue!");
+	for (u32 FiberIndex = 0; FiberIndex < WORK_QUEUE_FIBERS; FiberIndex++) {
+		work_fiber *Fiber = Queue->Fibers + FiberIndex;
+		Fiber->Handle = CreateFiber(WORK_FIBER_STACK_SIZE, Win32WorkFiberProc, Fiber);
+		if (!Fiber->Handle)
+			Win32Error(PlatformState, "Failed allocating resources for work queue!");
+
+		Fiber->Queue = Queue;
+		Fiber->Next = Queue->FirstFreeFiber;
+		Queue->FirstFreeFiber = Fiber;
+	}
 
+	for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++) {
 		DWORD ThreadId;
-		HANDLE Thread = (HANDLE)_beginthreadex(0, 0, Win32WorkQueueProc, &Queue->Startups[ThreadIndex], 0, (unsigned int *)&ThreadId);
-		CloseHandle(Thread);
+		HANDLE Thread = (HANDLE)_beginthreadex(0, 0, Win32WorkQueueProc, &Queue->Workers[ThreadIndex], CREATE_SUSPENDED, (unsigned int *)&ThreadId);
+		if (!Thread)
+			Win32Error(PlatformState, "Failed creating work queue thread!");
+		if (Topology)
+			SetThreadAffinityMask(Thread, Topology->CoreMasks[(FirstCore + ThreadIndex) % Topology->NumCores]);
+		if (IsLowPriority)
+			SetThreadPriority(Thread, THREAD_PRIORITY_IDLE);
+		Queue->Workers[ThreadIndex].Thread = Thread;
+		ResumeThread(Thread);
 	}
 }
 
+// NOTE(ivan): Entries still queued are dropped, complete the queue first if they matter.
 static void
 Win32ReleaseWorkQueue(work_queue *Queue)
 {
 	Assert(Queue);
-	Win32DeallocateMemory(Queue->Startups);
+
+	// NOTE(ivan): Quit must be visible before the semaphore is released, so a worker that parks meanwhile
+	// either sees it or gets woken. One release per worker, those past the maximum fail but the semaphore is full then.
+	// Nothing may be freed until every worker is gone.
+	Queue->Quit = true;
+	CompletePastWritesBeforeFutureWrites();
+	for (u32 ThreadIndex = 0; ThreadIndex < Queue->NumWorkers; ThreadIndex++)
+		ReleaseSemaphore(Queue->Semaphore, 1, 0);
+	for (u32 ThreadIndex = 0; ThreadIndex < Queue->NumWorkers; ThreadIndex++) {
+		WaitForSingleObject(Queue->Workers[ThreadIndex].Thread, INFINITE);
+		CloseHandle(Queue->Workers[ThreadIndex].Thread);
+	}
+
+	for (u32 ThreadIndex = 0; ThreadIndex < Queue->NumWorkers; ThreadIndex++)
+		FreeWorkDeque(&Queue->Workers[ThreadIndex].Deque, Win32DeallocateMemory);
+	Win32DeallocateMemory(Queue->Workers);
+	FreeWorkRing(&Queue->Ring, Win32DeallocateMemory);
+	Win32DeallocateMemory(Queue->OverflowEntries);
+	FreeWorkHeap(&Queue->Heap, Win32DeallocateMemory);
+	for (u32 FiberIndex = 0; FiberIndex < WORK_QUEUE_FIBERS; FiberIndex++)
+		DeleteFiber(Queue->Fibers[FiberIndex].Handle);
+	Win32DeallocateMemory(Queue->Fibers);
 	CloseHandle(Queue->Semaphore);
 }
 
+// NOTE(ivan): Any thread may add entries, so counters are bumped atomically and before the entry is visible.
+static void
+Win32CountWorkQueueEntry(work_queue *Queue, work_queue_entry *Entry)
+{
+	Assert(Queue);
+	Assert(Entry);
+
+	AtomicIncrementU32(&Queue->CompletionGoal);
+	if (Entry->Group) {
+		Assert((Entry->Group->State & WORK_GROUP_PENDING_MASK) != WORK_GROUP_PENDING_MASK);
+		AtomicIncrementU32(&Entry->Group->State);
+	}
+}
+
+// NOTE(ivan): Returns false if out of memory, the entry is counted but not added then.
+static b32
+Win32PushWorkQueueEntry(work_queue *Queue, work_queue_entry Entry)
+{
+	Assert(Queue);
+	Assert(Entry.Callback);
+
+	Win32CountWorkQueueEntry(Queue, &Entry);
+
+	// NOTE(ivan): A worker keeps what its own jobs add, others will steal it if it is busy for too long.
+	work_queue_worker *Worker = Win32CurrentWorker;
+	b32 Result = (Worker && Worker->Queue == Queue && PushWorkDeque(&Worker->Deque, Entry, Win32AllocateMemory));
+	if (!Result)
+		Result = PushWorkRing(&Queue->Ring, Entry);
+	if (!Result)
+		Result = Win32PushWorkQueueOverflow(Queue, Entry);
+
+	return Result;
+}
+
+PLATFORM_ADD_WORK_QUEUE_ENTRIES(Win32AddWorkQueueEntries)
+{
+	Assert(Queue);
+	Assert(Entries);
+
+	u32 NumAdded = 0;
+	for (u32 Index = 0; Index < Count; Index++) {
+		if (Win32PushWorkQueueEntry(Queue, Entries[Index])) {
+			NumAdded++;
+		} else {
+			// NOTE(ivan): Out of memory, do the job right here rather than lose it, after waking others for what is added so far.
+			Win32WakeWorkQueueWorkers(Queue, NumAdded);
+			NumAdded = 0;
+			Win32FinishWorkQueueEntry(Queue, Entries + Index);
+		}
+	}
+
+	Win32WakeWorkQueueWorkers(Queue, NumAdded);
+}
+
 PLATFORM_ADD_WORK_QUEUE_ENTRY(Win32AddWorkQueueEntry)
 {
 	Assert(Queue);
 	Assert(Callback);
-	
-	// TODO(ivan): Switch to AtomicCompareExchange() eventually so that any thread can add?
-	u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % CountOf(Queue->Entries);
-	Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
-
-	work_queue_entry *Entry = Queue->Entries + Queue->NextEntryToWrite;
-	Entry->Callback = Callback;
-	Entry->Data = Data;
-	Queue->CompletionGoal++;
-	CompletePastWritesBeforeFutureWrites();
 
-	Queue->NextEntryToWrite = NewNextEntryToWrite;
-	ReleaseSemaphore(Queue->Semaphore, 1, 0);
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = false;
+	Entry.Name = 0;
+
+	Win32AddWorkQueueEntries(Queue, &Entry, 1);
 }
 
+PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(Win32AddFiberWorkQueueEntry)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = true;
+	Entry.Name = 0;
+
+	Win32AddWorkQueueEntries(Queue, &Entry, 1);
+}
+
+PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(Win32AddBackgroundWorkQueueEntry)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	work_queue_entry Entry;
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	Entry.RunOnFiber = false;
+	Entry.Name = 0;
+
+	Win32CountWorkQueueEntry(Queue, &Entry);
+	if (PushWorkHeap(&Queue->Heap, Entry, Priority, DeadlineFrames, Win32AllocateMemory, Win32DeallocateMemory))
+		Win32WakeWorkQueueWorkers(Queue, 1);
+	else
+		Win32FinishWorkQueueEntry(Queue, &Entry); // NOTE(ivan): Out of memory, do the job right here rather than lose it.
+}
+
+// NOTE(ivan): Called by the main thread once a frame, starts the queue's next frame and does background entries.
+// Entries that are due are all done whatever the budget, so a frame running late cannot starve them,
+// the rest are done while SecondsLeft lasts. An entry is never cut short, so the last one may overrun the budget.
+static void
+Win32EndWorkQueueFrame(platform_state *PlatformState, work_queue *Queue, f32 SecondsLeft)
+{
+	Assert(PlatformState);
+	Assert(Queue);
+
+	AdvanceWorkHeapFrame(&Queue->Heap);
+
+	u64 Start = Win32GetClock();
+	work_queue_entry Entry;
+	while (PopWorkHeap(&Queue->Heap, &Entry, true))
+		Win32RunWorkQueueEntry(Queue, &Entry);
+	while (Win32GetSecondsElapsed(Start, Win32GetClock(), PlatformState->PerformanceFrequency) < SecondsLeft &&
+		   PopWorkHeap(&Queue->Heap, &Entry))
+		Win32RunWorkQueueEntry(Queue, &Entry);
+}
+
+// NOTE(ivan): Counters are never reset, since other threads may be adding entries at any time.
 PLATFORM_COMPLETE_WORK_QUEUE(Win32CompleteWorkQueue)
 {
+	Assert(Queue);
+
 	while (Queue->CompletionGoal != Queue->CompletionCount)
 		Win32DoNextWorkQueueEntry(Queue);
+}
 
-	Queue->CompletionGoal = Queue->CompletionCount = 0;
+PLATFORM_WAIT_FOR_WORK_GROUP(Win32WaitForWorkGroup)
+{
+	Assert(Queue);
+	Assert(Group);
+
+	// NOTE(ivan): Inside of a fiber, switch back to the worker and let it do something else till the group is done.
+	work_fiber *Fiber = Win32CurrentFiber;
+	if (Fiber) {
+		if (Group->State & WORK_GROUP_PENDING_MASK) {
+			Fiber->State = WorkFiberState_Waiting;
+			Fiber->WaitGroup = Group;
+			SwitchToFiber(Fiber->Worker->SchedulerFiber);
+		}
+
+		AtomicCompareExchangeU32(&Group->State, 0, WORK_GROUP_FIBER_WAITING);
+		return;
+	}
+
+	u32 Spin = 0;
+	for (;;) {
+		u32 State = Group->State;
+		if (!(State & WORK_GROUP_PENDING_MASK))
+			break;
+
+		// NOTE(ivan): Help out with whatever is there, it may well be the group's own entries.
+		if (!Win32DoNextWorkQueueEntry(Queue)) {
+			Spin = 0;
+		} else if (Spin < MUTEX_SPIN_COUNT) {
+			YieldProcessor();
+			Spin++;
+		} else if (!(State & WORK_GROUP_WAITING)) {
+			AtomicCompareExchangeU32(&Group->State, State | WORK_GROUP_WAITING, State);
+		} else {
+			// NOTE(ivan): Nothing to do but the group's entries others are running, sleep till one of them is done.
+			WaitOnAddressU32(&Group->State, State);
+		}
+	}
+
+	// NOTE(ivan): Spare future entries the wakes, unless the group has been reused already.
+	AtomicCompareExchangeU32(&Group->State, 0, WORK_GROUP_WAITING);
+}
+
+// NOTE(ivan): Work queue callback of a single parallel-for range.
+static WORK_QUEUE_CALLBACK(Win32DoParallelForRange)
+{
+	parallel_for_range *Range = (parallel_for_range *)Data;
+	parallel_for_job *Job = Range->Job;
+
+	// NOTE(ivan): Halving a u32 range takes 32 splits at most, and all of them are added at the cost of a single wake.
+	work_queue_entry Splits[32];
+	u32 NumSplits = 0;
+
+	u32 First = Range->First;
+	u32 OnePastLast = Range->OnePastLast;
+	while (OnePastLast - First > Job->Grain && NumSplits < CountOf(Splits)) {
+		u32 RangeIndex = AtomicAddU32(&Job->NumRanges, 1);
+		if (RangeIndex >= MAX_PARALLEL_FOR_RANGES)
+			break; // NOTE(ivan): Out of ranges, do all of what is left here.
+
+		u32 Middle = First + (OnePastLast - First) / 2;
+		parallel_for_range *Upper = Job->Ranges + RangeIndex;
+		Upper->Job = Job;
+		Upper->First = Middle;
+		Upper->OnePastLast = OnePastLast;
+
+		work_queue_entry *Split = Splits + NumSplits++;
+		Split->Callback = Win32DoParallelForRange;
+		Split->Data = Upper;
+		Split->Group = &Job->Group;
+		Split->RunOnFiber = false;
+		Split->Name = "ParallelFor";
+
+		OnePastLast = Middle;
+	}
+	Win32AddWorkQueueEntries(Queue, Splits, NumSplits);
+
+	Job->Callback(Job->Data, First, OnePastLast);
+}
+
+PLATFORM_PARALLEL_FOR(Win32ParallelFor)
+{
+	Assert(Queue);
+	Assert(Callback);
+
+	if (!Count)
+		return;
+
+	// NOTE(ivan): Grain adapts to the number of threads, but never goes below the one asked for.
+	u32 NumThreads = Queue->NumWorkers + 1;
+	u32 Grain = Max(Max(MinGrain, Count / (NumThreads * PARALLEL_FOR_RANGES_PER_THREAD)), 1u);
+	if (Count <= Grain) {
+		Callback(Data, 0, Count);
+		return;
+	}
+
+	parallel_for_job Job;
+	Job.Callback = Callback;
+	Job.Data = Data;
+	Job.Grain = Grain;
+	Job.Group = {};
+	Job.NumRanges = 1;
+	Job.Ranges[0].Job = &Job;
+	Job.Ranges[0].First = 0;
+	Job.Ranges[0].OnePastLast = Count;
+
+	// NOTE(ivan): The calling thread takes the whole range itself, splitting it off to others as it goes.
+	Win32DoParallelForRange(Queue, Job.Ranges);
+	Win32WaitForWorkGroup(Queue, &Job.Group);
 }
 
 PLATFORM_READ_ENTIRE_FILE(Win32ReadEntireFile)
@@ -903,6 +1670,33 @@ Win32WindowProc(HWND Window,
 	return 0;
 }
 
+// NOTE(ivan): Starts a work queues' profile capture, or stops the running one and writes it out next to the log.
+static void
+Win32ToggleWorkProfileCapture(platform_state *PlatformState)
+{
+	Assert(PlatformState);
+
+	if (!Win32WorkProfiler.IsCapturing) {
+		StartWorkProfileCapture(&Win32WorkProfiler, Win32GetClock());
+		Win32Log(PlatformState, "Work queues profile capture started.");
+		return;
+	}
+
+	Win32WorkProfiler.IsCapturing = false;
+
+	char FileName[sizeof(PlatformState->ExeNameNoExt) + sizeof("_jobs.json")] = {};
+	snprintf(FileName, CountOf(FileName) - 1, "%s_jobs.json", PlatformState->ExeNameNoExt);
+
+	piece Trace = FormatWorkProfileTrace(&Win32WorkProfiler, PlatformState->PerformanceFrequency, Win32AllocateMemory, Win32DeallocateMemory);
+	if (Trace.Memory && Win32WriteEntireFile(FileName, Trace.Memory, SafeTruncateU64(Trace.Bytes)))
+		Win32Log(PlatformState, "Work queues profile capture written to '%s'.", FileName);
+	else
+		Win32Log(PlatformState, "Failed writing work queues profile capture to '%s'!", FileName);
+
+	if (Trace.Memory)
+		Win32DeallocateMemory(Trace.Memory);
+}
+
 int CALLBACK
 WinMain(HINSTANCE Instance,
 		HINSTANCE PrevInstance,
@@ -916,6 +1710,7 @@ WinMain(HINSTANCE Instance,
 	PlatformState.Running = true;
 
 	PlatformState.Instance = Instance;
+	Win32MainThreadID = GetCurrentThreadId();
 	PlatformState.ShowCommand = ShowCommand;
 
 	// TODO(ivan): Are these UTF-8 or ANSI?
@@ -993,8 +1788,36 @@ WinMain(HINSTANCE Instance,
 	Verify(SUCCEEDED(CoInitializeEx(0, COINIT_MULTITHREADED)));
 
 	// NOTE(ivan): Initialize work queues for multithreading.
-	Win32InitializeWorkQueue(&PlatformState, &PlatformState.HighPriorityWorkQueue, 6);
-	Win32InitializeWorkQueue(&PlatformState, &PlatformState.LowPriorityWorkQueue, 2);
+	// High-priority workers get one physical core each except the first one, which is left for the main thread,
+	// SMT siblings share execution units so they do not count. Low-priority workers only soak up idle time.
+	cpu_topology Topology;
+	Win32DetectCPUTopology(&Topology);
+
+	u32 NumHighPriorityThreads = Max(Topology.NumCores, 2u) - 1;
+	u32 NumLowPriorityThreads = Max(Topology.NumCores / 4, 1u);
+
+	const char *HighThreadsParam = Win32CheckParamValue(&PlatformState, "-highthreads");
+	if (HighThreadsParam)
+		NumHighPriorityThreads = (u32)Min(Max(atoi(HighThreadsParam), 1), 256);
+	const char *LowThreadsParam = Win32CheckParamValue(&PlatformState, "-lowthreads");
+	if (LowThreadsParam)
+		NumLowPriorityThreads = (u32)Min(Max(atoi(LowThreadsParam), 1), 256);
+
+	b32 IsPinned = (Win32CheckParam(&PlatformState, "-noaffinity") == -1);
+	u32 FirstWorkerCore = (Topology.NumCores > 1) ? 1 : 0;
+
+	Win32Log(&PlatformState, "CPU: %u logical CPUs, %u physical cores, %u high-priority and %u low-priority workers%s.",
+			 Topology.NumLogicalCPUs, Topology.NumCores, NumHighPriorityThreads, NumLowPriorityThreads,
+			 IsPinned ? "" : ", not pinned");
+
+	Win32InitializeWorkQueue(&PlatformState, &PlatformState.HighPriorityWorkQueue, "High-priority", NumHighPriorityThreads,
+							 IsPinned ? &Topology : 0, FirstWorkerCore);
+	Win32InitializeWorkQueue(&PlatformState, &PlatformState.LowPriorityWorkQueue, "Low-priority", NumLowPriorityThreads,
+							 0, 0, true);
+
+	// NOTE(ivan): Profile work queues from the very start if requested, the capture is written out on exit.
+	if (Win32CheckParam(&PlatformState, "-profilework") != -1)
+		Win32ToggleWorkProfileCapture(&PlatformState);
 
 	// NOTE(ivan): Initialize platform API structure.
 	platform_api PlatformAPI = {};
@@ -1005,8 +1828,18 @@ WinMain(HINSTANCE Instance,
 	PlatformAPI.AllocateMemory = Win32AllocateMemory;
 	PlatformAPI.DeallocateMemory = Win32DeallocateMemory;
 	PlatformAPI.GetMemoryStats = Win32GetMemoryStats;
+	PlatformAPI.ReserveMemory = Win32ReserveMemory;
+	PlatformAPI.CommitMemory = Win32CommitMemory;
+	PlatformAPI.DecommitMemory = Win32DecommitMemory;
+	PlatformAPI.ReleaseMemory = Win32ReleaseMemory;
+	PlatformAPI.GetThreadScratch = Win32GetThreadScratch;
 	PlatformAPI.AddWorkQueueEntry = Win32AddWorkQueueEntry;
+	PlatformAPI.AddFiberWorkQueueEntry = Win32AddFiberWorkQueueEntry;
+	PlatformAPI.AddWorkQueueEntries = Win32AddWorkQueueEntries;
+	PlatformAPI.AddBackgroundWorkQueueEntry = Win32AddBackgroundWorkQueueEntry;
 	PlatformAPI.CompleteWorkQueue = Win32CompleteWorkQueue;
+	PlatformAPI.WaitForWorkGroup = Win32WaitForWorkGroup;
+	PlatformAPI.ParallelFor = Win32ParallelFor;
 	PlatformAPI.ReadEntireFile = Win32ReadEntireFile;
 	PlatformAPI.FreeEntireFileMemory = Win32FreeEntireFileMemory;
 	PlatformAPI.WriteEntireFile = Win32WriteEntireFile;
@@ -1078,6 +1911,12 @@ WinMain(HINSTANCE Instance,
 	u64 LastFPSCounter = Win32GetClock();
 	u32 NumFrames = 0;
 
+	// NOTE(ivan): Frame time the main thread spends on background work whatever is left of, frames are not capped by it.
+	f32 TargetSecondsPerFrame = 1.0f / 60.0f;
+	const char *TargetFPSParam = Win32CheckParamValue(&PlatformState, "-targetfps");
+	if (TargetFPSParam)
+		TargetSecondsPerFrame = 1.0f / (f32)Min(Max(atoi(TargetFPSParam), 1), 1000);
+
 	// NOTE(ivan): Primary cycle.
 	MSG Msg = {};
 	while (PlatformState.Running) {
@@ -1193,6 +2032,8 @@ WinMain(HINSTANCE Instance,
 #if INTERNAL		
 		if (IsSinglePress(Input.KeyboardButtons[KeyCode_F2]))
 			PlatformState.DebugCursor = !PlatformState.DebugCursor;
+		if (IsSinglePress(Input.KeyboardButtons[KeyCode_F6]))
+			Win32ToggleWorkProfileCapture(&PlatformState);
 #endif
 		if (Input.KeyboardButtons[KeyCode_LeftAlt].IsDown && IsSinglePress(Input.KeyboardButtons[KeyCode_Enter]))
 			Win32ToggleFullscreen(PlatformState.MainWindow, &PlatformState.MainWindowPlacement);
@@ -1232,6 +2073,11 @@ WinMain(HINSTANCE Instance,
 		if (PlatformAPI.QuitRequested)
 			PlatformState.Running = false;
 
+		// NOTE(ivan): Start work queues' next frame, doing background work in what is left of this one.
+		f32 SecondsLeft = TargetSecondsPerFrame - Win32GetSecondsElapsed(LastCycleCounter, Win32GetClock(), PlatformState.PerformanceFrequency);
+		Win32EndWorkQueueFrame(&PlatformState, &PlatformState.HighPriorityWorkQueue, 0.0f);
+		Win32EndWorkQueueFrame(&PlatformState, &PlatformState.LowPriorityWorkQueue, SecondsLeft);
+
 		// NOTE(ivan): Finish timings.
 		u64 EndCycleCounter = Win32GetClock();
 		u64 EndFPSCounter = Win32GetClock();
@@ -1281,10 +2127,17 @@ WinMain(HINSTANCE Instance,
 	// NOTE(ivan): Unload XInput library.
 	Win32FreeXInput(&PlatformState.XInput);
 
+	// NOTE(ivan): Write out the capture if still running.
+	if (Win32WorkProfiler.IsCapturing)
+		Win32ToggleWorkProfileCapture(&PlatformState);
+
 	// NOTE(ivan): Release work queues.
 	Win32ReleaseWorkQueue(&PlatformState.HighPriorityWorkQueue);
 	Win32ReleaseWorkQueue(&PlatformState.LowPriorityWorkQueue);
 
+	// NOTE(ivan): Release main thread scratch stack.
+	FreeMemoryStack(&PlatformAPI, Win32GetThreadScratch());
+
 	// NOTE(ivan): Release graphics subsystem.
 	if (PlatformState.SurfaceBuffer.Pixels)
 		Win32DeallocateMemory(PlatformState.SurfaceBuffer.Pixels);
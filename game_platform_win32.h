@@ -93,28 +93,91 @@ Win32GetSecondsElapsed(u64 Start, u64 End, u64 Frequency)
 	return (f32)(Diff / (f64)Frequency);
 }
 
-// NOTE(ivan): Work queue entry structure.
-struct work_queue_entry {
-	work_queue_callback *Callback;
-	void *Data;
+// NOTE(ivan): Maximal number of physical cores worker threads are spread over.
+#define MAX_CPU_CORES 64
+
+// NOTE(ivan): Logical CPUs the process is allowed to run on, SMT siblings grouped by physical core.
+struct cpu_topology {
+	u32 NumLogicalCPUs;
+	u32 NumCores;
+	DWORD_PTR CoreMasks[MAX_CPU_CORES];
 };
 
-// NOTE(ivan): Work queue thread startup parameters structure.
-struct work_queue_startup {
+// NOTE(ivan): Number of fibers per work queue, that is how many fiber entries may be started and not done yet at once.
+#define WORK_QUEUE_FIBERS 64
+// NOTE(ivan): Fiber stack size.
+#define WORK_FIBER_STACK_SIZE Kilobytes(256)
+
+// NOTE(ivan): Work queue worker thread, also its startup parameters.
+struct work_queue_worker {
+	work_queue *Queue;
+	work_deque Deque; // NOTE(ivan): Entries added by this worker's own jobs.
+
+	LPVOID SchedulerFiber; // NOTE(ivan): The worker thread itself, converted to a fiber, fibers running on it switch back here.
+
+	HANDLE Thread; // NOTE(ivan): Waited for on release, the queue storage outlives every worker.
+};
+
+enum work_fiber_state {
+	WorkFiberState_Running,
+	WorkFiberState_Waiting,
+	WorkFiberState_Done
+};
+
+// NOTE(ivan): Fiber that runs fiber work queue entries, one at a time, and is reused afterwards.
+struct work_fiber {
+	LPVOID Handle;
+
 	work_queue *Queue;
+	work_queue_worker *Worker; // NOTE(ivan): Worker the fiber runs on, updated on every switch to it.
+
+	work_queue_entry Entry;
+	work_fiber_state State;
+	work_group *WaitGroup;
+
+	work_fiber *Next; // NOTE(ivan): Free or ready list link.
 };
 
 // NOTE(ivan): Work queue implementation.
+// Every worker has its own deque and steals from the others once it runs dry,
+// entries added from outside of the workers go to the ring, or to the overflow queue once the ring is full.
+// Background entries wait in the heap till nothing else is left.
 struct work_queue {
+	const char *Name; // NOTE(ivan): Shown by the profiler.
+
 	volatile u32 CompletionGoal;
 	volatile u32 CompletionCount;
 
-	volatile u32 NextEntryToWrite;
-	volatile u32 NextEntryToRead;
+	// NOTE(ivan): Idle workers park on the semaphore, it is released only when entries are added while anyone sleeps.
 	HANDLE Semaphore;
+	volatile u32 NumSleepers;
+
+	volatile b32 Quit; // NOTE(ivan): Set on release, workers exit instead of looking for more entries.
+
+	u32 NumWorkers;
+	work_queue_worker *Workers;
+
+	work_ring Ring;
+
+	// NOTE(ivan): Unbounded locked FIFO ring, grows by doubling.
+	ticket_mutex OverflowMutex;
+	volatile u32 NumOverflowEntries;
+	u32 FirstOverflowEntry;
+	u32 MaxOverflowEntries;
+	work_queue_entry *OverflowEntries;
+
+	work_heap Heap; // NOTE(ivan): Background entries, picked up once there are no others.
+
+	b32 IsLowPriority; // NOTE(ivan): Workers run at THREAD_PRIORITY_IDLE.
 
-	work_queue_startup *Startups;
-	work_queue_entry Entries[256];
+	// NOTE(ivan): Fiber pool, all fibers and their stacks are created up front.
+	// Free fibers and suspended ones that are ready to be resumed are kept in lists under one lock.
+	ticket_mutex FiberMutex;
+	work_fiber *Fibers;
+	work_fiber *FirstFreeFiber;
+	work_fiber *FirstReadyFiber;
+	work_fiber *LastReadyFiber;
+	volatile u32 NumReadyFibers;
 };
 
 // NOTE(ivan): Platform-specific window dimensions.
@@ -209,8 +272,18 @@ PLATFORM_ERROR(Win32Error);
 PLATFORM_ALLOCATE_MEMORY(Win32AllocateMemory);
 PLATFORM_DEALLOCATE_MEMORY(Win32DeallocateMemory);
 PLATFORM_GET_MEMORY_STATS(Win32GetMemoryStats);
+PLATFORM_RESERVE_MEMORY(Win32ReserveMemory);
+PLATFORM_COMMIT_MEMORY(Win32CommitMemory);
+PLATFORM_DECOMMIT_MEMORY(Win32DecommitMemory);
+PLATFORM_RELEASE_MEMORY(Win32ReleaseMemory);
+PLATFORM_GET_THREAD_SCRATCH(Win32GetThreadScratch);
 PLATFORM_ADD_WORK_QUEUE_ENTRY(Win32AddWorkQueueEntry);
+PLATFORM_ADD_FIBER_WORK_QUEUE_ENTRY(Win32AddFiberWorkQueueEntry);
+PLATFORM_ADD_WORK_QUEUE_ENTRIES(Win32AddWorkQueueEntries);
+PLATFORM_ADD_BACKGROUND_WORK_QUEUE_ENTRY(Win32AddBackgroundWorkQueueEntry);
 PLATFORM_COMPLETE_WORK_QUEUE(Win32CompleteWorkQueue);
+PLATFORM_WAIT_FOR_WORK_GROUP(Win32WaitForWorkGroup);
+PLATFORM_PARALLEL_FOR(Win32ParallelFor);
 PLATFORM_READ_ENTIRE_FILE(Win32ReadEntireFile);
 PLATFORM_FREE_ENTIRE_FILE_MEMORY(Win32FreeEntireFileMemory);
 PLATFORM_WRITE_ENTIRE_FILE(Win32WriteEntireFile);
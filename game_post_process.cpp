@@ -0,0 +1,508 @@
+#include "game.h"
+#include "game_post_process.h"
+
+// NOTE(ivan): Every pass works on 0xAARRGGBB pixels, four pixels per SSE register,
+// with channels widened to 16-bit lanes where sums are needed.
+
+// NOTE(ivan): Post-process pass types.
+enum post_process_pass_type {
+	PostProcessPass_Downsample,
+	PostProcessPass_BlurHorizontal,
+	PostProcessPass_BlurVertical,
+	PostProcessPass_Upsample
+};
+
+// NOTE(ivan): Single band of a post-process pass, executed through ParallelFor().
+struct post_process_job {
+	post_process_pass_type Type;
+	image *Source;
+	image *Dest;
+
+	// NOTE(ivan): Destination rows range [Y0, Y1).
+	s32 Y0;
+	s32 Y1;
+
+	s32 Radius; // NOTE(ivan): Blur passes.
+	u8 Threshold; // NOTE(ivan): Downsample pass.
+	b32 Additive; // NOTE(ivan): Upsample pass, add to destination instead of replacing it.
+	u16 Intensity; // NOTE(ivan): Upsample pass, additive scale in 8.8 fixed point.
+
+	// NOTE(ivan): Upsample pass takes its row scratch from the thread scratch stack.
+	platform_state *PlatformState;
+	platform_api *PlatformAPI;
+};
+
+inline u32 *
+GetImageRow(image *Image, s32 Y)
+{
+	return (u32 *)((u8 *)Image->Pixels + Y * Image->Pitch);
+}
+
+inline s32
+ClampS32(s32 Value, s32 MinValue, s32 MaxValue)
+{
+	if (Value < MinValue)
+		return MinValue;
+	if (Value > MaxValue)
+		return MaxValue;
+	return Value;
+}
+
+// NOTE(ivan): Scalar per-channel rounding average, matches _mm_avg_epu8() exactly.
+inline u32
+AveragePixels(u32 A, u32 B)
+{
+	u32 Result = 0;
+	for (u32 Shift = 0; Shift < 32; Shift += 8) {
+		u32 CA = (A >> Shift) & 0xFF;
+		u32 CB = (B >> Shift) & 0xFF;
+		Result |= (((CA + CB + 1) >> 1) << Shift);
+	}
+	return Result;
+}
+
+inline u32
+SubtractPixelsSaturated(u32 A, u32 B)
+{
+	u32 Result = 0;
+	for (u32 Shift = 0; Shift < 32; Shift += 8) {
+		s32 C = (s32)((A >> Shift) & 0xFF) - (s32)((B >> Shift) & 0xFF);
+		Result |= ((u32)Max(C, 0) << Shift);
+	}
+	return Result;
+}
+
+inline u32
+AddScaledPixelSaturated(u32 Dest, u32 Source, u16 Intensity)
+{
+	u32 Result = 0;
+	for (u32 Shift = 0; Shift < 32; Shift += 8) {
+		u32 CS = ((((Source >> Shift) & 0xFF) << 8) * Intensity) >> 16;
+		u32 C = ((Dest >> Shift) & 0xFF) + CS;
+		Result |= (Min(C, 255u) << Shift);
+	}
+	return Result;
+}
+
+static void
+DownsamplePass(post_process_job *Job)
+{
+	image *Source = Job->Source;
+	image *Dest = Job->Dest;
+
+	u32 Threshold32 = (((u32)Job->Threshold << 16) | ((u32)Job->Threshold << 8) | (u32)Job->Threshold);
+	__m128i Threshold = _mm_set1_epi32((int)Threshold32);
+
+	for (s32 Y = Job->Y0; Y < Job->Y1; Y++) {
+		u32 *SourceRow0 = GetImageRow(Source, Y * 2);
+		u32 *SourceRow1 = GetImageRow(Source, Y * 2 + 1);
+		u32 *DestRow = GetImageRow(Dest, Y);
+
+		s32 X = 0;
+		for (; X + 4 <= Dest->Width; X += 4) {
+			__m128i A = _mm_avg_epu8(_mm_loadu_si128((__m128i *)(SourceRow0 + X * 2)),
+									 _mm_loadu_si128((__m128i *)(SourceRow1 + X * 2)));
+			__m128i B = _mm_avg_epu8(_mm_loadu_si128((__m128i *)(SourceRow0 + X * 2 + 4)),
+									 _mm_loadu_si128((__m128i *)(SourceRow1 + X * 2 + 4)));
+
+			// NOTE(ivan): Deinterleave even and odd source pixels.
+			__m128i Even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(A), _mm_castsi128_ps(B), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i Odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(A), _mm_castsi128_ps(B), _MM_SHUFFLE(3, 1, 3, 1)));
+
+			__m128i Result = _mm_subs_epu8(_mm_avg_epu8(Even, Odd), Threshold);
+			_mm_storeu_si128((__m128i *)(DestRow + X), Result);
+		}
+		for (; X < Dest->Width; X++) {
+			u32 Even = AveragePixels(SourceRow0[X * 2], SourceRow1[X * 2]);
+			u32 Odd = AveragePixels(SourceRow0[X * 2 + 1], SourceRow1[X * 2 + 1]);
+			DestRow[X] = SubtractPixelsSaturated(AveragePixels(Even, Odd), Threshold32);
+		}
+	}
+}
+
+// NOTE(ivan): Box filter normalization is (Sum * Reciprocal) >> 16, rounded up so a flat 255 stays 255.
+inline u16
+GetBoxReciprocal(s32 Radius)
+{
+	u32 Taps = (u32)(Radius * 2 + 1);
+	return (u16)((65535 + Taps) / Taps);
+}
+
+inline u32
+BoxFilterPixel(u32 **Taps, s32 NumTaps, u16 Reciprocal)
+{
+	u32 Result = 0;
+	for (u32 Shift = 0; Shift < 32; Shift += 8) {
+		u32 Sum = 0;
+		for (s32 Tap = 0; Tap < NumTaps; Tap++)
+			Sum += ((*Taps[Tap]) >> Shift) & 0xFF;
+		Result |= (((Sum * Reciprocal) >> 16) << Shift);
+	}
+	return Result;
+}
+
+static void
+BlurHorizontalPass(post_process_job *Job)
+{
+	image *Source = Job->Source;
+	image *Dest = Job->Dest;
+	s32 Radius = Job->Radius;
+	s32 NumTaps = Radius * 2 + 1;
+	s32 Width = Dest->Width;
+
+	u16 Reciprocal = GetBoxReciprocal(Radius);
+	__m128i Reciprocal16 = _mm_set1_epi16((short)Reciprocal);
+	__m128i Zero = _mm_setzero_si128();
+
+	u32 *Taps[MAX_POST_PROCESS_RADIUS * 2 + 1];
+
+	for (s32 Y = Job->Y0; Y < Job->Y1; Y++) {
+		u32 *SourceRow = GetImageRow(Source, Y);
+		u32 *DestRow = GetImageRow(Dest, Y);
+
+		s32 X = 0;
+		while (X < Width) {
+			if (X >= Radius && (X + 3 + Radius) < Width) {
+				__m128i SumLo = Zero;
+				__m128i SumHi = Zero;
+				for (s32 Tap = -Radius; Tap <= Radius; Tap++) {
+					__m128i Pixels = _mm_loadu_si128((__m128i *)(SourceRow + X + Tap));
+					SumLo = _mm_add_epi16(SumLo, _mm_unpacklo_epi8(Pixels, Zero));
+					SumHi = _mm_add_epi16(SumHi, _mm_unpackhi_epi8(Pixels, Zero));
+				}
+
+				__m128i Result = _mm_packus_epi16(_mm_mulhi_epu16(SumLo, Reciprocal16),
+												  _mm_mulhi_epu16(SumHi, Reciprocal16));
+				_mm_storeu_si128((__m128i *)(DestRow + X), Result);
+				X += 4;
+			} else {
+				// NOTE(ivan): Border pixels, clamp to edge.
+				for (s32 Tap = 0; Tap < NumTaps; Tap++)
+					Taps[Tap] = SourceRow + ClampS32(X + Tap - Radius, 0, Width - 1);
+				DestRow[X] = BoxFilterPixel(Taps, NumTaps, Reciprocal);
+				X++;
+			}
+		}
+	}
+}
+
+static void
+BlurVerticalPass(post_process_job *Job)
+{
+	image *Source = Job->Source;
+	image *Dest = Job->Dest;
+	s32 Radius = Job->Radius;
+	s32 NumTaps = Radius * 2 + 1;
+
+	u16 Reciprocal = GetBoxReciprocal(Radius);
+	__m128i Reciprocal16 = _mm_set1_epi16((short)Reciprocal);
+	__m128i Zero = _mm_setzero_si128();
+
+	u32 *Rows[MAX_POST_PROCESS_RADIUS * 2 + 1];
+	u32 *Taps[MAX_POST_PROCESS_RADIUS * 2 + 1];
+
+	for (s32 Y = Job->Y0; Y < Job->Y1; Y++) {
+		// NOTE(ivan): Rows are clamped to edge, so every column can go through the SIMD path.
+		for (s32 Tap = 0; Tap < NumTaps; Tap++)
+			Rows[Tap] = GetImageRow(Source, ClampS32(Y + Tap - Radius, 0, Source->Height - 1));
+		u32 *DestRow = GetImageRow(Dest, Y);
+
+		s32 X = 0;
+		for (; X + 4 <= Dest->Width; X += 4) {
+			__m128i SumLo = Zero;
+			__m128i SumHi = Zero;
+			for (s32 Tap = 0; Tap < NumTaps; Tap++) {
+				__m128i Pixels = _mm_loadu_si128((__m128i *)(Rows[Tap] + X));
+				SumLo = _mm_add_epi16(SumLo, _mm_unpacklo_epi8(Pixels, Zero));
+				SumHi = _mm_add_epi16(SumHi, _mm_unpackhi_epi8(Pixels, Zero));
+			}
+
+			__m128i Result = _mm_packus_epi16(_mm_mulhi_epu16(SumLo, Reciprocal16),
+											  _mm_mulhi_epu16(SumHi, Reciprocal16));
+			_mm_storeu_si128((__m128i *)(DestRow + X), Result);
+		}
+		for (; X < Dest->Width; X++) {
+			for (s32 Tap = 0; Tap < NumTaps; Tap++)
+				Taps[Tap] = Rows[Tap] + X;
+			DestRow[X] = BoxFilterPixel(Taps, NumTaps, Reciprocal);
+		}
+	}
+}
+
+static void
+UpsamplePass(post_process_job *Job, u32 *RowScratch)
+{
+	image *Source = Job->Source;
+	image *Dest = Job->Dest;
+	s32 HalfWidth = Source->Width;
+
+	__m128i Zero = _mm_setzero_si128();
+	__m128i Intensity = _mm_set1_epi16((short)Job->Intensity);
+
+	// NOTE(ivan): Row scratch is padded by one pixel on the left and at least four on the right,
+	// so neighbour taps never need clamping inside the SIMD loop.
+	u32 *Row = RowScratch + 1;
+
+	for (s32 Y = Job->Y0; Y < Job->Y1; Y++) {
+		// NOTE(ivan): Bilinear 2x upsampling, weights are 3/4 for the nearest half-res sample and 1/4 for the other one.
+		s32 NearY = Min(Y >> 1, Source->Height - 1);
+		s32 FarY = ClampS32((Y & 1) ? (NearY + 1) : (NearY - 1), 0, Source->Height - 1);
+		u32 *NearRow = GetImageRow(Source, NearY);
+		u32 *FarRow = GetImageRow(Source, FarY);
+
+		s32 X = 0;
+		for (; X + 4 <= HalfWidth; X += 4) {
+			__m128i Near = _mm_loadu_si128((__m128i *)(NearRow + X));
+			__m128i Far = _mm_loadu_si128((__m128i *)(FarRow + X));
+			_mm_storeu_si128((__m128i *)(Row + X), _mm_avg_epu8(Near, _mm_avg_epu8(Near, Far)));
+		}
+		for (; X < HalfWidth; X++)
+			Row[X] = AveragePixels(NearRow[X], AveragePixels(NearRow[X], FarRow[X]));
+
+		Row[-1] = Row[0];
+		for (s32 Pad = 0; Pad < 4; Pad++)
+			Row[HalfWidth + Pad] = Row[HalfWidth - 1];
+
+		u32 *DestRow = GetImageRow(Dest, Y);
+
+		s32 HalfX = 0;
+		for (; (HalfX * 2 + 8) <= Dest->Width; HalfX += 4) {
+			__m128i Center = _mm_loadu_si128((__m128i *)(Row + HalfX));
+			__m128i Left = _mm_loadu_si128((__m128i *)(Row + HalfX - 1));
+			__m128i Right = _mm_loadu_si128((__m128i *)(Row + HalfX + 1));
+
+			__m128i Even = _mm_avg_epu8(Center, _mm_avg_epu8(Center, Left));
+			__m128i Odd = _mm_avg_epu8(Center, _mm_avg_epu8(Center, Right));
+
+			__m128i Result[2];
+			Result[0] = _mm_unpacklo_epi32(Even, Odd);
+			Result[1] = _mm_unpackhi_epi32(Even, Odd);
+
+			for (u32 Index = 0; Index < 2; Index++) {
+				__m128i *DestPixels = (__m128i *)(DestRow + HalfX * 2 + Index * 4);
+				if (Job->Additive) {
+					__m128i ScaledLo = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpacklo_epi8(Result[Index], Zero), 8), Intensity);
+					__m128i ScaledHi = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpackhi_epi8(Result[Index], Zero), 8), Intensity);
+					__m128i Scaled = _mm_packus_epi16(ScaledLo, ScaledHi);
+					_mm_storeu_si128(DestPixels, _mm_adds_epu8(_mm_loadu_si128(DestPixels), Scaled));
+				} else {
+					_mm_storeu_si128(DestPixels, Result[Index]);
+				}
+			}
+		}
+		for (X = HalfX * 2; X < Dest->Width; X++) {
+			s32 CenterX = X >> 1;
+			u32 Center = Row[CenterX];
+			u32 Other = (X & 1) ? Row[CenterX + 1] : Row[CenterX - 1];
+			u32 Color = AveragePixels(Center, AveragePixels(Center, Other));
+
+			if (Job->Additive)
+				DestRow[X] = AddScaledPixelSaturated(DestRow[X], Color, Job->Intensity);
+			else
+				DestRow[X] = Color;
+		}
+	}
+}
+
+static PARALLEL_FOR_CALLBACK(DoPostProcessRows)
+{
+	post_process_job Band = *(post_process_job *)Data;
+	post_process_job *Job = &Band;
+	Job->Y0 = (s32)First;
+	Job->Y1 = (s32)OnePastLast;
+
+	switch (Job->Type) {
+	case PostProcessPass_Downsample: {
+		DownsamplePass(Job);
+	} break;
+
+	case PostProcessPass_BlurHorizontal: {
+		BlurHorizontalPass(Job);
+	} break;
+
+	case PostProcessPass_BlurVertical: {
+		BlurVerticalPass(Job);
+	} break;
+
+	case PostProcessPass_Upsample: {
+		// NOTE(ivan): Padded by one pixel on the left and by up to eight on the right, see UpsamplePass().
+		memory_stack *Scratch = Job->PlatformAPI->GetThreadScratch();
+		temporary_memory TempMemory = BeginTemporaryMemory(Scratch);
+
+		u32 *RowScratch = PushStackTypeArray(Job->PlatformState, Job->PlatformAPI, Scratch, u32, Job->Source->Width + 8);
+		if (RowScratch)
+			UpsamplePass(Job, RowScratch);
+
+		EndTemporaryMemory(TempMemory);
+	} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+// NOTE(ivan): Splits a pass into row bands and runs them on the high-priority work queue.
+static void
+RunPostProcessPass(platform_api *PlatformAPI,
+				   post_process_job *Template)
+{
+	Assert(PlatformAPI);
+	Assert(Template);
+	Assert(Template->Source != Template->Dest);
+
+	static const u32 MinRowsPerBand = 16;
+
+	PlatformAPI->ParallelFor(PlatformAPI->HighPriorityWorkQueue, Template->Dest->Height, MinRowsPerBand,
+							 DoPostProcessRows, Template);
+}
+
+static void
+FreePostProcessBuffers(platform_api *PlatformAPI,
+					   post_process *PostProcess)
+{
+	Assert(PlatformAPI);
+	Assert(PostProcess);
+
+	if (PostProcess->HalfA.Pixels)
+		FreeImage(PlatformAPI, &PostProcess->HalfA);
+	if (PostProcess->HalfB.Pixels)
+		FreeImage(PlatformAPI, &PostProcess->HalfB);
+
+	PostProcess->HalfA.Pixels = 0;
+	PostProcess->HalfB.Pixels = 0;
+	PostProcess->SurfaceWidth = 0;
+	PostProcess->SurfaceHeight = 0;
+}
+
+static b32
+PrepareHalfImage(platform_state *PlatformState,
+				 platform_api *PlatformAPI,
+				 image *Image,
+				 s32 Width, s32 Height)
+{
+	Image->Width = Width;
+	Image->Height = Height;
+	Image->BytesPerPixel = 4;
+	Image->Pitch = Width * Image->BytesPerPixel;
+	Image->Pixels = AllocateTrackedMemory(PlatformState, PlatformAPI, "PostProcess", Image->Pitch * Height);
+
+	return (Image->Pixels != 0);
+}
+
+static b32
+ResizePostProcess(platform_state *PlatformState,
+				  platform_api *PlatformAPI,
+				  post_process *PostProcess,
+				  s32 Width, s32 Height)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(PostProcess);
+
+	if (PostProcess->SurfaceWidth == Width && PostProcess->SurfaceHeight == Height)
+		return true;
+
+	FreePostProcessBuffers(PlatformAPI, PostProcess);
+
+	s32 HalfWidth = Width / 2;
+	s32 HalfHeight = Height / 2;
+
+	if (!PrepareHalfImage(PlatformState, PlatformAPI, &PostProcess->HalfA, HalfWidth, HalfHeight) ||
+		!PrepareHalfImage(PlatformState, PlatformAPI, &PostProcess->HalfB, HalfWidth, HalfHeight)) {
+		FreePostProcessBuffers(PlatformAPI, PostProcess);
+		PlatformAPI->Log(PlatformState, "PostProcess: Out of memory!");
+		return false;
+	}
+
+	PostProcess->SurfaceWidth = Width;
+	PostProcess->SurfaceHeight = Height;
+
+	return true;
+}
+
+// NOTE(ivan): Downsamples into HalfA, blurs HalfA -> HalfB -> HalfA, and upsamples back onto the surface.
+static void
+RunBlurChain(platform_state *PlatformState,
+			 platform_api *PlatformAPI,
+			 post_process *PostProcess,
+			 image *Surface,
+			 s32 Radius,
+			 u8 Threshold,
+			 b32 Additive,
+			 f32 Intensity)
+{
+	post_process_job Template = {};
+	Template.PlatformState = PlatformState;
+	Template.PlatformAPI = PlatformAPI;
+
+	Template.Type = PostProcessPass_Downsample;
+	Template.Source = Surface;
+	Template.Dest = &PostProcess->HalfA;
+	Template.Threshold = Threshold;
+	RunPostProcessPass(PlatformAPI, &Template);
+
+	Template.Type = PostProcessPass_BlurHorizontal;
+	Template.Source = &PostProcess->HalfA;
+	Template.Dest = &PostProcess->HalfB;
+	Template.Radius = ClampS32(Radius, MIN_POST_PROCESS_RADIUS, MAX_POST_PROCESS_RADIUS);
+	RunPostProcessPass(PlatformAPI, &Template);
+
+	Template.Type = PostProcessPass_BlurVertical;
+	Template.Source = &PostProcess->HalfB;
+	Template.Dest = &PostProcess->HalfA;
+	RunPostProcessPass(PlatformAPI, &Template);
+
+	Template.Type = PostProcessPass_Upsample;
+	Template.Source = &PostProcess->HalfA;
+	Template.Dest = Surface;
+	Template.Additive = Additive;
+	Template.Intensity = (u16)Min(Max(Intensity, 0.0f) * 256.0f, 65535.0f);
+	RunPostProcessPass(PlatformAPI, &Template);
+}
+
+void
+ApplyPostProcess(platform_state *PlatformState,
+				 platform_api *PlatformAPI,
+				 post_process *PostProcess,
+				 game_surface_buffer *Buffer)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(PostProcess);
+	Assert(Buffer);
+	Assert(Buffer->BytesPerPixel == 4);
+
+	if (!PostProcess->BlurEnabled && !PostProcess->BloomEnabled)
+		return;
+	if (Buffer->Width < 8 || Buffer->Height < 8)
+		return;
+
+	if (!ResizePostProcess(PlatformState, PlatformAPI, PostProcess, Buffer->Width, Buffer->Height))
+		return;
+
+	image Surface;
+	Surface.Pixels = Buffer->Pixels;
+	Surface.Width = Buffer->Width;
+	Surface.Height = Buffer->Height;
+	Surface.BytesPerPixel = Buffer->BytesPerPixel;
+	Surface.Pitch = Buffer->Pitch;
+
+	if (PostProcess->BlurEnabled)
+		RunBlurChain(PlatformState, PlatformAPI, PostProcess, &Surface,
+					 PostProcess->BlurRadius, 0, false, 1.0f);
+
+	if (PostProcess->BloomEnabled) {
+		f32 Threshold = Min(Max(PostProcess->BloomThreshold, 0.0f), 1.0f);
+		RunBlurChain(PlatformState, PlatformAPI, PostProcess, &Surface,
+					 PostProcess->BloomRadius, (u8)roundf(Threshold * 255.0f), true, PostProcess->BloomIntensity);
+	}
+}
+
+void
+FreePostProcess(platform_api *PlatformAPI,
+				post_process *PostProcess)
+{
+	Assert(PlatformAPI);
+	Assert(PostProcess);
+
+	FreePostProcessBuffers(PlatformAPI, PostProcess);
+}
@@ -0,0 +1,37 @@
+#ifndef GAME_POST_PROCESS_H
+#define GAME_POST_PROCESS_H
+
+#include "game_platform.h"
+#include "game_image.h"
+
+// NOTE(ivan): Box blur radius limits, in half-resolution pixels.
+#define MIN_POST_PROCESS_RADIUS 1
+#define MAX_POST_PROCESS_RADIUS 16
+
+// NOTE(ivan): Post-process chain settings and reduced-resolution scratch buffers.
+// NOTE(ivan): Must be ZEROED for proper functioning.
+struct post_process {
+	b32 BlurEnabled;
+	s32 BlurRadius;
+
+	b32 BloomEnabled;
+	s32 BloomRadius;
+	f32 BloomThreshold; // NOTE(ivan): 0..1, only colors above are bloomed.
+	f32 BloomIntensity;
+
+	// NOTE(ivan): Half-resolution ping-pong buffers, reallocated when the surface size changes.
+	s32 SurfaceWidth;
+	s32 SurfaceHeight;
+	image HalfA;
+	image HalfB;
+};
+
+void ApplyPostProcess(platform_state *PlatformState,
+					  platform_api *PlatformAPI,
+					  post_process *PostProcess,
+					  struct game_surface_buffer *Buffer);
+
+void FreePostProcess(platform_api *PlatformAPI,
+					 post_process *PostProcess);
+
+#endif // #ifndef GAME_POST_PROCESS_H
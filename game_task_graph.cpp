@@ -0,0 +1,135 @@
+#include "game.h"
+#include "game_task_graph.h"
+
+b32
+InitializeTaskGraph(platform_state *PlatformState,
+					platform_api *PlatformAPI,
+					memory_stack *MemoryStack,
+					task_graph *Graph,
+					work_queue *Queue,
+					u32 MaxTasks)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(MemoryStack);
+	Assert(Graph);
+	Assert(Queue);
+	Assert(MaxTasks);
+
+	Graph->PlatformAPI = PlatformAPI;
+	Graph->Queue = Queue;
+	Graph->Group = {};
+	Graph->IsRunning = false;
+
+	if (!InitializeArenaArray(PlatformState, PlatformAPI, MemoryStack, &Graph->Tasks, MaxTasks)) {
+		PlatformAPI->Log(PlatformState, "TaskGraph: Out of memory!");
+		return false;
+	}
+
+	return true;
+}
+
+task_graph_task *
+AddTask(task_graph *Graph,
+		const char *DebugName,
+		work_queue_callback *Callback,
+		void *Data)
+{
+	Assert(Graph);
+	Assert(Callback);
+	Assert(!Graph->IsRunning);
+
+	task_graph_task *Task = PushArenaArray(&Graph->Tasks);
+	if (Task) {
+		memset(Task, 0, sizeof(task_graph_task));
+		Task->Graph = Graph;
+		Task->DebugName = DebugName;
+		Task->Callback = Callback;
+		Task->Data = Data;
+	}
+
+	return Task;
+}
+
+void
+AddTaskDependency(task_graph_task *Task,
+				  task_graph_task *Predecessor)
+{
+	Assert(Task);
+	Assert(Predecessor);
+	Assert(Task->Graph == Predecessor->Graph);
+	Assert(!Task->Graph->IsRunning);
+	Assert(Predecessor < Task); // NOTE(ivan): Depending on later tasks only could make a cycle.
+	Assert(Predecessor->NumSuccessors < MAX_TASK_SUCCESSORS);
+
+	Predecessor->Successors[Predecessor->NumSuccessors++] = Task;
+	Task->NumPredecessors++;
+}
+
+static WORK_QUEUE_CALLBACK(DoTaskGraphTask);
+
+// NOTE(ivan): Tasks run as fiber entries, see task_graph_task.
+inline work_queue_entry
+MakeTaskGraphEntry(task_graph_task *Task)
+{
+	work_queue_entry Result;
+	Result.Callback = DoTaskGraphTask;
+	Result.Data = Task;
+	Result.Group = &Task->Graph->Group;
+	Result.RunOnFiber = true;
+	Result.Name = Task->DebugName;
+
+	return Result;
+}
+
+static WORK_QUEUE_CALLBACK(DoTaskGraphTask)
+{
+	task_graph_task *Task = (task_graph_task *)Data;
+	task_graph *Graph = Task->Graph;
+
+	Task->Callback(Queue, Task->Data);
+
+	// NOTE(ivan): The last predecessor done schedules the successor. This entry still counts in the group
+	// until it returns, so the group cannot run dry while successors are being added.
+	work_queue_entry Entries[MAX_TASK_SUCCESSORS];
+	u32 NumEntries = 0;
+	for (u32 Index = 0; Index < Task->NumSuccessors; Index++) {
+		task_graph_task *Successor = Task->Successors[Index];
+		if (AtomicAddU32(&Successor->NumPendingPredecessors, (u32)-1) == 1)
+			Entries[NumEntries++] = MakeTaskGraphEntry(Successor);
+	}
+	Graph->PlatformAPI->AddWorkQueueEntries(Queue, Entries, NumEntries);
+}
+
+void
+RunTaskGraph(task_graph *Graph)
+{
+	Assert(Graph);
+	Assert(!Graph->IsRunning);
+
+	Graph->IsRunning = true;
+
+	// NOTE(ivan): Counters must all be armed before the first task may finish.
+	for (u32 Index = 0; Index < Graph->Tasks.Count; Index++) {
+		task_graph_task *Task = Graph->Tasks.Items + Index;
+		Task->NumPendingPredecessors = Task->NumPredecessors;
+	}
+	CompletePastWritesBeforeFutureWrites();
+
+	// NOTE(ivan): Roots are added in batches, one wake-up per batch.
+	work_queue_entry Entries[32];
+	u32 NumEntries = 0;
+	for (u32 Index = 0; Index < Graph->Tasks.Count; Index++) {
+		task_graph_task *Task = Graph->Tasks.Items + Index;
+		if (!Task->NumPredecessors)
+			Entries[NumEntries++] = MakeTaskGraphEntry(Task);
+
+		if (NumEntries == CountOf(Entries) || (NumEntries && Index == Graph->Tasks.Count - 1)) {
+			Graph->PlatformAPI->AddWorkQueueEntries(Graph->Queue, Entries, NumEntries);
+			NumEntries = 0;
+		}
+	}
+
+	Graph->PlatformAPI->WaitForWorkGroup(Graph->Queue, &Graph->Group);
+	Graph->IsRunning = false;
+}
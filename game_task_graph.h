@@ -0,0 +1,59 @@
+#ifndef GAME_TASK_GRAPH_H
+#define GAME_TASK_GRAPH_H
+
+#include "game_platform.h"
+#include "game_memory.h"
+
+// NOTE(ivan): Maximal number of tasks that may depend on a single task.
+#define MAX_TASK_SUCCESSORS 16
+
+struct task_graph;
+
+// NOTE(ivan): Task graph node, runs on the graph's work queue as soon as all its predecessors are done.
+// Tasks run as fiber entries, so a task waiting for a work group (ParallelFor() too) does not hold up a worker.
+struct task_graph_task {
+	task_graph *Graph;
+	const char *DebugName;
+
+	work_queue_callback *Callback;
+	void *Data;
+
+	u32 NumPredecessors;
+	volatile u32 NumPendingPredecessors; // NOTE(ivan): Counts down while the graph runs.
+
+	u32 NumSuccessors;
+	task_graph_task *Successors[MAX_TASK_SUCCESSORS];
+};
+
+// NOTE(ivan): Dependency graph of tasks, built up front and then run at once on a work queue.
+// Tasks may only depend on tasks added before them, so the graph can never have a cycle.
+// NOTE(ivan): Tasks' memory comes from the memory stack given to InitializeTaskGraph(), usually a per-frame one.
+struct task_graph {
+	platform_api *PlatformAPI;
+	work_queue *Queue;
+
+	arena_array<task_graph_task> Tasks;
+	work_group Group; // NOTE(ivan): All tasks of the graph that are scheduled but not done yet.
+	b32 IsRunning;
+};
+
+b32 InitializeTaskGraph(platform_state *PlatformState,
+						platform_api *PlatformAPI,
+						memory_stack *MemoryStack,
+						task_graph *Graph,
+						work_queue *Queue,
+						u32 MaxTasks);
+
+// NOTE(ivan): Returns zero if the graph is full.
+task_graph_task * AddTask(task_graph *Graph,
+						  const char *DebugName,
+						  work_queue_callback *Callback,
+						  void *Data);
+void AddTaskDependency(task_graph_task *Task,
+					   task_graph_task *Predecessor);
+
+// NOTE(ivan): Schedules tasks that depend on nothing and returns once every task is done,
+// doing the queue's entries meanwhile. The graph may be run again afterwards.
+void RunTaskGraph(task_graph *Graph);
+
+#endif // #ifndef GAME_TASK_GRAPH_H
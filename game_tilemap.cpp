@@ -0,0 +1,264 @@
+#include "game.h"
+#include "game_tilemap.h"
+
+uptr
+EvictTileMapCache(platform_api *PlatformAPI,
+				  tile_map *TileMap)
+{
+	Assert(PlatformAPI);
+	Assert(TileMap);
+
+	uptr Result = 0;
+	if (!TileMap->Chunks)
+		return Result;
+
+	for (s32 ChunkY = 0; ChunkY < (s32)TileMap->NumChunksY; ChunkY++) {
+		for (s32 ChunkX = 0; ChunkX < (s32)TileMap->NumChunksX; ChunkX++) {
+			if (ChunkX >= TileMap->VisibleMinChunkX && ChunkX <= TileMap->VisibleMaxChunkX &&
+				ChunkY >= TileMap->VisibleMinChunkY && ChunkY <= TileMap->VisibleMaxChunkY)
+				continue;
+
+			tile_chunk *Chunk = TileMap->Chunks + ChunkY * TileMap->NumChunksX + ChunkX;
+			if (!Chunk->Image.Pixels)
+				continue;
+
+			Result += Chunk->Image.Pitch * Chunk->Image.Height;
+			FreeImage(PlatformAPI, &Chunk->Image);
+			Chunk->Image.Pixels = 0;
+		}
+	}
+
+	return Result;
+}
+
+static MEMORY_PRESSURE_CALLBACK(TileMapMemoryPressure)
+{
+	tile_map *TileMap = (tile_map *)Param;
+
+	// NOTE(ivan): Invisible chunks are cheap to re-bake, so any level is enough to drop them.
+	if (Level != MemoryPressureLevel_None && (!DebugName || strcmp(DebugName, IMAGES_MEMORY_NAME) == 0)) {
+		uptr BytesFreed = EvictTileMapCache(PlatformAPI, TileMap);
+		if (BytesFreed)
+			PlatformAPI->Log(PlatformState, "TileMap: Evicted %llu bytes of cached chunks.", (u64)BytesFreed);
+	}
+}
+
+INITIALIZE_TILE_MAP(InitializeTileMap)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(TileMap);
+	Assert(NumTilesX);
+	Assert(NumTilesY);
+	Assert(TileWidth > 0);
+	Assert(TileHeight > 0);
+	Assert(TileSet);
+	Assert(TileSetCount);
+
+	TileMap->TileWidth = TileWidth;
+	TileMap->TileHeight = TileHeight;
+	TileMap->NumTilesX = NumTilesX;
+	TileMap->NumTilesY = NumTilesY;
+	TileMap->NumChunksX = (NumTilesX + TILE_CHUNK_DIM - 1) / TILE_CHUNK_DIM;
+	TileMap->NumChunksY = (NumTilesY + TILE_CHUNK_DIM - 1) / TILE_CHUNK_DIM;
+	TileMap->TileSet = TileSet;
+	TileMap->TileSetCount = TileSetCount;
+
+	for (u32 Index = 0; Index < TileSetCount; Index++) {
+		Assert(TileSet[Index]);
+		Assert(TileSet[Index]->Width == TileWidth);
+		Assert(TileSet[Index]->Height == TileHeight);
+		Assert(TileSet[Index]->BytesPerPixel == 4); // NOTE(ivan): Chunks are baked as 32-bit, rows are copied as is.
+	}
+
+	// NOTE(ivan): Nothing is visible until pushed for the first time.
+	TileMap->VisibleMinChunkX = TileMap->VisibleMinChunkY = 0;
+	TileMap->VisibleMaxChunkX = TileMap->VisibleMaxChunkY = -1;
+
+	// NOTE(ivan): Chunks come zeroed, so every tile is TILE_EMPTY and nothing is baked.
+	TileMap->Chunks = (tile_chunk *)PlatformAPI->AllocateMemory(sizeof(tile_chunk) * TileMap->NumChunksX * TileMap->NumChunksY);
+	if (!TileMap->Chunks) {
+		PlatformAPI->Log(PlatformState, "TileMap: Out of memory!");
+		return false;
+	}
+
+	if (!RegisterMemoryPressureCallback(TileMapMemoryPressure, TileMap))
+		PlatformAPI->Log(PlatformState, "TileMap: Too many memory pressure callbacks, cache will not be evicted!");
+
+	return true;
+}
+
+FREE_TILE_MAP(FreeTileMap)
+{
+	Assert(PlatformAPI);
+	Assert(TileMap);
+
+	if (!TileMap->Chunks)
+		return;
+
+	UnregisterMemoryPressureCallback(TileMapMemoryPressure, TileMap);
+
+	for (u32 Index = 0; Index < TileMap->NumChunksX * TileMap->NumChunksY; Index++) {
+		tile_chunk *Chunk = TileMap->Chunks + Index;
+		if (Chunk->Image.Pixels)
+			FreeImage(PlatformAPI, &Chunk->Image);
+	}
+
+	PlatformAPI->DeallocateMemory(TileMap->Chunks);
+	TileMap->Chunks = 0;
+}
+
+inline tile_chunk *
+GetTileChunk(tile_map *TileMap, u32 TileX, u32 TileY)
+{
+	Assert(TileMap);
+	Assert(TileX < TileMap->NumTilesX);
+	Assert(TileY < TileMap->NumTilesY);
+
+	return TileMap->Chunks + (TileY / TILE_CHUNK_DIM) * TileMap->NumChunksX + (TileX / TILE_CHUNK_DIM);
+}
+
+SET_TILE_MAP_TILE(SetTileMapTile)
+{
+	Assert(TileMap);
+	Assert(Tile <= TileMap->TileSetCount);
+
+	if (TileX >= TileMap->NumTilesX || TileY >= TileMap->NumTilesY)
+		return;
+
+	tile_chunk *Chunk = GetTileChunk(TileMap, TileX, TileY);
+	u16 *Target = Chunk->Tiles + (TileY % TILE_CHUNK_DIM) * TILE_CHUNK_DIM + (TileX % TILE_CHUNK_DIM);
+	if (*Target == Tile)
+		return; // NOTE(ivan): Do not invalidate the cache for nothing.
+
+	if (*Target == TILE_EMPTY)
+		Chunk->NumSolidTiles++;
+	else if (Tile == TILE_EMPTY)
+		Chunk->NumSolidTiles--;
+
+	*Target = Tile;
+	Chunk->IsDirty = true;
+}
+
+GET_TILE_MAP_TILE(GetTileMapTile)
+{
+	Assert(TileMap);
+
+	if (TileX >= TileMap->NumTilesX || TileY >= TileMap->NumTilesY)
+		return TILE_EMPTY;
+
+	tile_chunk *Chunk = GetTileChunk(TileMap, TileX, TileY);
+	return Chunk->Tiles[(TileY % TILE_CHUNK_DIM) * TILE_CHUNK_DIM + (TileX % TILE_CHUNK_DIM)];
+}
+
+static b32
+BakeTileChunk(platform_state *PlatformState,
+			  platform_api *PlatformAPI,
+			  tile_map *TileMap,
+			  u32 ChunkX, u32 ChunkY)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(TileMap);
+
+	tile_chunk *Chunk = TileMap->Chunks + ChunkY * TileMap->NumChunksX + ChunkX;
+
+	// NOTE(ivan): Border chunks may be smaller than TILE_CHUNK_DIM tiles.
+	u32 NumTilesX = Min(TILE_CHUNK_DIM, TileMap->NumTilesX - ChunkX * TILE_CHUNK_DIM);
+	u32 NumTilesY = Min(TILE_CHUNK_DIM, TileMap->NumTilesY - ChunkY * TILE_CHUNK_DIM);
+
+	if (!Chunk->Image.Pixels) {
+		static const s32 BytesPerPixel = 4;
+
+		Chunk->Image.Width = NumTilesX * TileMap->TileWidth;
+		Chunk->Image.Height = NumTilesY * TileMap->TileHeight;
+		Chunk->Image.BytesPerPixel = BytesPerPixel;
+		Chunk->Image.Pitch = Chunk->Image.Width * BytesPerPixel;
+		Chunk->Image.Pixels = AllocateTrackedMemory(PlatformState, PlatformAPI, IMAGES_MEMORY_NAME,
+													Chunk->Image.Pitch * Chunk->Image.Height);
+		if (!Chunk->Image.Pixels) {
+			PlatformAPI->Log(PlatformState, "TileMap: Out of memory while baking chunk [%u, %u]!", ChunkX, ChunkY);
+			return false;
+		}
+	}
+
+	// NOTE(ivan): Plain copy, not a blend: tiles never overlap inside a chunk,
+	// and the chunk keeps source alpha so it blends correctly when drawn later.
+	u32 TileRowBytes = TileMap->TileWidth * Chunk->Image.BytesPerPixel;
+	for (u32 TileY = 0; TileY < NumTilesY; TileY++) {
+		for (u32 TileX = 0; TileX < NumTilesX; TileX++) {
+			u16 Tile = Chunk->Tiles[TileY * TILE_CHUNK_DIM + TileX];
+			u8 *DestRow = ((u8 *)Chunk->Image.Pixels +
+						   (TileY * TileMap->TileHeight) * Chunk->Image.Pitch +
+						   TileX * TileRowBytes);
+
+			if (Tile == TILE_EMPTY) {
+				for (s32 Y = 0; Y < TileMap->TileHeight; Y++) {
+					memset(DestRow, 0, TileRowBytes);
+					DestRow += Chunk->Image.Pitch;
+				}
+			} else {
+				image *TileImage = TileMap->TileSet[Tile - 1];
+				u8 *SourceRow = (u8 *)TileImage->Pixels;
+				for (s32 Y = 0; Y < TileMap->TileHeight; Y++) {
+					memcpy(DestRow, SourceRow, TileRowBytes);
+					DestRow += Chunk->Image.Pitch;
+					SourceRow += TileImage->Pitch;
+				}
+			}
+		}
+	}
+
+	Chunk->IsDirty = false;
+	return true;
+}
+
+PUSH_DRAW_GROUP_TILE_MAP(PushDrawGroupTileMap)
+{
+	Assert(PlatformState);
+	Assert(PlatformAPI);
+	Assert(Group);
+	Assert(TileMap);
+
+	if (!TileMap->Chunks)
+		return;
+	if (ViewWidth <= 0 || ViewHeight <= 0)
+		return;
+
+	s32 ChunkWidth = TILE_CHUNK_DIM * TileMap->TileWidth;
+	s32 ChunkHeight = TILE_CHUNK_DIM * TileMap->TileHeight;
+
+	// NOTE(ivan): Find visible chunks range, so the cost depends on the view size only.
+	s32 MinChunkX = (s32)floorf(CameraPos.X / (f32)ChunkWidth);
+	s32 MinChunkY = (s32)floorf(CameraPos.Y / (f32)ChunkHeight);
+	s32 MaxChunkX = (s32)floorf((CameraPos.X + (f32)(ViewWidth - 1)) / (f32)ChunkWidth);
+	s32 MaxChunkY = (s32)floorf((CameraPos.Y + (f32)(ViewHeight - 1)) / (f32)ChunkHeight);
+
+	MinChunkX = Max(MinChunkX, 0);
+	MinChunkY = Max(MinChunkY, 0);
+	MaxChunkX = Min(MaxChunkX, (s32)TileMap->NumChunksX - 1);
+	MaxChunkY = Min(MaxChunkY, (s32)TileMap->NumChunksY - 1);
+
+	TileMap->VisibleMinChunkX = MinChunkX;
+	TileMap->VisibleMinChunkY = MinChunkY;
+	TileMap->VisibleMaxChunkX = MaxChunkX;
+	TileMap->VisibleMaxChunkY = MaxChunkY;
+
+	for (s32 ChunkY = MinChunkY; ChunkY <= MaxChunkY; ChunkY++) {
+		for (s32 ChunkX = MinChunkX; ChunkX <= MaxChunkX; ChunkX++) {
+			tile_chunk *Chunk = TileMap->Chunks + ChunkY * TileMap->NumChunksX + ChunkX;
+			if (!Chunk->NumSolidTiles)
+				continue;
+
+			if (Chunk->IsDirty || !Chunk->Image.Pixels) {
+				if (!BakeTileChunk(PlatformState, PlatformAPI, TileMap, ChunkX, ChunkY))
+					continue;
+			}
+
+			PushDrawGroupImage(Group,
+							   MakeV2((f32)(ChunkX * ChunkWidth) - CameraPos.X,
+									  (f32)(ChunkY * ChunkHeight) - CameraPos.Y),
+							   &Chunk->Image);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef GAME_TILEMAP_H
+#define GAME_TILEMAP_H
+
+#include "game_platform.h"
+#include "game_math.h"
+#include "game_image.h"
+#include "game_draw_group.h"
+
+// NOTE(ivan): Tile map chunk dimension, in tiles.
+// Each chunk is rasterized into its own cached image and re-baked only when any of its tiles change.
+#define TILE_CHUNK_DIM 16
+
+// NOTE(ivan): Tile value that means "nothing is here".
+#define TILE_EMPTY 0
+
+// NOTE(ivan): Tile map chunk.
+struct tile_chunk {
+	u16 Tiles[TILE_CHUNK_DIM * TILE_CHUNK_DIM]; // NOTE(ivan): Zero is empty, otherwise (index + 1) into the tile set.
+	u32 NumSolidTiles; // NOTE(ivan): Number of non-empty tiles, empty chunks are never baked nor drawn.
+
+	image Image; // NOTE(ivan): Cached pre-rasterized chunk, Pixels is zero if not baked yet.
+	b32 IsDirty;
+};
+
+// NOTE(ivan): Tile map.
+// NOTE(ivan): Must be ZEROED for proper functioning.
+struct tile_map {
+	s32 TileWidth; // NOTE(ivan): In pixels.
+	s32 TileHeight; // NOTE(ivan): In pixels.
+
+	u32 NumTilesX;
+	u32 NumTilesY;
+
+	u32 NumChunksX;
+	u32 NumChunksY;
+	tile_chunk *Chunks;
+
+	// NOTE(ivan): Tile set, every image MUST be exactly TileWidth x TileHeight and 32-bit.
+	image **TileSet;
+	u32 TileSetCount;
+
+	// NOTE(ivan): Chunks range pushed last time, baked images outside of it are evicted under memory pressure.
+	s32 VisibleMinChunkX;
+	s32 VisibleMinChunkY;
+	s32 VisibleMaxChunkX;
+	s32 VisibleMaxChunkY;
+};
+
+// NOTE(ivan): The tile map registers itself for memory pressure, so both it and its tile set MUST live in memory
+// that survives entities module reloads, e.g. an entity state, and MUST be freed before that memory goes away.
+#define INITIALIZE_TILE_MAP(name) b32 name(platform_state *PlatformState, platform_api *PlatformAPI, tile_map *TileMap, u32 NumTilesX, u32 NumTilesY, s32 TileWidth, s32 TileHeight, image **TileSet, u32 TileSetCount)
+typedef INITIALIZE_TILE_MAP(initialize_tile_map);
+
+#define FREE_TILE_MAP(name) void name(platform_api *PlatformAPI, tile_map *TileMap)
+typedef FREE_TILE_MAP(free_tile_map);
+
+// NOTE(ivan): Frees baked images of chunks that were not visible last time, they are re-baked once visible again.
+// Returns number of bytes freed. Tile maps do this on their own under memory pressure on images budget.
+uptr EvictTileMapCache(platform_api *PlatformAPI,
+					   tile_map *TileMap);
+
+#define SET_TILE_MAP_TILE(name) void name(tile_map *TileMap, u32 TileX, u32 TileY, u16 Tile)
+typedef SET_TILE_MAP_TILE(set_tile_map_tile);
+
+#define GET_TILE_MAP_TILE(name) u16 name(tile_map *TileMap, u32 TileX, u32 TileY)
+typedef GET_TILE_MAP_TILE(get_tile_map_tile);
+
+// NOTE(ivan): Bakes dirty visible chunks and pushes one image entry per visible chunk.
+// CameraPos is the map-space pixel position of the view's top-left corner.
+#define PUSH_DRAW_GROUP_TILE_MAP(name) void name(platform_state *PlatformState, platform_api *PlatformAPI, draw_group *Group, tile_map *TileMap, v2 CameraPos, s32 ViewWidth, s32 ViewHeight)
+typedef PUSH_DRAW_GROUP_TILE_MAP(push_draw_group_tile_map);
+
+INITIALIZE_TILE_MAP(InitializeTileMap);
+FREE_TILE_MAP(FreeTileMap);
+SET_TILE_MAP_TILE(SetTileMapTile);
+GET_TILE_MAP_TILE(GetTileMapTile);
+PUSH_DRAW_GROUP_TILE_MAP(PushDrawGroupTileMap);
+
+#endif // #ifndef GAME_TILEMAP_H